@@ -5,24 +5,26 @@ DB_NAME = "./db/map.db"
 con = sqlite3.connect(DB_NAME, autocommit=False)
 cur = con.cursor()
 
+# nodes and edges are stored clustered on (chunk_id, id), chunk ids are the Morton keys of chunk_id() in populate_db.py
 sql_script = """
     CREATE TABLE IF NOT EXISTS node (
-        id INTEGER PRIMARY KEY,
-        chunk_id STRING,
+        id INTEGER NOT NULL,
+        chunk_id INTEGER NOT NULL,
         offset_lon REAL,
         offset_lat REAL,
         num_out_edges INTEGER,
         num_in_edges INTEGER,
+        PRIMARY KEY(chunk_id, id),
         FOREIGN KEY(chunk_id) REFERENCES chunk(id)
-    );
+    ) WITHOUT ROWID;
     CREATE INDEX IF NOT EXISTS idx_node_offset_lon ON node (offset_lon);
     CREATE INDEX IF NOT EXISTS idx_node_offset_lat ON node (offset_lat);
-    CREATE INDEX IF NOT EXISTS idx_node_chunk_id ON node (chunk_id);
+    CREATE UNIQUE INDEX IF NOT EXISTS idx_node_id ON node (id);
 
     CREATE TABLE IF NOT EXISTS edge (
-        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        id INTEGER NOT NULL,
         osm_id INTEGER,
-        chunk_id STRING,
+        chunk_id INTEGER NOT NULL,
         source_node_id INTEGER,
         target_node_id INTEGER,
         path_length_meters REAL,
@@ -33,16 +35,18 @@ sql_script = """
         path_bike_bwd INTEGER,
         path_train INTEGER,
         path_offset_points TEXT,
+        path_geometry BLOB,
+        PRIMARY KEY(chunk_id, id),
         FOREIGN KEY(source_node_id) REFERENCES node(id),
         FOREIGN KEY(target_node_id) REFERENCES node(id),
         FOREIGN KEY(chunk_id) REFERENCES chunk(id)
-    );
+    ) WITHOUT ROWID;
     CREATE INDEX IF NOT EXISTS idx_edge_source_node_id ON edge (source_node_id);
     CREATE INDEX IF NOT EXISTS idx_edge_target_node_id ON edge (target_node_id);
-    CREATE INDEX IF NOT EXISTS idx_edge_chunk_id ON edge (chunk_id);
+    CREATE UNIQUE INDEX IF NOT EXISTS idx_edge_id ON edge (id);
 
     CREATE TABLE IF NOT EXISTS chunk (
-        id STRING PRIMARY KEY,
+        id INTEGER PRIMARY KEY,
         row INTEGER,
         col INTEGER,
         offset_lat_top REAL,
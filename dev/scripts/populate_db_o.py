@@ -22,8 +22,9 @@ class Point:
 @dataclass
 class Edge:
     # SQL COLUMNS
+    id: ID
     osm_id: ID
-    chunk_id: str
+    chunk_id: int
     source_node_id: ID
     target_node_id: ID
     path_length_meters: decimal.Decimal
@@ -37,7 +38,7 @@ class Edge:
 
     def sql_tuple(self) -> tuple:
         return (
-            None,
+            self.id,
             self.osm_id,
             self.chunk_id,
             self.source_node_id,
@@ -49,7 +50,8 @@ class Edge:
             self.path_bike_fwd,
             self.path_bike_bwd,
             self.path_train,
-            ','.join(str(point.x) + ' ' + str(point.y) for point in self.path_offset_points)
+            ','.join(str(point.x) + ' ' + str(point.y) for point in self.path_offset_points),
+            None  # path_geometry, encoded from the text points when the app first opens the database
         )
 
 
@@ -57,7 +59,7 @@ class Edge:
 class Node:
     # SQL COLUMNS
     id: ID
-    chunk_id: str
+    chunk_id: int
     offset_lon: decimal.Decimal
     offset_lat: decimal.Decimal
     num_out_edges: int
@@ -77,7 +79,7 @@ class Node:
 @dataclass
 class Chunk:
     # SQL COLUMNS
-    id: str
+    id: int
     row: int
     col: int
     offset_lat_top: decimal.Decimal
@@ -105,8 +107,13 @@ class Rect:
     height: decimal.Decimal
 
 
-def chunk_id(row, col) -> str:
-    return f"{row},{col}"
+def chunk_id(row, col) -> int:
+    # the bits of row and col interleaved (a Morton code), the same as sql::chunkKey in src/sql.h
+    key = 0
+    for bit in range(16):
+        key |= ((col >> bit) & 1) << (2 * bit)
+        key |= ((row >> bit) & 1) << (2 * bit + 1)
+    return key
 
 
 def chunk_grid_pos(point: Point, chunk_size: decimal.Decimal) -> tuple[int, int]:
@@ -150,7 +157,7 @@ def node_generator(map_bbox: Rect, chunk_size: decimal.Decimal, node_num_out_edg
             cols = line.split(',')
             node = Node(
                 int(cols[0]),
-                '',
+                0,
                 decimal.Decimal(cols[1]),
                 decimal.Decimal(cols[2]),
                 0,
@@ -179,6 +186,7 @@ def edge_generator(chunk_size: decimal.Decimal, map_bbox: Rect, node_num_out_edg
 
     with open("./data/edges_bboxed.csv") as f:
         f.readline()  # skip columns headers
+        edge_id = 0  # the edge table has no rowid to number the edges with
         for line in tqdm(f, 'making and inserting edges', n_edges):
             line = line.strip()
             wkt_start = line.find(',"L')
@@ -189,7 +197,9 @@ def edge_generator(chunk_size: decimal.Decimal, map_bbox: Rect, node_num_out_edg
             # edge belongs to chunk where path starts
             chunk_row, chunk_col = chunk_grid_pos(path[0], chunk_size)
 
+            edge_id += 1
             edge = Edge(
+                edge_id,
                 int(cols[0]),
                 chunk_id(chunk_row, chunk_col),
                 int(cols[1]),
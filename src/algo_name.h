@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+
+enum class AlgoName
+{
+    AStar,
+    Dijkstras,
+    ContractionHierarchies,
+    BidirectionalAStar,
+    BidirectionalDijkstras,
+    ALT,
+    BidirectionalALT
+};
+
+// Short names of the algorithms, as used on the command line of the tools
+static const char *const algoNameStrings[] = {"astar", "dijkstra", "ch", "biastar", "bidijkstra", "alt", "bialt"};
+
+inline std::string algoNameToString(AlgoName algorithm)
+{
+    return algoNameStrings[(int)algorithm];
+}
+
+/**
+ * Finds the algorithm with the given short name.
+ *
+ * @param name One of the names in `algoNameStrings`
+ * @param algorithm Set to the algorithm if the name is known
+ * @return true if the name is known
+ */
+inline bool parseAlgoName(const std::string &name, AlgoName &algorithm)
+{
+    for (int i = 0; i < int(sizeof(algoNameStrings) / sizeof(algoNameStrings[0])); ++i)
+    {
+        if (name == algoNameStrings[i])
+        {
+            algorithm = (AlgoName)i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -1,9 +1,21 @@
+#pragma once
+
 #include <iostream>
 #include <SFML/Graphics.hpp>
 #include "geometry.h"
 #include <utility>
 #include <queue>
 #include "pubsub.h"
+#include "graph.h"
+#include "algo_name.h"
+#include "cancellation_token.h"
+#include "search_progress.h"
+#include "contraction_hierarchy.h"
+#include "landmarks.h"
+#include "search_workspace.h"
+#include "distance_matrix.h"
+#include "isochrone.h"
+#include "traffic_overlay.h"
 
 using namespace std;
 
@@ -11,240 +23,970 @@ class Algorithms : public ps::Publisher
 {
 public:
     /**
-     * Finds the shortest path between two nodes using Dijkstra's algorithm.
+     * Finds the shortest path between two nodes using Dijkstra's algorithm, which is A* search
+     * with a heuristic of zero.
      *
      * @param startNodeIndex The index of the start node
      * @param endNodeIndex The index of the end node
      * @param graph The graph to search
+     * @param profile The edge weights to minimise, the shortest distance or a travel time. Car
+     * travel times include the live traffic of the snapshot that is current when the search starts.
      * @return The shortest path between the two nodes
      */
-    vector<GraphEdgeIndex> Dijkstra(GraphNodeIndex startNodeIndex, GraphNodeIndex endNodeIndex, MapGraph &graph, bool animate)
+    vector<GraphEdgeIndex> Dijkstra(GraphNodeIndex startNodeIndex, GraphNodeIndex endNodeIndex, MapGraph &graph, bool animate, const CancellationToken &cancellation = CancellationToken::none(), RoutingProfile profile = RoutingProfile::Distance)
     {
-        vector<long long int> weights(graph.getNodeCount(), 9999999999999);
-        weights[startNodeIndex] = 0; // The distance from the start node to itself is 0.
+        std::shared_ptr<const TrafficSnapshot> traffic = trafficOverlay.current();
+        return aStar(SearchEnds::betweenNodes(startNodeIndex, endNodeIndex), graph, traffic->getEdgeWeights(graph, profile), animate, cancellation, [](GraphNodeIndex)
+                     { return 0.0; });
+    }
 
-        // Each index in prev is a node that holds its previous node prev[D] = A if the shortest path so far to D came from A.
-        vector<GraphNodeIndex> prev(graph.getNodeCount(), -1);
-        vector<GraphEdgeIndex> pathEdges(graph.getEdgeCount(), -1);
+    /**
+     * Finds the shortest path between two points on roads using Dijkstra's algorithm. The search
+     * starts from both ends of the origin's road, at the weight of the part of the road that leads
+     * to them, and finishes on the destination's road the same way.
+     *
+     * @param origin The origin, snapped to a road with MapGraph::snapToRoad
+     * @param destination The destination, snapped to a road
+     * @return The shortest path, its first edge is only driven from the origin on and its last edge
+     * only up to the destination (see MapGraph::getPathLength)
+     */
+    vector<GraphEdgeIndex> Dijkstra(const RoadSnap &origin, const RoadSnap &destination, MapGraph &graph, bool animate, const CancellationToken &cancellation = CancellationToken::none(), RoutingProfile profile = RoutingProfile::Distance)
+    {
+        std::shared_ptr<const TrafficSnapshot> traffic = trafficOverlay.current();
+        const Column<int> &weights = traffic->getEdgeWeights(graph, profile);
+        return aStar(SearchEnds::betweenRoads(origin, destination, graph, weights), graph, weights, animate, cancellation, [](GraphNodeIndex)
+                     { return 0.0; });
+    }
+
+    /**
+     * Finds the shortest path between two nodes using A* search.
+     *
+     * The heuristic is the straight line distance from a node to the end node, which can never be
+     * longer than the road distance. For a travel time profile it is the time that distance takes
+     * at the profile's highest speed.
+     *
+     * @param startNodeIndex The index of the start node
+     * @param endNodeIndex The index of the end node
+     * @param graph The graph to search
+     * @return The shortest path between the two nodes
+     */
+    vector<GraphEdgeIndex> aStarSearch(GraphNodeIndex startNodeIndex, GraphNodeIndex endNodeIndex, MapGraph &graph, bool animate, const CancellationToken &cancellation = CancellationToken::none(), RoutingProfile profile = RoutingProfile::Distance)
+    {
+        double endLon = graph.getNodeLon(endNodeIndex);
+        double endLat = graph.getNodeLat(endNodeIndex);
+        double costPerMeter = profileCostPerMeter(profile);
+        std::shared_ptr<const TrafficSnapshot> traffic = trafficOverlay.current();
 
-        // pq.first = distance to start node, pq.second = the nodeID;
-        priority_queue<pair<int, GraphNodeIndex>, vector<pair<int, GraphNodeIndex>>, greater<pair<int, GraphNodeIndex>>> minPQ;
-        minPQ.push(make_pair(0, startNodeIndex));
+        return aStar(SearchEnds::betweenNodes(startNodeIndex, endNodeIndex), graph, traffic->getEdgeWeights(graph, profile), animate, cancellation, [&](GraphNodeIndex nodeIndex)
+                     { return costPerMeter * geoDistanceLowerBound(graph.getNodeLon(nodeIndex), graph.getNodeLat(nodeIndex), endLon, endLat); });
+    }
 
-        set<GraphEdgeIndex> visitedEdges; // Not used if animation is disabled.
+    /**
+     * Finds the shortest path between two points on roads using A* search, the heuristic is the
+     * straight line distance to the destination. See the Dijkstra overload for the points.
+     *
+     * @param origin The origin, snapped to a road with MapGraph::snapToRoad
+     * @param destination The destination, snapped to a road
+     * @return The shortest path, its first and last edge are only driven in part
+     */
+    vector<GraphEdgeIndex> aStarSearch(const RoadSnap &origin, const RoadSnap &destination, MapGraph &graph, bool animate, const CancellationToken &cancellation = CancellationToken::none(), RoutingProfile profile = RoutingProfile::Distance)
+    {
+        double costPerMeter = profileCostPerMeter(profile);
+        std::shared_ptr<const TrafficSnapshot> traffic = trafficOverlay.current();
+        const Column<int> &weights = traffic->getEdgeWeights(graph, profile);
+        return aStar(SearchEnds::betweenRoads(origin, destination, graph, weights), graph, weights, animate, cancellation, [&](GraphNodeIndex nodeIndex)
+                     { return costPerMeter * geoDistanceLowerBound(graph.getNodeLon(nodeIndex), graph.getNodeLat(nodeIndex), destination.point.x, destination.point.y); });
+    }
 
-        while (!minPQ.empty())
-        {
-            std::pair<int, GraphNodeIndex> v = minPQ.top();
-            minPQ.pop();
+    /**
+     * Finds the shortest path between two nodes using A* search with the ALT heuristic, a lower
+     * bound from precomputed landmark distances (see landmarks.h). Requires `prepareLandmarks`.
+     *
+     * @param startNodeIndex The index of the start node
+     * @param endNodeIndex The index of the end node
+     * @param graph The graph to search
+     * @return The shortest path between the two nodes
+     */
+    vector<GraphEdgeIndex> landmarkAStarSearch(GraphNodeIndex startNodeIndex, GraphNodeIndex endNodeIndex, MapGraph &graph, bool animate, const CancellationToken &cancellation = CancellationToken::none())
+    {
+        Landmarks::QueryBounds bounds = landmarks.prepareQuery(startNodeIndex, endNodeIndex);
+
+        return aStar(SearchEnds::betweenNodes(startNodeIndex, endNodeIndex), graph, graph.getEdgeWeights(RoutingProfile::Distance), animate, cancellation, [&](GraphNodeIndex nodeIndex)
+                     { return bounds.toEnd(nodeIndex); });
+    }
+
+    /**
+     * Finds the shortest path between two nodes using bidirectional Dijkstra. One search grows
+     * from the start node along out edges while another grows from the end node along in edges,
+     * and the path is found where they meet.
+     *
+     * @param startNodeIndex The index of the start node
+     * @param endNodeIndex The index of the end node
+     * @param graph The graph to search
+     * @param profile The edge weights to minimise
+     * @return The shortest path between the two nodes
+     */
+    vector<GraphEdgeIndex> bidirectionalDijkstra(GraphNodeIndex startNodeIndex, GraphNodeIndex endNodeIndex, MapGraph &graph, bool animate, const CancellationToken &cancellation = CancellationToken::none(), RoutingProfile profile = RoutingProfile::Distance)
+    {
+        std::shared_ptr<const TrafficSnapshot> traffic = trafficOverlay.current();
+        return bidirectionalSearch(startNodeIndex, endNodeIndex, graph, traffic->getEdgeWeights(graph, profile), animate, cancellation, [](GraphNodeIndex)
+                                   { return 0.0; });
+    }
+
+    /**
+     * Finds the shortest path between two nodes using bidirectional A* search.
+     *
+     * Both searches need to agree on the node potentials for the meeting criterion to hold, so the
+     * forward search uses the average of the distance-to-end and distance-from-start lower bounds,
+     * and the backward search uses its negation.
+     *
+     * @param startNodeIndex The index of the start node
+     * @param endNodeIndex The index of the end node
+     * @param graph The graph to search
+     * @return The shortest path between the two nodes
+     */
+    vector<GraphEdgeIndex> bidirectionalAStar(GraphNodeIndex startNodeIndex, GraphNodeIndex endNodeIndex, MapGraph &graph, bool animate, const CancellationToken &cancellation = CancellationToken::none(), RoutingProfile profile = RoutingProfile::Distance)
+    {
+        double startLon = graph.getNodeLon(startNodeIndex);
+        double startLat = graph.getNodeLat(startNodeIndex);
+        double endLon = graph.getNodeLon(endNodeIndex);
+        double endLat = graph.getNodeLat(endNodeIndex);
+        double costPerMeter = profileCostPerMeter(profile);
+        std::shared_ptr<const TrafficSnapshot> traffic = trafficOverlay.current();
+
+        return bidirectionalSearch(startNodeIndex, endNodeIndex, graph, traffic->getEdgeWeights(graph, profile), animate, cancellation, [&](GraphNodeIndex nodeIndex)
+                                   {
+            double lon = graph.getNodeLon(nodeIndex);
+            double lat = graph.getNodeLat(nodeIndex);
+            double toEnd = geoDistanceLowerBound(lon, lat, endLon, endLat);
+            double fromStart = geoDistanceLowerBound(startLon, startLat, lon, lat);
+            return costPerMeter * (toEnd - fromStart) / 2; });
+    }
 
-            GraphNode currentNode = graph.getNode(v.second);
+    /**
+     * Finds the shortest path between two nodes using bidirectional A* search with the ALT heuristic.
+     * Requires `prepareLandmarks`.
+     *
+     * @param startNodeIndex The index of the start node
+     * @param endNodeIndex The index of the end node
+     * @param graph The graph to search
+     * @return The shortest path between the two nodes
+     */
+    vector<GraphEdgeIndex> bidirectionalLandmarkAStar(GraphNodeIndex startNodeIndex, GraphNodeIndex endNodeIndex, MapGraph &graph, bool animate, const CancellationToken &cancellation = CancellationToken::none())
+    {
+        Landmarks::QueryBounds bounds = landmarks.prepareQuery(startNodeIndex, endNodeIndex);
+
+        return bidirectionalSearch(startNodeIndex, endNodeIndex, graph, graph.getEdgeWeights(RoutingProfile::Distance), animate, cancellation, [&](GraphNodeIndex nodeIndex)
+                                   { return (bounds.toEnd(nodeIndex) - bounds.fromStart(nodeIndex)) / 2; });
+    }
 
-            for (auto edgeIndex : currentNode.outEdges)
+    /**
+     * Loads the landmark distance tables for the graph from disk, or computes and saves them if
+     * the file is missing or was made for a different graph. Computing them runs several full
+     * graph searches, so this should be called from a background thread.
+     *
+     * @param graph The fully loaded graph
+     * @param cachePath File that the distance tables are stored in
+     * @param landmarkCount Number of landmarks to use
+     * @param cancellation Stops the computation, nothing is saved then
+     */
+    void prepareLandmarks(MapGraph &graph, std::string cachePath, int landmarkCount, const CancellationToken &cancellation = CancellationToken::none())
+    {
+        if (landmarks.load(cachePath, graph, landmarkCount))
+            return;
+
+        landmarks.build(graph, landmarkCount, cancellation);
+        if (landmarks.isBuilt())
+            landmarks.save(cachePath);
+    }
+
+    bool isLandmarksReady() const
+    {
+        return landmarks.isBuilt();
+    }
+
+    /**
+     * Loads the contraction hierarchy for the graph from disk, or builds and saves it if the
+     * file is missing or was made for a different graph. Building can take a while, so this
+     * should be called from a background thread.
+     *
+     * @param graph The fully loaded graph
+     * @param cachePath File that the preprocessed hierarchy is stored in
+     * @param cancellation Stops the build, nothing is saved then
+     */
+    void prepareContractionHierarchy(MapGraph &graph, std::string cachePath, const CancellationToken &cancellation = CancellationToken::none())
+    {
+        if (contractionHierarchy.load(cachePath, graph))
+            return;
+
+        contractionHierarchy.build(graph, cancellation);
+        if (contractionHierarchy.isBuilt())
+            contractionHierarchy.save(cachePath);
+    }
+
+    bool isContractionHierarchyReady() const
+    {
+        return contractionHierarchy.isBuilt();
+    }
+
+    /**
+     * The live traffic on the car weights, see TrafficOverlay. Searches by car read the snapshot
+     * that is current when they start, the distance only algorithms never read it.
+     */
+    TrafficOverlay &getTrafficOverlay()
+    {
+        return trafficOverlay;
+    }
+
+    /**
+     * Finds the shortest path between two nodes using the preprocessed contraction hierarchy.
+     *
+     * @param startNodeIndex The index of the start node
+     * @param endNodeIndex The index of the end node
+     * @param graph The graph to search
+     * @return The shortest path between the two nodes
+     */
+    vector<GraphEdgeIndex> contractionHierarchySearch(GraphNodeIndex startNodeIndex, GraphNodeIndex endNodeIndex, MapGraph &graph, bool animate)
+    {
+        // In the case of an animation the settled nodes are sent to the UI in batches.
+        SearchProgress progress(animate, [this](ps::Event &&event)
+                                { emitEvent(std::move(event)); });
+
+        return contractionHierarchy.query(startNodeIndex, endNodeIndex, [&](GraphNodeIndex settledNodeIndex)
+                                          { progress.add(graph.getNodeLon(settledNodeIndex), graph.getNodeLat(settledNodeIndex)); });
+    }
+
+    /**
+     * Computes the road distance from every origin to every destination. The origins are spread
+     * over `threadCount` threads, every thread runs its own searches.
+     *
+     * MatrixMethod::OneToMany runs one Dijkstra per origin that stops once all destinations are
+     * settled. MatrixMethod::Buckets needs `prepareContractionHierarchy`: an upward search from
+     * every destination leaves its distance in a bucket at each node it settles, then an upward
+     * search from every origin reads the buckets of the nodes it settles. Both searches settle a
+     * few hundred nodes, so a matrix costs about as much as origins + destinations queries.
+     *
+     * @param origins Nodes of the rows, -1 for a row without any path
+     * @param destinations Nodes of the columns, -1 for a column without any path
+     * @return The matrix, SearchLabels::unreachable where there is no path
+     */
+    DistanceMatrix distanceMatrix(const vector<GraphNodeIndex> &origins, const vector<GraphNodeIndex> &destinations, MapGraph &graph, MatrixMethod method, int threadCount)
+    {
+        DistanceMatrix matrix;
+        matrix.rows = origins.size();
+        matrix.cols = destinations.size();
+        matrix.distances.assign((size_t)matrix.rows * matrix.cols, SearchLabels::unreachable);
+
+        auto startTime = std::chrono::steady_clock::now();
+        std::atomic<long long int> settledNodes = 0;
+        if (method == MatrixMethod::Buckets)
+            bucketDistances(origins, destinations, matrix, threadCount, settledNodes);
+        else
+            oneToManyDistances(origins, destinations, graph, matrix, threadCount, settledNodes);
+
+        matrix.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        matrix.settledNodes = settledNodes;
+        return matrix;
+    }
+
+    /**
+     * Finds everything that can be reached from a point on a road within each of the budgets, with
+     * a Dijkstra that stops once the cost of the next node exceeds the largest budget. The search
+     * starts from both ends of the origin's road, like the road snapping searches.
+     *
+     * The outline of a band is traced around the reachable roads, including the reachable part
+     * of the roads that lead out of it, see ReachabilityGrid.
+     *
+     * @param origin The point the isochrone is measured from, see MapGraph::snapToRoad
+     * @param budgets Meters for RoutingProfile::Distance, seconds for the travel time profiles
+     * @param cancellation Stops the search early, the returned isochrone is empty then
+     */
+    Isochrone isochrone(const RoadSnap &origin, vector<double> budgets, RoutingProfile profile, MapGraph &graph, const CancellationToken &cancellation = CancellationToken::none())
+    {
+        Isochrone result;
+        result.profile = profile;
+        sort(budgets.begin(), budgets.end());
+        result.budgets = budgets;
+        if (origin.road == -1 || budgets.empty())
+            return result;
+
+        // costs are searched in the units of the profile's weights, whole meters or milliseconds
+        double unitsPerBudget = profile == RoutingProfile::Distance ? 1 : 1000;
+        long long int maxCost = llround(budgets.back() * unitsPerBudget);
+
+        auto startTime = std::chrono::steady_clock::now();
+        SearchWorkspace &workspace = SearchWorkspace::forThisThread();
+        workspace.reset(graph.getNodeCount());
+        SearchLabels &labels = workspace.labels[0];
+        SearchQueue &minPQ = workspace.queues[0];
+        std::shared_ptr<const TrafficSnapshot> traffic = trafficOverlay.current();
+        const Column<int> &weights = traffic->getEdgeWeights(graph, profile);
+
+        vector<GraphEdgeIndex> originEdges;
+        for (bool forward : {true, false})
+        {
+            GraphEdgeIndex edgeIndex = graph.getRoadEdge(origin.road, forward);
+            if (edgeIndex == -1 || weights[edgeIndex] == forbiddenWeight)
+                continue;
+            originEdges.push_back(edgeIndex);
+
+            GraphNodeIndex v = graph.getEdgeTarget(edgeIndex);
+            long long int cost = graph.getPartialEdgeWeight(edgeIndex, &origin, nullptr, weights);
+            if (cost < labels.getDistance(v))
             {
-                GraphEdge edge = graph.getEdge(edgeIndex);
-                GraphNodeIndex targetNodeIndex = edge.to;
+                labels.setDistance(v, cost, edgeIndex);
+                minPQ.push(cost, v);
+            }
+        }
 
-                // In the case of an animation we want to emit an event to update the UI.
-                if (animate)
-                {
-                    ps::Event event(ps::EventType::NodeTouched);
-                    event.data = ps::Data::Vector2(currentNode.data.offsetLon, currentNode.data.offsetLat);
-                    emitEvent(event);
-                }
+        vector<long long int> costs;
+        while (!minPQ.empty())
+        {
+            if (cancellation.isCancelled())
+                return Isochrone();
 
-                // Calculate the distance from the start node to the current node.
-                // And update if the new distance is shorter.
-                long long int distanceFromStart = edge.weight + weights[v.second];
-                if (distanceFromStart < weights[targetNodeIndex])
+            auto [key, v] = minPQ.top();
+            minPQ.pop();
+            if (key > maxCost)
+                break;
+            if (labels.isSettled(v))
+                continue;
+            labels.settle(v);
+            workspace.stats.settledNodes++;
+
+            long long int cost = labels.getDistance(v);
+            result.nodes.push_back(v);
+            costs.push_back(cost);
+
+            for (auto edgeIndex : graph.getOutEdges(v))
+            {
+                GraphNodeIndex targetNodeIndex = graph.getEdgeTarget(edgeIndex);
+                if (weights[edgeIndex] == forbiddenWeight)
+                    continue;
+                long long int costFromStart = cost + weights[edgeIndex];
+                if (costFromStart < labels.getDistance(targetNodeIndex) && costFromStart <= maxCost)
                 {
-                    weights[targetNodeIndex] = distanceFromStart;
-                    prev[targetNodeIndex] = v.second;
-                    pathEdges[targetNodeIndex] = edgeIndex;
-                    minPQ.push(make_pair(distanceFromStart, targetNodeIndex));
+                    labels.setDistance(targetNodeIndex, costFromStart, edgeIndex);
+                    minPQ.push(costFromStart, targetNodeIndex);
                 }
             }
+        }
 
-            // Stop early if we have reached the end node to avoid unnecessary computation.
-            // Guaranteed to be the shortest path.
-            if (v.second == endNodeIndex)
+        // the nodes are settled in cost order, so every band is a prefix of them
+        for (long long int cost : costs)
+            result.costs.push_back(cost / unitsPerBudget);
+        for (double budget : budgets)
+            result.bandEnds.push_back(upper_bound(costs.begin(), costs.end(), llround(budget * unitsPerBudget)) - costs.begin());
+        result.searchMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+        startTime = std::chrono::steady_clock::now();
+        traceIsochroneOutlines(origin, originEdges, costs, unitsPerBudget, graph, weights, result);
+        result.outlineMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        return result;
+    }
+
+    /**
+     * Whether findShortestPath snaps the origin and destination to the nearest point on a road for
+     * this algorithm, instead of to the nearest node. The first and last edge of its paths are then
+     * only driven in part, the points they are driven from and to are given by MapGraph::snapToRoad.
+     */
+    static bool snapsToRoads(AlgoName algorithm)
+    {
+        return algorithm == AlgoName::Dijkstras || algorithm == AlgoName::AStar;
+    }
+
+    /**
+     * Whether findShortestPath can route by a profile with this algorithm. The landmarks and the
+     * contraction hierarchy are prepared from the distance weights, so ALT and CH only route by
+     * distance. The other searches read the weight column of any profile.
+     */
+    static bool supportsProfile(AlgoName algorithm, RoutingProfile profile)
+    {
+        bool isPrepared = algorithm == AlgoName::ALT || algorithm == AlgoName::BidirectionalALT || algorithm == AlgoName::ContractionHierarchies;
+        return profile == RoutingProfile::Distance || !isPrepared;
+    }
+
+    /**
+     * Finds a shortest path between origin and destination using the selected algorithm. The
+     * origin and destination are snapped to the nearest road for the algorithms that support it
+     * (see snapsToRoads) and to their nearest node for the others.
+     *
+     * @param animate Emit SearchProgress events with the nodes the search settles
+     * @param cancellation Stops the search early, the returned path is empty then
+     * @param profile The edge weights to minimise
+     * @throws std::invalid_argument if the algorithm does not support the profile, see supportsProfile
+     * @return The shortest path, empty if the origin or destination is off the map
+     */
+    vector<GraphEdgeIndex> findShortestPath(sf::Vector2<double> offsetLonLatOrigin, sf::Vector2<double> offsetLonLatDestination, AlgoName algorithm, MapGraph &mapGraph, bool animate,
+                                            const CancellationToken &cancellation = CancellationToken::none(), RoutingProfile profile = RoutingProfile::Distance)
+    {
+        if (!supportsProfile(algorithm, profile))
+            throw std::invalid_argument(algoNameToString(algorithm) + " only routes by distance, not by " + routingProfileToString(profile));
+
+        if (snapsToRoads(algorithm))
+        {
+            RoadSnap origin = mapGraph.snapToRoad(offsetLonLatOrigin.x, offsetLonLatOrigin.y);
+            RoadSnap destination = mapGraph.snapToRoad(offsetLonLatDestination.x, offsetLonLatDestination.y);
+            if (origin.road == -1 || destination.road == -1)
+                return vector<GraphEdgeIndex>();
+
+            if (algorithm == AlgoName::Dijkstras)
+                return Dijkstra(origin, destination, mapGraph, animate, cancellation, profile);
+            return aStarSearch(origin, destination, mapGraph, animate, cancellation, profile);
+        }
+
+        // Get the origin and destination nodes
+        GraphNodeIndex startNodeIndex = mapGraph.findNearestNode(offsetLonLatOrigin.x, offsetLonLatOrigin.y);
+        GraphNodeIndex endNodeIndex = mapGraph.findNearestNode(offsetLonLatDestination.x, offsetLonLatDestination.y);
+        if (startNodeIndex == -1 || endNodeIndex == -1)
+            return vector<GraphEdgeIndex>();
+
+        if (algorithm == AlgoName::BidirectionalDijkstras)
+        {
+            return bidirectionalDijkstra(startNodeIndex, endNodeIndex, mapGraph, animate, cancellation, profile);
+        }
+        else if (algorithm == AlgoName::BidirectionalAStar)
+        {
+            return bidirectionalAStar(startNodeIndex, endNodeIndex, mapGraph, animate, cancellation, profile);
+        }
+        else if (algorithm == AlgoName::ALT)
+        {
+            return landmarkAStarSearch(startNodeIndex, endNodeIndex, mapGraph, animate, cancellation);
+        }
+        else if (algorithm == AlgoName::BidirectionalALT)
+        {
+            return bidirectionalLandmarkAStar(startNodeIndex, endNodeIndex, mapGraph, animate, cancellation);
+        }
+        else
+        {
+            return contractionHierarchySearch(startNodeIndex, endNodeIndex, mapGraph, animate);
+        }
+    }
+
+private:
+    /**
+     * Where an A* search starts and where it may finish. A search between two nodes has one source
+     * and one target, a search between two points on roads has a source and a target for each way
+     * that the road of the point can be driven.
+     */
+    struct SearchEnds
+    {
+        struct End
+        {
+            GraphNodeIndex node;
+            long long int distance; // from the origin to a source node, or from a target node to the destination
+            GraphEdgeIndex edge;    // the edge that distance is driven on, -1 for none
+        };
+
+        vector<End> sources;
+        vector<End> targets;
+
+        // A path that stays on one edge, when the origin and destination are on the same road
+        long long int directDistance = SearchLabels::unreachable;
+        GraphEdgeIndex directEdge = -1;
+
+        static SearchEnds betweenNodes(GraphNodeIndex startNodeIndex, GraphNodeIndex endNodeIndex)
+        {
+            SearchEnds ends;
+            ends.sources.push_back(End{startNodeIndex, 0, -1});
+            ends.targets.push_back(End{endNodeIndex, 0, -1});
+            return ends;
+        }
+
+        // The ways of the roads that are forbiddenWeight in the weights are left out.
+        static SearchEnds betweenRoads(const RoadSnap &origin, const RoadSnap &destination, const MapGraph &graph, const Column<int> &weights)
+        {
+            SearchEnds ends;
+            for (bool forward : {true, false})
             {
-                vector<GraphEdgeIndex> path;
-                vector<GraphNodeIndex> pathNodes;
-                GraphNodeIndex current = endNodeIndex;
-                while (current != -1)
+                GraphEdgeIndex originEdge = graph.getRoadEdge(origin.road, forward);
+                if (originEdge != -1 && weights[originEdge] == forbiddenWeight)
+                    originEdge = -1;
+                if (originEdge != -1)
+                    ends.sources.push_back(End{graph.getEdgeTarget(originEdge), graph.getPartialEdgeWeight(originEdge, &origin, nullptr, weights), originEdge});
+
+                GraphEdgeIndex destinationEdge = graph.getRoadEdge(destination.road, forward);
+                if (destinationEdge != -1 && weights[destinationEdge] != forbiddenWeight)
+                    ends.targets.push_back(End{graph.getEdgeSource(destinationEdge), graph.getPartialEdgeWeight(destinationEdge, nullptr, &destination, weights), destinationEdge});
+
+                // driving along the road from the origin reaches the destination without leaving the edge
+                bool isAhead = forward ? origin.fraction <= destination.fraction : origin.fraction >= destination.fraction;
+                if (origin.road == destination.road && originEdge != -1 && isAhead)
                 {
-                    pathNodes.push_back(current);
-                    path.push_back(pathEdges[current]);
-                    current = prev[current];
+                    long long int distance = graph.getPartialEdgeWeight(originEdge, &origin, &destination, weights);
+                    if (distance < ends.directDistance)
+                    {
+                        ends.directDistance = distance;
+                        ends.directEdge = originEdge;
+                    }
                 }
-
-                reverse(pathNodes.begin(), pathNodes.end());
-                reverse(path.begin(), path.end());
-                path.erase(path.begin()); // Since the start node has no edge leading to it, we remove the first edge which has -1.
-
-                // TESTING: This loop prints the path of edges, and the nodes in the path.
-                // for (auto e : path)
-                // {
-                //     auto edge = graph.getEdge(e);
-                //     std::cout << "EdgeID: " << e << std::endl;
-                // }
-                // MapGeometry mapGeometry;
-                // for (auto e : pathNodes)
-                // {
-                //     auto node = graph.getNode(e);
-                //     auto globalLonLat = mapGeometry.unoffsetGeoVector({node.data.offsetLon, node.data.offsetLat});
-                //     std::cout << "Node: " << e << " at " << globalLonLat.y << " " << globalLonLat.x << std::endl;
-                // }
-
-                return path;
             }
+            return ends;
         }
-
-        return vector<GraphEdgeIndex>(); // Empty vector if no path exists.
-    }
+    };
 
     /**
-     * Finds the shortest path between two nodes using A* search.
+     * Shared implementation of the A* searches.
      *
-     * @param startNodeIndex The index of the start node
-     * @param endNodeIndex The index of the end node
-     * @param graph The graph to search
-     * @return The shortest path between the two nodes
+     * @param ends The source nodes the search starts from and the target nodes it can finish at
+     * @param weights The weight column to search, see MapGraph::getEdgeWeights and TrafficSnapshot
+     * @param cancellation The search gives up and returns an empty path once this is cancelled
+     * @param heuristic Returns a lower bound of the distance from a node to the destination
      */
-    vector<GraphEdgeIndex> aStarSearch(GraphNodeIndex startNodeIndex, GraphNodeIndex endNodeIndex, MapGraph &graph, bool animate)
+    template <typename Heuristic>
+    vector<GraphEdgeIndex> aStar(const SearchEnds &ends, MapGraph &graph, const Column<int> &weights, bool animate, const CancellationToken &cancellation, Heuristic heuristic)
     {
         /*
         This is very similar to Djikstra's algorithm, but with a heuristic added to the weights.
-        The hueuristic is the euclidean distance from the current node to the end node,
-        which defines the shortest possible distance. This means that the algorithm will prioritize
-        nodes that are closer to the end node geometrically rather than just the shortest path between the nodes.
+        The heuristic is a lower bound of the distance from the current node to the end node.
+        This means that the algorithm will prioritize nodes that are closer to the end node
+        rather than just the shortest path between the nodes.
         */
 
-        // It's necessary to track both the total distance traveled to the node as well as each node's heuristic.
-        vector<long long int> weights(graph.getNodeCount(), 9999999999999);
-        weights[startNodeIndex] = 0;
-        vector<long long int> heuristic(graph.getNodeCount(), 9999999999999);
-        heuristic[endNodeIndex] = 0;
-
-        // Initializes the heuristic for the start node.
-        GraphNode startNode = graph.getNode(startNodeIndex);
-        GraphNode endNode = graph.getNode(endNodeIndex);
-        double endX = endNode.data.offsetLon;
-        double endY = endNode.data.offsetLat;
-        double startX = startNode.data.offsetLon;
-        double startY = startNode.data.offsetLat;
-        heuristic[startNodeIndex] = distanceBetweenPoints(startX, startY, endX, endY);
-
-        // Each index in prev is a node that holds its previous node prev[D] = A if the shortest path so far to D came from A.
-        vector<GraphNodeIndex> prev(graph.getNodeCount(), -1);
-        vector<GraphEdgeIndex> pathEdges(graph.getEdgeCount(), -1);
-
-        // pq.first = distance to start node, pq.second = the nodeID;
-        priority_queue<pair<int, GraphNodeIndex>, vector<pair<int, GraphNodeIndex>>, greater<pair<int, GraphNodeIndex>>> minPQ;
-        minPQ.push(make_pair(0, startNodeIndex));
+        // It's necessary to track the total distance traveled to each node, the heuristic is only used for the queue order.
+        // The labels and queue are reused between queries, resetting them only forgets the nodes touched last time.
+        SearchWorkspace &workspace = SearchWorkspace::forThisThread();
+        workspace.reset(graph.getNodeCount());
+        SearchLabels &labels = workspace.labels[0];
+        SearchQueue &minPQ = workspace.queues[0];
+        SearchStats &stats = workspace.stats;
+
+        // In the case of an animation the settled nodes are sent to the UI in batches.
+        SearchProgress progress(animate, [this](ps::Event &&event)
+                                { emitEvent(std::move(event)); });
+
+        // Each node's label holds the edge that the shortest path so far reached it through, -1 for the sources.
+        // key = distance to the origin plus the heuristic
+        for (const SearchEnds::End &source : ends.sources)
+        {
+            if (source.distance < labels.getDistance(source.node))
+            {
+                labels.setDistance(source.node, source.distance, -1);
+                minPQ.push(source.distance + heuristic(source.node), source.node);
+                stats.heapPushes++;
+            }
+        }
+
+        // Length of the shortest path found so far, and the target it finishes at (none for the direct path).
+        long long int bestDistance = ends.directDistance;
+        const SearchEnds::End *bestTarget = nullptr;
 
         while (!minPQ.empty())
         {
-            std::pair<int, GraphNodeIndex> v = minPQ.top();
+            if (cancellation.isCancelled())
+            {
+                progress.discard();
+                return vector<GraphEdgeIndex>();
+            }
+
+            double key = minPQ.top().first;
+            GraphNodeIndex v = minPQ.top().second;
             minPQ.pop();
+            stats.heapPops++;
 
-            GraphNode currentNode = graph.getNode(v.second);
+            // Any path that is not found yet is at least as long as the smallest key, so the best path is final.
+            if (key >= bestDistance)
+                break;
 
-            for (auto edgeIndex : currentNode.outEdges)
-            {
+            // A node can be queued several times, only the first time it is popped is its distance final.
+            if (labels.isSettled(v))
+                continue;
+            labels.settle(v);
+            stats.settledNodes++;
+            progress.add(graph.getNodeLon(v), graph.getNodeLat(v));
 
-                // In the case of an animation we want to emit an event to update the UI.
-                if (animate)
+            for (const SearchEnds::End &target : ends.targets)
+            {
+                if (target.node == v && labels.getDistance(v) + target.distance < bestDistance)
                 {
-                    ps::Event event(ps::EventType::NodeTouched);
-                    event.data = ps::Data::Vector2(currentNode.data.offsetLon, currentNode.data.offsetLat);
-                    emitEvent(event);
+                    bestDistance = labels.getDistance(v) + target.distance;
+                    bestTarget = &target;
                 }
+            }
+
+            // Stop early once the path through this node is the best, to avoid unnecessary computation.
+            // Guaranteed to be the shortest path.
+            if (key >= bestDistance)
+                break;
+
+            for (auto edgeIndex : graph.getOutEdges(v))
+            {
+                GraphNodeIndex targetNodeIndex = graph.getEdgeTarget(edgeIndex);
+                stats.relaxedEdges++;
 
-                GraphEdge edge = graph.getEdge(edgeIndex);
-                GraphNodeIndex targetNodeIndex = edge.to;
-                GraphNode nextNode = graph.getNode(targetNodeIndex);
-                double nextNodeX = nextNode.data.offsetLon;
-                double nextNodeY = nextNode.data.offsetLat;
+                // The profile may not use this edge, a bike on a motorway or a road closed by traffic.
+                int weight = weights[edgeIndex];
+                if (weight == forbiddenWeight)
+                    continue;
 
                 // Calculate the distance from the start node to the current node.
                 // And update if the new distance is shorter.
-                long long int distanceFromStart = edge.weight + weights[v.second];
-                if (distanceFromStart < weights[targetNodeIndex])
+                long long int distanceFromStart = weight + labels.getDistance(v);
+                if (distanceFromStart < labels.getDistance(targetNodeIndex))
                 {
-                    weights[targetNodeIndex] = distanceFromStart;
-                    // Calculate the A* cost and update if the new cost is shorter.
-                    double heuristicDistance = distanceBetweenPoints(nextNodeX, nextNodeY, endX, endY);
-                    double heuristicMeters = degreesToMeters(heuristicDistance);
-                    long long int aStarCost = distanceFromStart + heuristicMeters;
-                    heuristic[targetNodeIndex] = aStarCost;
-                    prev[targetNodeIndex] = v.second;
-                    pathEdges[targetNodeIndex] = edgeIndex; // Store the edge index so we can reconstruct the path later.
-                    minPQ.push(make_pair(aStarCost, targetNodeIndex));
+                    labels.setDistance(targetNodeIndex, distanceFromStart, edgeIndex);
+                    minPQ.push(distanceFromStart + heuristic(targetNodeIndex), targetNodeIndex);
+                    stats.heapPushes++;
                 }
             }
+        }
 
-            // Stop early if we have reached the end node to avoid unnecessary computation.
-            if (v.second == endNodeIndex)
+        if (bestDistance == SearchLabels::unreachable)
+            return vector<GraphEdgeIndex>(); // Empty vector if no path exists.
+        if (!bestTarget)
+            return vector<GraphEdgeIndex>{ends.directEdge};
+
+        // Follow the parent edges back from the target to the source the path starts at, and add
+        // the edges from the origin and to the destination that lead to them.
+        vector<GraphEdgeIndex> path;
+        if (bestTarget->edge != -1)
+            path.push_back(bestTarget->edge);
+        GraphNodeIndex current = bestTarget->node;
+        for (GraphEdgeIndex edgeIndex = labels.getParentEdge(current); edgeIndex != -1; edgeIndex = labels.getParentEdge(current))
+        {
+            path.push_back(edgeIndex);
+            current = graph.getEdgeSource(edgeIndex);
+        }
+        for (const SearchEnds::End &source : ends.sources)
+        {
+            if (source.node == current && source.distance == labels.getDistance(current))
+            {
+                if (source.edge != -1)
+                    path.push_back(source.edge);
+                break;
+            }
+        }
+
+        reverse(path.begin(), path.end());
+        return path;
+    }
+
+    // Draws the reachable roads of every band of an isochrone into a grid and traces their outlines, see isochrone.
+    void traceIsochroneOutlines(const RoadSnap &origin, const vector<GraphEdgeIndex> &originEdges, const vector<long long int> &costs,
+                                double unitsPerBudget, const MapGraph &graph, const Column<int> &weights, Isochrone &result)
+    {
+        // Calls visit(points, reachable fraction) for every edge that can be driven in part within
+        // `cost` units, the points are the edge's shape from where the isochrone enters it.
+        vector<sf::Vector2<double>> points;
+        auto forEachReachedEdge = [&](size_t nodeCount, long long int cost, auto visit)
+        {
+            for (GraphEdgeIndex edgeIndex : originEdges)
+            {
+                long long int edgeCost = graph.getPartialEdgeWeight(edgeIndex, &origin, nullptr, weights);
+                points.clear();
+                graph.appendEdgePoints(edgeIndex, &origin, nullptr, points);
+                visit(points, edgeCost > 0 ? min(1.0, (double)cost / edgeCost) : 1.0);
+            }
+            for (size_t i = 0; i < nodeCount; ++i)
+            {
+                for (auto edgeIndex : graph.getOutEdges(result.nodes[i]))
+                {
+                    long long int edgeCost = weights[edgeIndex];
+                    if (edgeCost == forbiddenWeight)
+                        continue;
+                    points.clear();
+                    graph.appendEdgePoints(edgeIndex, nullptr, nullptr, points);
+                    visit(points, edgeCost > 0 ? min(1.0, double(cost - costs[i]) / edgeCost) : 1.0);
+                }
+            }
+        };
+
+        // the largest band covers all the others, so its bounding box is the grid's area
+        long long int maxCost = llround(result.budgets.back() * unitsPerBudget);
+        double left = origin.point.x, right = left, top = origin.point.y, bottom = top;
+        forEachReachedEdge(result.nodes.size(), maxCost, [&](const vector<sf::Vector2<double>> &edgePoints, double)
+                           {
+            for (sf::Vector2<double> point : edgePoints)
+            {
+                left = min(left, point.x);
+                right = max(right, point.x);
+                top = min(top, point.y);
+                bottom = max(bottom, point.y);
+            } });
+        ReachabilityGrid grid(left, top, right - left, bottom - top, isochroneGridCells);
+
+        for (size_t band = 0; band < result.budgets.size(); ++band)
+        {
+            grid.clear();
+            grid.markPoint(origin.point);
+            forEachReachedEdge(result.bandEnds[band], llround(result.budgets[band] * unitsPerBudget), [&](const vector<sf::Vector2<double>> &edgePoints, double reachable)
+                               {
+                // the cost is spread evenly over the edge's shape, so the reachable part is the same
+                // fraction of its length
+                double length = 0;
+                for (size_t i = 0; i + 1 < edgePoints.size(); ++i)
+                    length += hypot(edgePoints[i + 1].x - edgePoints[i].x, edgePoints[i + 1].y - edgePoints[i].y);
+
+                double remaining = reachable * length;
+                for (size_t i = 0; i + 1 < edgePoints.size() && remaining > 0; ++i)
+                {
+                    sf::Vector2<double> start = edgePoints[i], end = edgePoints[i + 1];
+                    double step = hypot(end.x - start.x, end.y - start.y);
+                    if (step > remaining)
+                        end = sf::Vector2<double>(start.x + (end.x - start.x) * remaining / step, start.y + (end.y - start.y) * remaining / step);
+                    grid.markLine(start, end);
+                    remaining -= step;
+                } });
+            result.bandRings.push_back(grid.traceRings());
+        }
+    }
+
+    // Fills the matrix with a Dijkstra per origin, see distanceMatrix.
+    void oneToManyDistances(const vector<GraphNodeIndex> &origins, const vector<GraphNodeIndex> &destinations, MapGraph &graph, DistanceMatrix &matrix,
+                            int threadCount, std::atomic<long long int> &settledNodes)
+    {
+        // the columns of every node, so that a settled node finds its columns without a search
+        int nodeCount = graph.getNodeCount();
+        vector<int> firstColumn(nodeCount + 1, 0);
+        for (GraphNodeIndex destination : destinations)
+        {
+            if (destination != -1)
+                firstColumn[destination + 1]++;
+        }
+        int destinationNodes = 0;
+        for (GraphNodeIndex v = 0; v < nodeCount; ++v)
+        {
+            destinationNodes += firstColumn[v + 1] > 0;
+            firstColumn[v + 1] += firstColumn[v];
+        }
+        vector<int> columns(firstColumn[nodeCount]);
+        vector<int> nextColumn(firstColumn.begin(), firstColumn.end() - 1);
+        for (int col = 0; col < matrix.cols; ++col)
+        {
+            if (destinations[col] != -1)
+                columns[nextColumn[destinations[col]]++] = col;
+        }
+
+        parallelFor(origins.size(), threadCount, [&](size_t row)
+                    {
+            if (origins[row] == -1)
+                return;
+
+            SearchWorkspace &workspace = SearchWorkspace::forThisThread();
+            workspace.reset(nodeCount);
+            SearchLabels &labels = workspace.labels[0];
+            SearchQueue &minPQ = workspace.queues[0];
+            long long int *distances = matrix.distances.data() + row * matrix.cols;
+
+            labels.setDistance(origins[row], 0, -1);
+            minPQ.push(0, origins[row]);
+
+            // stop once every destination is settled, the rest of the graph does not matter
+            int unsettledDestinations = destinationNodes;
+            while (!minPQ.empty() && unsettledDestinations > 0)
             {
-                vector<GraphEdgeIndex> path;
-                vector<GraphNodeIndex> pathNodes;
-                GraphNodeIndex current = endNodeIndex;
-                while (current != -1)
+                GraphNodeIndex v = minPQ.top().second;
+                minPQ.pop();
+                if (labels.isSettled(v))
+                    continue;
+                labels.settle(v);
+                workspace.stats.settledNodes++;
+
+                long long int distance = labels.getDistance(v);
+                if (firstColumn[v] != firstColumn[v + 1])
                 {
-                    pathNodes.push_back(current);
-                    path.push_back(pathEdges[current]);
-                    current = prev[current];
+                    unsettledDestinations--;
+                    for (int i = firstColumn[v]; i < firstColumn[v + 1]; ++i)
+                        distances[columns[i]] = distance;
                 }
 
-                reverse(pathNodes.begin(), pathNodes.end());
-                reverse(path.begin(), path.end());
-                path.erase(path.begin()); // Since the start node has no edge leading to it, we remove the first edge which has -1.
-
-                // TESTING: This loop prints the path of edges, and the nodes in the path.
-                // for (auto e : path)
-                // {
-                //     auto edge = graph.getEdge(e);
-                //     std::cout << "EdgeID: " << e << std::endl;
-                // }
-                // MapGeometry mapGeometry;
-                // for (auto e : pathNodes)
-                // {
-                //     auto node = graph.getNode(e);
-                //     auto globalLonLat = mapGeometry.unoffsetGeoVector({node.data.offsetLon, node.data.offsetLat});
-                //     std::cout << "Node: " << e << " at " << globalLonLat.y << " " << globalLonLat.x << std::endl;
-                // }
-
-                return path;
+                for (auto edgeIndex : graph.getOutEdges(v))
+                {
+                    GraphNodeIndex targetNodeIndex = graph.getEdgeTarget(edgeIndex);
+                    if (graph.getEdgeWeight(edgeIndex) == forbiddenWeight)
+                        continue;
+                    long long int distanceFromStart = distance + graph.getEdgeWeight(edgeIndex);
+                    if (distanceFromStart < labels.getDistance(targetNodeIndex))
+                    {
+                        labels.setDistance(targetNodeIndex, distanceFromStart, edgeIndex);
+                        minPQ.push(distanceFromStart, targetNodeIndex);
+                    }
+                }
             }
+            settledNodes += workspace.stats.settledNodes; });
+    }
+
+    // Fills the matrix with the bucket based many-to-many search over the contraction hierarchy, see distanceMatrix.
+    void bucketDistances(const vector<GraphNodeIndex> &origins, const vector<GraphNodeIndex> &destinations, DistanceMatrix &matrix,
+                         int threadCount, std::atomic<long long int> &settledNodes)
+    {
+        struct BucketEntry
+        {
+            GraphNodeIndex node;
+            int col;
+            long long int distance; // from the node to the column's destination
+        };
+
+        // backward upward searches from the destinations, every thread collects its own entries
+        auto startTime = std::chrono::steady_clock::now();
+        vector<vector<BucketEntry>> columnEntries(destinations.size());
+        parallelFor(destinations.size(), threadCount, [&](size_t col)
+                    {
+            if (destinations[col] == -1)
+                return;
+            contractionHierarchy.upwardSearch(destinations[col], false, [&](GraphNodeIndex v, long long int distance)
+                                              { columnEntries[col].push_back(BucketEntry{v, (int)col, distance}); });
+            settledNodes += SearchWorkspace::forThisThread().stats.settledNodes; });
+
+        // sort the entries into one bucket per node (counting sort, the same as the graph's edges)
+        int nodeCount = contractionHierarchy.getNodeCount();
+        vector<int> firstEntry(nodeCount + 1, 0);
+        for (const vector<BucketEntry> &entries : columnEntries)
+        {
+            for (const BucketEntry &entry : entries)
+                firstEntry[entry.node + 1]++;
         }
+        for (GraphNodeIndex v = 0; v < nodeCount; ++v)
+            firstEntry[v + 1] += firstEntry[v];
+        vector<pair<int, long long int>> buckets(firstEntry[nodeCount]); // (column, distance)
+        vector<int> nextEntry(firstEntry.begin(), firstEntry.end() - 1);
+        for (vector<BucketEntry> &entries : columnEntries)
+        {
+            for (const BucketEntry &entry : entries)
+                buckets[nextEntry[entry.node]++] = {entry.col, entry.distance};
+            vector<BucketEntry>().swap(entries);
+        }
+        matrix.bucketMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+        // forward upward searches from the origins, a path meets its destination's search at the highest node on it
+        parallelFor(origins.size(), threadCount, [&](size_t row)
+                    {
+            if (origins[row] == -1)
+                return;
+            long long int *distances = matrix.distances.data() + row * matrix.cols;
+            contractionHierarchy.upwardSearch(origins[row], true, [&](GraphNodeIndex v, long long int distance)
+                                              {
+                for (int i = firstEntry[v]; i < firstEntry[v + 1]; ++i)
+                    distances[buckets[i].first] = std::min(distances[buckets[i].first], distance + buckets[i].second); });
+            settledNodes += SearchWorkspace::forThisThread().stats.settledNodes; });
+    }
 
-        return vector<GraphEdgeIndex>(); // Empty vector if no path exists.
+    // Follows the parent edges from the end node back to the start node.
+    vector<GraphEdgeIndex> buildPath(const SearchLabels &labels, MapGraph &graph, GraphNodeIndex startNodeIndex, GraphNodeIndex endNodeIndex)
+    {
+        vector<GraphEdgeIndex> path;
+        for (GraphNodeIndex current = endNodeIndex; current != startNodeIndex;)
+        {
+            GraphEdgeIndex edgeIndex = labels.getParentEdge(current);
+            path.push_back(edgeIndex);
+            current = graph.getEdgeSource(edgeIndex);
+        }
+
+        reverse(path.begin(), path.end());
+        return path;
     }
 
     /**
-     * Finds a shortest path between origin and destination using the selected algorithm
+     * Shared implementation of the bidirectional searches. Index 0 of each pair of arrays belongs
+     * to the forward search from the start node and index 1 to the backward search from the end node.
      *
-     * @return The shortest path
+     * @param cancellation The search gives up and returns an empty path once this is cancelled
+     * @param forwardPotential Returns the potential of a node for the forward search, the backward
+     * search uses the negated value. Must be consistent, a constant potential gives plain Dijkstra.
      */
-    vector<GraphEdgeIndex> findShortestPath(sf::Vector2<double> offsetLonLatOrigin, sf::Vector2<double> offsetLonLatDestination, AlgoName algorithm, MapGraph &mapGraph, MapGeometry &mapGeometry, sf::RenderWindow &window, Viewport viewport, NavBox &navBox)
+    template <typename Potential>
+    vector<GraphEdgeIndex> bidirectionalSearch(GraphNodeIndex startNodeIndex, GraphNodeIndex endNodeIndex, MapGraph &graph, const Column<int> &weights, bool animate, const CancellationToken &cancellation, Potential forwardPotential)
     {
-        // Get the origin and destination nodes
-        pair<int, int> startChunkCoordinate = mapGeometry.getChunkRowCol(offsetLonLatOrigin.y, offsetLonLatOrigin.x);
-        pair<int, int> endChunkCoordinate = mapGeometry.getChunkRowCol(offsetLonLatDestination.y, offsetLonLatDestination.x);
-        GraphNodeIndex startNodeIndex = mapGraph.findNearestNode(startChunkCoordinate.first, startChunkCoordinate.second, offsetLonLatOrigin.x, offsetLonLatOrigin.y);
-        GraphNodeIndex endNodeIndex = mapGraph.findNearestNode(endChunkCoordinate.first, endChunkCoordinate.second, offsetLonLatDestination.x, offsetLonLatDestination.y);
-        GraphNode startNode = mapGraph.getNode(startNodeIndex);
-        GraphNode endNode = mapGraph.getNode(endNodeIndex);
-
-        if (algorithm == AlgoName::Dijkstras)
+        if (startNodeIndex == endNodeIndex)
+            return vector<GraphEdgeIndex>();
+
+        const long long int unreachable = SearchLabels::unreachable;
+        SearchWorkspace &workspace = SearchWorkspace::forThisThread();
+        workspace.reset(graph.getNodeCount());
+        SearchLabels *labels = workspace.labels;
+        labels[0].setDistance(startNodeIndex, 0, -1);
+        labels[1].setDistance(endNodeIndex, 0, -1);
+
+        // key = distance to the search origin plus the potential
+        SearchQueue *minPQ = workspace.queues;
+        minPQ[0].push(forwardPotential(startNodeIndex), startNodeIndex);
+        minPQ[1].push(-forwardPotential(endNodeIndex), endNodeIndex);
+        SearchStats &stats = workspace.stats;
+        stats.heapPushes += 2;
+
+        // In the case of an animation the settled nodes are sent to the UI in batches.
+        SearchProgress progress(animate, [this](ps::Event &&event)
+                                { emitEvent(std::move(event)); });
+
+        // Length of the shortest path found so far, and the node where the two searches met on it.
+        long long int bestDistance = unreachable;
+        GraphNodeIndex meetingNodeIndex = -1;
+
+        // Once either search runs out of nodes it has reached everything it can, so the best path is final.
+        while (!minPQ[0].empty() && !minPQ[1].empty())
         {
-            return Dijkstra(startNodeIndex, endNodeIndex, mapGraph, navBox.getAnimate());
+            // The potentials cancel out on any path from start to end, so the searches can stop once
+            // the smallest keys of both queues add up to the best path length.
+            if (minPQ[0].top().first + minPQ[1].top().first >= bestDistance)
+                break;
+
+            if (cancellation.isCancelled())
+            {
+                progress.discard();
+                return vector<GraphEdgeIndex>();
+            }
+
+            // Expand the search with the smaller key so that both grow at the same rate.
+            int direction = minPQ[0].top().first <= minPQ[1].top().first ? 0 : 1;
+            GraphNodeIndex v = minPQ[direction].top().second;
+            minPQ[direction].pop();
+            stats.heapPops++;
+
+            if (labels[direction].isSettled(v))
+                continue;
+            labels[direction].settle(v);
+            stats.settledNodes++;
+            progress.add(graph.getNodeLon(v), graph.getNodeLat(v));
+
+            EdgeRange edgeIndices = direction == 0 ? graph.getOutEdges(v) : graph.getInEdges(v);
+
+            for (auto edgeIndex : edgeIndices)
+            {
+                GraphNodeIndex targetNodeIndex = direction == 0 ? graph.getEdgeTarget(edgeIndex) : graph.getEdgeSource(edgeIndex);
+                stats.relaxedEdges++;
+
+                int weight = weights[edgeIndex];
+                if (weight == forbiddenWeight)
+                    continue;
+
+                long long int distanceFromOrigin = weight + labels[direction].getDistance(v);
+                if (distanceFromOrigin < labels[direction].getDistance(targetNodeIndex))
+                {
+                    labels[direction].setDistance(targetNodeIndex, distanceFromOrigin, edgeIndex);
+                    double potential = direction == 0 ? forwardPotential(targetNodeIndex) : -forwardPotential(targetNodeIndex);
+                    minPQ[direction].push(distanceFromOrigin + potential, targetNodeIndex);
+                    stats.heapPushes++;
+
+                    // The other search has already reached this node, so there is a path through it.
+                    long long int otherDistance = labels[1 - direction].getDistance(targetNodeIndex);
+                    if (otherDistance != unreachable && distanceFromOrigin + otherDistance < bestDistance)
+                    {
+                        bestDistance = distanceFromOrigin + otherDistance;
+                        meetingNodeIndex = targetNodeIndex;
+                    }
+                }
+            }
         }
-        else
+
+        if (meetingNodeIndex == -1)
+            return vector<GraphEdgeIndex>(); // Empty vector if no path exists.
+
+        // Walk from the meeting node back to the start, then forward to the end.
+        vector<GraphEdgeIndex> path = buildPath(labels[0], graph, startNodeIndex, meetingNodeIndex);
+        for (GraphNodeIndex current = meetingNodeIndex; current != endNodeIndex;)
         {
-            return aStarSearch(startNodeIndex, endNodeIndex, mapGraph, navBox.getAnimate());
+            GraphEdgeIndex edgeIndex = labels[1].getParentEdge(current);
+            path.push_back(edgeIndex);
+            current = graph.getEdgeTarget(edgeIndex);
         }
+
+        return path;
     }
+
+    // cells along the longer side of an isochrone's outline grid, a 30 minute drive makes cells of a few hundred meters
+    static constexpr int isochroneGridCells = 256;
+
+    ContractionHierarchy contractionHierarchy;
+    Landmarks landmarks;
+    TrafficOverlay trafficOverlay;
 };
\ No newline at end of file
@@ -15,6 +15,7 @@
 
 #include "graph.h"
 #include "algorithms.h"
+#include "route_executor.h"
 #include <utility>
 
 class App
@@ -33,14 +34,37 @@ public:
         // connect the custom event queue to listen to events from different publishers
         eventQueue.subscribe(&navBox, ps::EventType::NavBoxSubmitted);
         eventQueue.subscribe(&navBox, ps::EventType::NavBoxFormChanged);
-        eventQueue.subscribe(&algorithms, ps::EventType::NodeTouched);
-
-        // load map data in background. Done event will be handled in event loop.
-        std::thread([this]()
-                    {
-            this->mapGraph.load("./db/map.db");
-            this->eventQueue.pushEvent(ps::Event(ps::EventType::MapDataLoaded)); })
-            .detach();
+        eventQueue.subscribe(&navBox, ps::EventType::IsochroneRequested);
+        eventQueue.subscribe(&algorithms, ps::EventType::SearchProgress);
+
+        routeExecutor.start(*config["routing"]["route_threads"].value<int>(), 64, [this](const std::string &, const std::string &error)
+                            {
+                                ps::Event event(ps::EventType::RouteFailed);
+                                event.data = ps::Data::Message("Could not find a route: " + error);
+                                this->eventQueue.pushEvent(std::move(event)); });
+        for (auto &&minutes : *config["routing"]["isochrone_minutes"].as_array())
+            isochroneMinutes.push_back(*minutes.value<double>());
+        std::string trafficFeedPath = *config["traffic"]["feed"].value<std::string>();
+        std::chrono::milliseconds trafficPollInterval(*config["traffic"]["poll_ms"].value<int>());
+
+        // load map data in background. Done event will be handled in event loop. The thread is
+        // joined in ~App, the preprocessing stops early when the window is closed.
+        loader = std::thread([this, trafficFeedPath, trafficPollInterval]()
+                             {
+            this->mapGraph.load("./db/map.db", "./db/map.graph");
+            this->eventQueue.pushEvent(ps::Event(ps::EventType::MapDataLoaded));
+            if (loaderCancellation.isCancelled())
+                return;
+            // car routes read the traffic feed from here on, applying a batch never waits for a search
+            this->algorithms.getTrafficOverlay().init(this->mapGraph);
+            this->trafficFeed.start(trafficFeedPath, this->algorithms.getTrafficOverlay(), trafficPollInterval, [](const TrafficBatchStats &stats)
+                                    { std::cout << "traffic " << stats.version << ": " << stats.appliedUpdates << " updates (" << stats.unknownRoads << " unknown roads) in "
+                                                << stats.milliseconds << " ms, " << stats.slowedEdges << " edges slowed" << std::endl; });
+            // preprocessing is only slow the first time, afterwards it is read from disk
+            this->algorithms.prepareLandmarks(this->mapGraph, "./db/map.alt", *config["routing"]["landmarks"].value<int>(), loaderCancellation);
+            this->algorithms.prepareContractionHierarchy(this->mapGraph, "./db/map.ch", loaderCancellation);
+            if (!loaderCancellation.isCancelled())
+                this->eventQueue.pushEvent(ps::Event(ps::EventType::ContractionHierarchyReady)); });
 
         mapGeometry = MapGeometry(
             float(this->window.getSize().x) / viewportW,               // pixels per degree
@@ -61,7 +85,9 @@ public:
                 mapGeometry.offsetGeoVector({-82.325005, 29.651982}) // Gville, FL
                 ));
 
-        chunkSpriteLoader.init(&mapGeometry, "./db/map.db");
+        chunkSpriteLoader.init(&mapGeometry, "./db/map.db", *config["map"]["chunk_threads"].value<int>());
+        chunkSpriteLoader.setByteBudgets(size_t(*config["cache"]["chunk_sprites_mb"].value<int>()) << 20,
+                                         size_t(*config["cache"]["chunk_data_mb"].value<int>()) << 20);
 
         window.setFramerateLimit(*config["graphics"]["framerate"].value<int>());
 
@@ -72,6 +98,10 @@ public:
 
     ~App()
     {
+        // the loader uses most members, so it must finish before any of them is destroyed
+        loaderCancellation.cancel();
+        if (loader.joinable())
+            loader.join();
     }
 
     void run()
@@ -84,9 +114,22 @@ public:
             update();
             render();
         }
+
+        ChunkLoadStats stats = chunkSpriteLoader.getLoadStats();
+        std::cout << "loaded " << stats.loadedChunks << " chunks, request to ready: mean " << stats.meanReady()
+                  << " ms (" << stats.meanQueueWait() << " ms queued), max " << stats.maxReady << " ms" << std::endl;
+        printCacheStats("chunk sprites", chunkSpriteLoader.getSpriteCacheStats());
+        printCacheStats("chunk data", chunkSpriteLoader.getChunkCacheStats());
     }
 
 private:
+    void printCacheStats(const string &name, const CacheStats &stats)
+    {
+        std::cout << name << " cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.evictions
+                  << " evictions, " << stats.entries << " entries using " << (stats.bytes >> 20) << " of "
+                  << (stats.byteBudget >> 20) << " MB" << std::endl;
+    }
+
     void processEvents()
     {
         sf::Event event;
@@ -125,22 +168,27 @@ private:
         Refer to the comments in the ps::EventType enum to determine which `DataType` to access.
         */
 
-        int nEvents = eventQueue.size();
-        for (int i = 0; i < nEvents; ++i)
+        // take everything that is queued at once, events pushed while these are handled wait for the next frame
+        pendingEvents.clear();
+        eventQueue.drainInto(pendingEvents);
+        for (const ps::Event &event : pendingEvents)
         {
-            ps::Event event = eventQueue.popNext();
-
             if (event.type == ps::EventType::MapDataLoaded)
             {
                 toaster.spawnToast(window.getSize().x / 2, "Map data loaded! Let's go!", "loading_data", sf::seconds(3));
+                chunkSpriteLoader.useGraph(&mapGraph);
+            }
+            else if (event.type == ps::EventType::ContractionHierarchyReady)
+            {
+                toaster.spawnToast(window.getSize().x / 2, "Contraction hierarchy ready!", "ch_ready", sf::seconds(3));
             }
             else if (event.type == ps::EventType::NavBoxSubmitted)
             {
                 startFindingRoute(event);
             }
-            else if (event.type == ps::EventType::NodeTouched)
+            else if (event.type == ps::EventType::SearchProgress)
             {
-                enqueueAnimationPoint(event);
+                enqueueAnimationPoints(event);
             }
             else if (event.type == ps::EventType::NavBoxFormChanged)
             {
@@ -150,6 +198,19 @@ private:
             {
                 onRouteCompleted(event);
             }
+            else if (event.type == ps::EventType::IsochroneRequested)
+            {
+                startFindingIsochrone(event);
+            }
+            else if (event.type == ps::EventType::IsochroneCompleted)
+            {
+                onIsochroneCompleted(event);
+            }
+            else if (event.type == ps::EventType::RouteFailed)
+            {
+                toaster.removeToast("finding_route");
+                toaster.spawnToast(window.getSize().x / 2, std::get<ps::Data::Message>(event.data).text, "route_failed", sf::seconds(4));
+            }
         }
     }
 
@@ -167,6 +228,9 @@ private:
         // window.clear(sf::Color(247, 246, 246, 255));
         window.clear(sf::Color(245, 245, 245, 255));
 
+        // free the least recently drawn chunk sprites if the cache is over its memory budget
+        chunkSpriteLoader.evictOverBudget();
+
         // render up to x animation dots onto loaded chunk sprite
         // if a chunk sprite is not yet loaded, requue the point so that
         // it can be rendered later when the user pans that map region
@@ -190,6 +254,9 @@ private:
         // determine the range of chunks that are inside of the viewport to render
         auto overlap = mapGeometry.calculateOverlappingChunks(mapGeometry.toGeoRectangle(viewport));
 
+        // load the chunks in the middle of the screen first, and the ones the viewport is panning towards early
+        scheduleChunkLoads(overlap);
+
         for (int row = overlap.top - 1; row <= overlap.bottom() + 1; ++row)
         {
             for (int col = overlap.left - 1; col <= overlap.right() + 1; ++col)
@@ -224,7 +291,39 @@ private:
         window.display();
     }
 
-    void startFindingRoute(ps::Event event)
+    void scheduleChunkLoads(const Rectangle<int> &overlap)
+    {
+        double chunkSize = mapGeometry.getChunkDisplaySize();
+        sf::Vector2<double> velocity = viewport.getPanVelocity();
+
+        // the viewport where panning will be in a moment, chunks in it that are outside of the
+        // buffered area are requested now so that they are loaded when they scroll into view
+        Rectangle<double> ahead = viewport;
+        ahead.left += velocity.x * chunkPrefetchSeconds;
+        ahead.top += velocity.y * chunkPrefetchSeconds;
+        auto aheadOverlap = mapGeometry.calculateOverlappingChunks(mapGeometry.toGeoRectangle(ahead));
+
+        // queued chunks outside of the buffered and the prefetched area are no longer needed
+        double prefetchChunks = std::max(std::abs(velocity.x), std::abs(velocity.y)) * chunkPrefetchSeconds / chunkSize;
+        double keepDistance = std::max(overlap.width, overlap.height) / 2.0 + 2 + prefetchChunks;
+        chunkSpriteLoader.setLoadFocus((viewport.top + viewport.height / 2) / chunkSize,
+                                       (viewport.left + viewport.width / 2) / chunkSize, keepDistance);
+
+        if (velocity.x == 0 && velocity.y == 0)
+            return;
+
+        for (int row = aheadOverlap.top; row <= aheadOverlap.bottom(); ++row)
+        {
+            for (int col = aheadOverlap.left; col <= aheadOverlap.right(); ++col)
+            {
+                bool isBuffered = row >= overlap.top - 1 && row <= overlap.bottom() + 1 && col >= overlap.left - 1 && col <= overlap.right() + 1;
+                if (!isBuffered && mapGeometry.isValidChunkGridCoordinate(row, col))
+                    chunkSpriteLoader.prefetch(row, col);
+            }
+        }
+    }
+
+    void startFindingRoute(const ps::Event &event)
     {
         // The graph is still loading, so notify the user
         if (!mapGraph.isDataLoaded())
@@ -233,55 +332,108 @@ private:
             return;
         }
 
-        auto navBoxForm = std::get<ps::Data::NavBoxForm>(event.data);
+        const auto &navBoxForm = std::get<ps::Data::NavBoxForm>(event.data);
         sf::Vector2<double> origin = navBoxForm.origin;
         sf::Vector2<double> destination = navBoxForm.destination;
         AlgoName algoName = (AlgoName)navBoxForm.algoName;
 
-        // start the selected pathfinding algo in another thread
+        // The landmarks and the contraction hierarchy only know the distance weights
+        RoutingProfile profile = navBox.getProfile();
+        if (!Algorithms::supportsProfile(algoName, profile))
+        {
+            toaster.spawnToast(window.getSize().x / 2, "ALT and CH only find the shortest route, press P to route by distance", "profile", sf::seconds(3));
+            return;
+        }
+
+        // The landmarks and contraction hierarchy are prepared after the graph is loaded
+        if ((algoName == AlgoName::ALT || algoName == AlgoName::BidirectionalALT) && !algorithms.isLandmarksReady())
+        {
+            toaster.spawnToast(window.getSize().x / 2, "Preparing landmarks, please wait...", "loading_data", sf::seconds(2.25));
+            return;
+        }
+        if (algoName == AlgoName::ContractionHierarchies && !algorithms.isContractionHierarchyReady())
+        {
+            toaster.spawnToast(window.getSize().x / 2, "Preparing contraction hierarchy, please wait...", "loading_data", sf::seconds(2.25));
+            return;
+        }
+
+        // run the selected pathfinding algo on the route workers, this cancels the search for the previous submission
         toaster.spawnToast(window.getSize().x / 2, "Finding a route...", "finding_route");
-        std::thread([this, origin, destination, algoName]()
-                    {
+        bool animate = navBox.getAnimate();
+        routeExecutor.submit("navbox", [this, origin, destination, algoName, animate, profile](const CancellationToken &cancellation)
+                             {
                         auto startTime = std::chrono::high_resolution_clock().now();
-                        vector<GraphNodeIndex> path = algorithms.findShortestPath(origin, destination, algoName, mapGraph, mapGeometry, window, viewport, navBox);
+                        vector<GraphNodeIndex> path = algorithms.findShortestPath(origin, destination, algoName, mapGraph, animate, cancellation, profile);
                         auto endTime = std::chrono::high_resolution_clock().now();
+                        // the searches between nodes return no edges when both points are nearest to the same node
+                        GraphNodeIndex originNode = -1, destinationNode = -1;
+                        if (!Algorithms::snapsToRoads(algoName))
+                        {
+                            originNode = mapGraph.findNearestNode(origin.x, origin.y);
+                            destinationNode = mapGraph.findNearestNode(destination.x, destination.y);
+                        }
+                        // a newer submission replaced this one, so its result is not shown
+                        if (cancellation.isCancelled())
+                            return;
                         // push an event with the completed route data
                         ps::Event event(ps::EventType::RouteCompleted);
-                        event.data = ps::Data::CompleteRoute(path, std::chrono::duration(endTime - startTime));
-                        this->eventQueue.onEvent(event); })
-            .detach();
+                        event.data = ps::Data::CompleteRoute(path, std::chrono::duration(endTime - startTime), origin, destination, Algorithms::snapsToRoads(algoName), originNode, destinationNode, (int)profile);
+                        this->eventQueue.pushEvent(std::move(event)); });
     }
 
-    void onRouteCompleted(ps::Event event)
+    void onRouteCompleted(const ps::Event &event)
     {
         // In the case the a route has been found,
         // The route's edges will be displayed on the map.
         // And a message of confirmation will be displayed.
 
-        auto data = std::get<ps::Data::CompleteRoute>(event.data);
-
-        PointPath routePath;
-        auto storage = sql::loadStorage("./db/map.db");
-
-        // Total distance of the route in meters
-        int totalDistance = 0;
+        const auto &data = std::get<ps::Data::CompleteRoute>(event.data);
 
-        // load the point paths from all of the edges in the completed route
-        for (GraphEdgeIndex idx : data.edgeIndices)
+        // no path was found, or a point is off the map where the graph has no nodes. A route between
+        // points on roads has at least one edge, one between nodes has none if they are the same.
+        bool isSameNode = data.originNode != -1 && data.originNode == data.destinationNode;
+        if (data.edgeIndices.empty() && !isSameNode)
         {
-            GraphEdge graphEdge = mapGraph.getEdge(idx);
+            route.path = PointPath();
+            toaster.removeToast("finding_route");
+            toaster.spawnToast(window.getSize().x / 2, "No route found between these points.", "route_found", sf::seconds(4));
+            return;
+        }
 
-            totalDistance += graphEdge.weight;
+        PointPath routePath;
 
-            sql::Edge edge = storage.get<sql::Edge>(graphEdge.sqlID);
-            PointPath edgePath(edge.pathOffsetPoints);
+        // the first and last edge are only driven in part when the route starts and ends on a road
+        RoadSnap origin, destination;
+        if (data.snappedToRoads && !data.edgeIndices.empty())
+        {
+            origin = mapGraph.snapToRoad(data.origin.x, data.origin.y);
+            destination = mapGraph.snapToRoad(data.destination.x, data.destination.y);
+        }
+        const RoadSnap *enter = origin.road != -1 ? &origin : nullptr;
+        const RoadSnap *leave = destination.road != -1 ? &destination : nullptr;
+
+        // Total distance of the route in meters, and its travel time when it was routed by one
+        long long int totalDistance = mapGraph.getPathLength(data.edgeIndices, enter, leave);
+        RoutingProfile profile = (RoutingProfile)data.profile;
+        string travelTime;
+        if (profile != RoutingProfile::Distance)
+        {
+            // with the traffic there is now, which may be newer than the traffic the route was found with
+            std::shared_ptr<const TrafficSnapshot> traffic = algorithms.getTrafficOverlay().current();
+            long long int time = mapGraph.getPathWeight(data.edgeIndices, traffic->getEdgeWeights(mapGraph, profile), enter, leave);
+            if (time >= forbiddenWeight)
+                travelTime = " A road on it has closed since.";
+            else
+                travelTime = " Time by " + routingProfileToString(profile) + ": " + to_string(llround(time / 60000.0)) + " min.";
+        }
 
-            // if the edge has been duplicated in reverse, unreverse the path so that
-            // it forms a continous point path from origin to destination
-            if (!graphEdge.isPrimary)
-            {
-                edgePath.reverse();
-            }
+        // load the point paths from all of the edges in the completed route, the edge's shape is
+        // read from the graph's road arrays in the direction the edge is driven, so that they form
+        // a continous point path from origin to destination
+        for (size_t i = 0; i < data.edgeIndices.size(); ++i)
+        {
+            PointPath edgePath;
+            mapGraph.appendEdgePoints(data.edgeIndices[i], i == 0 ? enter : nullptr, i + 1 == data.edgeIndices.size() ? leave : nullptr, edgePath.points);
             routePath.extend(edgePath);
         }
 
@@ -295,19 +447,78 @@ private:
             double totalDistanceKM = totalDistance / 1000.0;
             string distanceString = to_string(totalDistanceKM);
             distanceString = distanceString.substr(0, distanceString.find(".") + 2);
-            toaster.spawnToast(window.getSize().x / 2, "Route found! Have a nice trip! (" + to_string(data.runTime.count()) + ") seconds. Distance: " + distanceString + " Km.", "route_found", sf::seconds(5));
+            toaster.spawnToast(window.getSize().x / 2, "Route found! Have a nice trip! (" + to_string(data.runTime.count()) + ") seconds. Distance: " + distanceString + " Km." + travelTime, "route_found", sf::seconds(5));
         }
         else // distance is small enough to display in meters
         {
-            toaster.spawnToast(window.getSize().x / 2, "Route found! Have a nice trip! (" + to_string(data.runTime.count()) + ") seconds. Distance: " + to_string(totalDistance) + " m.", "route_found", sf::seconds(5));
+            toaster.spawnToast(window.getSize().x / 2, "Route found! Have a nice trip! (" + to_string(data.runTime.count()) + ") seconds. Distance: " + to_string(totalDistance) + " m." + travelTime, "route_found", sf::seconds(5));
+        }
+    }
+
+    void startFindingIsochrone(const ps::Event &event)
+    {
+        if (!mapGraph.isDataLoaded())
+        {
+            toaster.spawnToast(window.getSize().x / 2, "Loading data, please wait...", "loading_data", sf::seconds(2.25));
+            return;
+        }
+
+        sf::Vector2<double> origin = std::get<ps::Data::NavBoxForm>(event.data).origin;
+        vector<double> minutes = isochroneMinutes;
+
+        // the bands are minutes, so routing by distance shows how far a car gets
+        RoutingProfile profile = navBox.getProfile() == RoutingProfile::Distance ? RoutingProfile::Car : navBox.getProfile();
+
+        // runs on the route workers like a route, a newer isochrone or route cancels it
+        toaster.spawnToast(window.getSize().x / 2, "Finding the reachable area...", "finding_route");
+        routeExecutor.submit("navbox", [this, origin, minutes, profile](const CancellationToken &cancellation)
+                             {
+                        auto startTime = std::chrono::high_resolution_clock().now();
+                        RoadSnap snap = mapGraph.snapToRoad(origin.x, origin.y);
+                        vector<double> budgets;
+                        for (double bandMinutes : minutes)
+                            budgets.push_back(bandMinutes * 60);
+                        Isochrone isochrone = algorithms.isochrone(snap, budgets, profile, mapGraph, cancellation);
+                        auto endTime = std::chrono::high_resolution_clock().now();
+                        if (cancellation.isCancelled())
+                            return;
+                        ps::Event event(ps::EventType::IsochroneCompleted);
+                        event.data = ps::Data::IsochroneBands(std::move(isochrone.bandRings), minutes, isochrone.nodes.size(), std::chrono::duration(endTime - startTime));
+                        this->eventQueue.pushEvent(std::move(event)); });
+    }
+
+    void onIsochroneCompleted(const ps::Event &event)
+    {
+        const auto &data = std::get<ps::Data::IsochroneBands>(event.data);
+
+        // the outlines are drawn onto the chunk sprites, the nearest band in the strongest color
+        vector<OverlayLine> lines;
+        for (size_t band = 0; band < data.bandRings.size(); ++band)
+        {
+            int fade = data.bandRings.size() > 1 ? 160 * band / (data.bandRings.size() - 1) : 0;
+            for (const auto &ring : data.bandRings[band])
+            {
+                PointPath path;
+                path.points = ring;
+                lines.emplace_back(std::move(path), sf::Color(220, fade, 40 + fade / 2));
+            }
         }
+        route.path.clear();
+        chunkSpriteLoader.setOverlay(std::move(lines));
+
+        toaster.removeToast("finding_route");
+        string bands;
+        for (double minutes : data.minutes)
+            bands += (bands.empty() ? "" : ", ") + to_string((int)minutes);
+        toaster.spawnToast(window.getSize().x / 2, "Reachable within " + bands + " minutes: " + to_string(data.reachedNodes) + " nodes (" + to_string(data.runTime.count()) + ") seconds.", "route_found", sf::seconds(5));
     }
 
-    void clearAnimationPoints(ps::Event event)
+    void clearAnimationPoints(const ps::Event &event)
     {
-        // Clear the route and remove all dots from the map when the navbox form changes
+        // Clear the route, the isochrone and remove all dots from the map when the navbox form changes
         // Because the route no longer exists.
         route.path.clear();
+        chunkSpriteLoader.clearOverlay();
         for (ChunkSprite *sprite : chunkSpriteLoader.getAllLoaded())
         {
             if (sprite->hasDots)
@@ -319,11 +530,11 @@ private:
             animationPoints.pop();
     }
 
-    void enqueueAnimationPoint(ps::Event event)
+    void enqueueAnimationPoints(const ps::Event &event)
     {
-        // Animates a point on the map when a node is touched
-        auto lonLat = std::get<ps::Data::Vector2>(event.data);
-        animationPoints.push({mapGeometry.getChunkRowCol(lonLat.y, lonLat.x), sf::Vector2<double>(lonLat.x, lonLat.y)});
+        // Animates a point on the map for every node that the search settled
+        for (const ps::Data::Vector2 &lonLat : std::get<ps::Data::NodeBatch>(event.data).points)
+            animationPoints.push({mapGeometry.getChunkRowCol(lonLat.y, lonLat.x), sf::Vector2<double>(lonLat.x, lonLat.y)});
     }
 
     toml::v3::ex::parse_result config = toml::parse_file("./config/config.toml");
@@ -339,10 +550,22 @@ private:
 
     ChunkLoader chunkLoader;
     ChunkSpriteLoader chunkSpriteLoader;
+    const double chunkPrefetchSeconds = 0.5; // how far ahead of the panning viewport chunks are loaded
     MapGeometry mapGeometry;
     MapGraph mapGraph;
 
     std::queue<std::pair<std::pair<int, int>, sf::Vector2<double>>> animationPoints;
 
+    vector<double> isochroneMinutes; // driving time of every isochrone band, from the config
+
     ps::EventQueue eventQueue;
+    std::vector<ps::Event> pendingEvents; // reused by processEvents so that draining the queue does not allocate
+
+    TrafficFeedWatcher trafficFeed; // applies the traffic feed file to the algorithms' overlay
+
+    std::thread loader; // loads the graph, then reads or computes the landmarks and the contraction hierarchy
+    CancellationToken loaderCancellation;
+
+    // declared last so that it is destroyed first, its workers use the members above
+    RouteExecutor routeExecutor;
 };
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <fstream>
+
+/**
+ * Helpers for the binary files that cache preprocessed routing data next to the database.
+ * Values are written in the machine's native layout, so the files are not portable between
+ * machines, they are only meant to skip preprocessing on the next start.
+ */
+namespace binio
+{
+    template <typename T>
+    void writeValue(std::ofstream &file, const T &value)
+    {
+        file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void writeVector(std::ofstream &file, const std::vector<T> &values)
+    {
+        long long int size = values.size();
+        writeValue(file, size);
+        file.write(reinterpret_cast<const char *>(values.data()), sizeof(T) * size);
+    }
+
+    template <typename T>
+    void readValue(std::ifstream &file, T &value)
+    {
+        file.read(reinterpret_cast<char *>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void readVector(std::ifstream &file, std::vector<T> &values)
+    {
+        long long int size = 0;
+        readValue(file, size);
+        if (!file || size < 0)
+            return;
+        values.resize(size);
+        file.read(reinterpret_cast<char *>(values.data()), sizeof(T) * size);
+    }
+};
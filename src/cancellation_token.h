@@ -0,0 +1,34 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+/**
+ * A flag shared between whoever started a long running job and the job itself. Copies of a token
+ * share the flag, so the job can keep its copy and poll `isCancelled` while the owner cancels.
+ */
+class CancellationToken
+{
+public:
+    CancellationToken() : cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() const
+    {
+        cancelled->store(true, std::memory_order_relaxed);
+    }
+
+    bool isCancelled() const
+    {
+        return cancelled->load(std::memory_order_relaxed);
+    }
+
+    // A token that is never cancelled, the default for callers that do not need cancellation.
+    static const CancellationToken &none()
+    {
+        static const CancellationToken token;
+        return token;
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled;
+};
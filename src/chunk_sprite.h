@@ -8,12 +8,19 @@
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <chrono>
+#include <optional>
+#include <cmath>
+#include <algorithm>
+#include <condition_variable>
 #include <unordered_set>
 #include <string>
 
 #include "sql.h"
 #include "geometry.h"
 #include "node.h"
+#include "graph.h"
+#include "lru_index.h"
 
 using std::mutex;
 using std::pair;
@@ -24,11 +31,6 @@ using std::unordered_map;
 using std::unordered_set;
 using std::vector;
 
-string chunkId(int row, int col)
-{
-    return std::to_string(row) + ',' + std::to_string(col);
-}
-
 struct Chunk
 {
     sql::Chunk data;
@@ -44,7 +46,7 @@ struct Chunk
 
         using namespace sqlite_orm;
 
-        // load all nodes in the chunk from the db
+        // load all nodes in the chunk from the db, they are stored together under the chunk's key
         for (auto sqlNode : storage->iterate<sql::Node>(where(c(&sql::Node::chunkId) == chunk.id), limit(chunk.numNodes)))
         {
             nodes.emplace(sqlNode.id, Node(sqlNode));
@@ -56,6 +58,34 @@ struct Chunk
             nodes.at(sqlEdge.sourceNodeId).edgesOut.push_back(Edge(sqlEdge));
         }
     }
+
+    // Approximate memory used by the chunk, counted against the chunk cache budget
+    size_t estimateBytes() const
+    {
+        size_t bytes = sizeof(Chunk) + nodes.bucket_count() * sizeof(void *);
+        for (auto &[_, node] : nodes)
+        {
+            // map node with its key, hash and next pointer
+            bytes += sizeof(std::pair<const int, Node>) + 2 * sizeof(void *);
+            bytes += node.edgesOut.capacity() * sizeof(Edge);
+            for (const Edge &edge : node.edgesOut)
+                bytes += edge.path.points.capacity() * sizeof(sf::Vector2<double>);
+        }
+        return bytes;
+    }
+};
+
+// Timings of the chunks that a ChunkLoader has loaded so far, in milliseconds
+struct ChunkLoadStats
+{
+    int loadedChunks = 0;
+    double totalQueueWait = 0; // from the request until a worker started loading the chunk
+    double totalReady = 0;     // from the request until the chunk was in the cache
+    double maxReady = 0;
+    int droppedRequests = 0; // requests dropped because their chunk scrolled far away before it was loaded
+
+    double meanQueueWait() const { return loadedChunks ? totalQueueWait / loadedChunks : 0; }
+    double meanReady() const { return loadedChunks ? totalReady / loadedChunks : 0; }
 };
 
 class ChunkLoader
@@ -63,12 +93,7 @@ class ChunkLoader
 public:
     ~ChunkLoader()
     {
-        // signal for all worker threads to stop, then wait for them all to finish
-        m_stopWorkers = true;
-        for (std::thread *worker : m_workerThreads)
-        {
-            worker->join();
-        }
+        stop();
 
         // delete all of the chunks in the cache
         for (vector<Chunk *> &row : m_cache)
@@ -80,24 +105,41 @@ public:
         }
     }
 
-    void start(string dbFilePath)
+    /*
+    Start the threads that load chunks from the db so that chunks can be
+    loaded in the background without freezing the app
+
+    @param dbFilePath: path of the sqlite database, every worker opens its own connection
+    @param workerCount: number of worker threads
+    */
+    void start(string dbFilePath, int workerCount)
     {
-        // this flag will be set to true to stop the workers
         m_stopWorkers = false;
-        // start threads that load chunks from the db so that
-        // chunks can be loaded in the background without freezing the app
-        auto workerTask = [this, dbFilePath]()
+        for (int i = 0; i < std::max(1, workerCount); ++i)
         {
-            this->workerThread(dbFilePath);
-        };
+            m_workerThreads.emplace_back([this, dbFilePath]()
+                                         { this->workerThread(dbFilePath); });
+        }
+    };
 
-        // threads need to be stored on the heap. If they were on the stack, they
-        // would get deleted immediately
-        for (int i = 0; i < 5; ++i)
+    /*
+    Signal the workers to stop and wait for them. A worker that is loading a chunk
+    finishes it first, chunks that are still queued are not loaded.
+    */
+    void stop()
+    {
         {
-            m_workerThreads.push_back(new std::thread(workerTask));
+            std::lock_guard<mutex> lock(m_mutex);
+            m_stopWorkers = true;
         }
-    };
+        m_workAvailable.notify_all();
+
+        for (std::thread &worker : m_workerThreads)
+        {
+            worker.join();
+        }
+        m_workerThreads.clear();
+    }
 
     /*
     If the chunk is already loaded, immedaitely returns a pointer to the chunk,
@@ -111,6 +153,9 @@ public:
     */
     std::optional<Chunk *> get(int row, int col)
     {
+        // the workers write to the cache grid, so it is only touched with the mutex held
+        std::lock_guard<mutex> lock(m_mutex);
+
         // resize the cache grid and isLoading flag grid to fit the chunk
         if (m_cache.size() <= row)
         {
@@ -133,31 +178,156 @@ public:
             return std::nullopt;
         }
 
+        m_cacheStats.hits++;
+        m_lru.touch(row, col);
+        evictOverBudget();
         return pChunk;
     }
 
     void unCache(int row, int col)
     {
+        std::lock_guard<mutex> lock(m_mutex);
         delete m_cache[row][col];
         m_cache[row][col] = nullptr;
+        m_lru.erase(row, col);
+    }
+
+    /*
+    Limit the memory of the cached chunks. The least recently used chunks are
+    evicted when the budget is exceeded and loaded again when they are requested.
+
+    @param bytes: memory budget of the cached chunks, 0 for no limit
+    */
+    void setByteBudget(size_t bytes)
+    {
+        std::lock_guard<mutex> lock(m_mutex);
+        m_lru.setByteBudget(bytes);
+    }
+
+    CacheStats getCacheStats()
+    {
+        std::lock_guard<mutex> lock(m_mutex);
+        CacheStats stats = m_cacheStats;
+        stats.entries = m_lru.size();
+        stats.bytes = m_lru.bytes();
+        stats.byteBudget = m_lru.getByteBudget();
+        return stats;
+    }
+
+    /*
+    Set the point that chunk loads are prioritised around, usually the centre of
+    the viewport. Queued chunks closest to it are loaded first, and queued chunks
+    that are further than `keepDistance` away on either axis are dropped, they are
+    requested again if they come back into view.
+
+    @param row: fractional chunk row of the focus point
+    @param col: fractional chunk column of the focus point
+    @param keepDistance: distance in chunks beyond which queued requests are stale
+    */
+    void setFocus(double row, double col, double keepDistance)
+    {
+        std::lock_guard<mutex> lock(m_mutex);
+        m_focusRow = row;
+        m_focusCol = col;
+        m_hasFocus = true;
+
+        // drop the stale requests, then rebuild the heap with the new distances
+        auto isStale = [&](const ChunkRequest &request)
+        {
+            bool stale = std::abs(request.row + 0.5 - row) > keepDistance || std::abs(request.col + 0.5 - col) > keepDistance;
+            if (stale)
+                m_isLoading[request.row][request.col] = false;
+            return stale;
+        };
+        size_t queued = m_loadQueue.size();
+        m_loadQueue.erase(std::remove_if(m_loadQueue.begin(), m_loadQueue.end(), isStale), m_loadQueue.end());
+        m_stats.droppedRequests += queued - m_loadQueue.size();
+
+        for (ChunkRequest &request : m_loadQueue)
+            request.priority = focusDistance(request.row, request.col);
+        std::make_heap(m_loadQueue.begin(), m_loadQueue.end(), isLowerPriority);
+    }
+
+    ChunkLoadStats getStats()
+    {
+        std::lock_guard<mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    /*
+    Delete all cached chunks and forget the queued requests.
+    */
+    void clear()
+    {
+        std::lock_guard<mutex> lock(m_mutex);
+        for (const ChunkRequest &request : m_loadQueue)
+            m_isLoading[request.row][request.col] = false;
+        m_loadQueue.clear();
+
+        while (!m_lru.empty())
+        {
+            auto [row, col] = m_lru.leastRecent();
+            delete m_cache[row][col];
+            m_cache[row][col] = nullptr;
+            m_lru.erase(row, col);
+        }
     }
 
 private:
+    struct ChunkRequest
+    {
+        int row;
+        int col;
+        std::chrono::steady_clock::time_point requestTime;
+        double priority;        // squared distance to the focus point, lower is loaded first
+        unsigned long sequence; // requests at the same distance are loaded in request order
+    };
+
+    // heap order of the load queue, the request with the highest priority is at the front
+    static bool isLowerPriority(const ChunkRequest &a, const ChunkRequest &b)
+    {
+        if (a.priority != b.priority)
+            return a.priority > b.priority;
+        return a.sequence > b.sequence;
+    }
+
+    double focusDistance(int row, int col) const
+    {
+        if (!m_hasFocus)
+            return 0; // load in request order until a focus is set
+        double rowDistance = row + 0.5 - m_focusRow;
+        double colDistance = col + 0.5 - m_focusCol;
+        return rowDistance * rowDistance + colDistance * colDistance;
+    }
+
+    // Deletes the least recently used chunks until the cache fits its budget. Only get() evicts, so
+    // a pointer it returned stays valid until the next call to get() or unCache(). Must be called
+    // with m_mutex held, the most recently used chunk is never evicted.
+    void evictOverBudget()
+    {
+        while (m_lru.isOverBudget() && m_lru.size() > 1)
+        {
+            auto [row, col] = m_lru.leastRecent();
+            delete m_cache[row][col];
+            m_cache[row][col] = nullptr;
+            m_lru.erase(row, col);
+            m_cacheStats.evictions++;
+        }
+    }
+
+    // must be called with m_mutex held
     void startLoadingChunk(int row, int col)
     {
         // if the chunk is not already loading, push it to the queue so that
-        // the loader thread will retrieve it from the db
-
-        // a mutex is used to limit access of shared state to one thread at a time
-        m_mutex.lock();
+        // a worker thread will retrieve it from the db
+        if (!m_isLoading[row][col])
         {
-            if (!m_isLoading[row][col])
-            {
-                m_loadQueue.push({row, col});
-                m_isLoading[row][col] = true;
-            }
+            m_loadQueue.push_back({row, col, std::chrono::steady_clock::now(), focusDistance(row, col), m_nextSequence++});
+            std::push_heap(m_loadQueue.begin(), m_loadQueue.end(), isLowerPriority);
+            m_isLoading[row][col] = true;
+            m_cacheStats.misses++;
+            m_workAvailable.notify_one();
         }
-        m_mutex.unlock();
     }
 
     void workerThread(string dbFilePath)
@@ -170,45 +340,67 @@ private:
         // each worker thread gets its own connection to the db
         auto storage = sql::loadStorage(dbFilePath);
 
-        // continually take coordinates of chunks to be loaded from the work queue
-        while (!m_stopWorkers)
+        while (true)
         {
-            m_mutex.lock();
-            if (m_loadQueue.empty()) // no work to do yet
-            {
-                m_mutex.unlock();
-                // wait a bit before checking for work so that the mutex isn't hogged
-                std::this_thread::sleep_for(std::chrono::milliseconds(50));
-                continue;
-            }
+            // sleep until a chunk is requested or the loader stops
+            std::unique_lock<mutex> lock(m_mutex);
+            m_workAvailable.wait(lock, [this]()
+                                 { return m_stopWorkers || !m_loadQueue.empty(); });
+            if (m_stopWorkers)
+                return;
 
-            auto [row, col] = m_loadQueue.front();
-            m_loadQueue.pop();
+            std::pop_heap(m_loadQueue.begin(), m_loadQueue.end(), isLowerPriority);
+            ChunkRequest request = m_loadQueue.back();
+            m_loadQueue.pop_back();
+            lock.unlock();
 
-            m_mutex.unlock();
+            auto startTime = std::chrono::steady_clock::now();
 
             // load chunk sql data then init Chunk with data
             // the Chunk constructor needs the storage object because it will
             // load all of the nodes and edges that are inside of it.
-            sql::Chunk data = storage.get<sql::Chunk>(chunkId(row, col));
+            sql::Chunk data = storage.get<sql::Chunk>(sql::chunkKey(request.row, request.col));
             Chunk *newChunk = new Chunk(data, &storage);
 
             // place the chunk into the cache and unmark it as loading
-            m_mutex.lock();
-            {
-                m_cache[row][col] = newChunk;
-                m_isLoading[row][col] = false;
-            }
-            m_mutex.unlock();
+            lock.lock();
+            m_cache[request.row][request.col] = newChunk;
+            m_isLoading[request.row][request.col] = false;
+            m_lru.insert(request.row, request.col, newChunk->estimateBytes());
+
+            auto readyTime = std::chrono::steady_clock::now();
+            double ready = std::chrono::duration<double, std::milli>(readyTime - request.requestTime).count();
+            m_stats.loadedChunks++;
+            m_stats.totalQueueWait += std::chrono::duration<double, std::milli>(startTime - request.requestTime).count();
+            m_stats.totalReady += ready;
+            m_stats.maxReady = std::max(m_stats.maxReady, ready);
         }
     }
 
     vector<vector<Chunk *>> m_cache;
     vector<vector<bool>> m_isLoading;
-    queue<pair<int, int>> m_loadQueue;
-    vector<thread *> m_workerThreads;
+    vector<ChunkRequest> m_loadQueue; // binary heap ordered by isLowerPriority
+    unsigned long m_nextSequence = 0;
+    double m_focusRow = 0;
+    double m_focusCol = 0;
+    bool m_hasFocus = false;
+    vector<thread> m_workerThreads;
     mutex m_mutex;
-    bool m_stopWorkers;
+    std::condition_variable m_workAvailable; // notified when a chunk is queued or the workers should stop
+    bool m_stopWorkers = false;
+    ChunkLoadStats m_stats;
+    LruIndex m_lru;
+    CacheStats m_cacheStats;
+};
+
+// A line drawn over the roads of the chunk sprites, like the outline of an isochrone band
+struct OverlayLine
+{
+    OverlayLine(PointPath path, sf::Color color) : path(std::move(path)), color(color), geoBounds(this->path.getGeoBoundingBox()) {}
+
+    PointPath path; // offset lon, lat points
+    sf::Color color;
+    Rectangle<double> geoBounds;
 };
 
 struct ChunkSprite : sf::Sprite
@@ -242,6 +434,40 @@ struct ChunkSprite : sf::Sprite
         renderTexture.draw(path);
     }
 
+    void renderRoad(const MapGraph &graph, int roadIndex, MapGeometry *mapGeometry)
+    {
+        // same as renderEdge, with the points read from the graph's road arrays
+        int begin = graph.getRoadPointsBegin(roadIndex);
+        int end = graph.getRoadPointsEnd(roadIndex);
+        sf::Color color = roadStyleColor(graph.getRoadStyle(roadIndex));
+
+        sf::VertexArray path(sf::LineStrip, end - begin);
+        for (int i = begin; i < end; ++i)
+        {
+            auto pointDisplayCoordinate = mapGeometry->toPixelVector(graph.getRoadPoint(i));
+            pointDisplayCoordinate -= {rect.left, rect.top};
+
+            path[i - begin].color = color;
+            path[i - begin].position = sf::Vector2f(pointDisplayCoordinate);
+        }
+        renderTexture.draw(path);
+    }
+
+    void renderOverlayLine(const OverlayLine &line, MapGeometry *mapGeometry)
+    {
+        // same as renderEdge, in the overlay's color
+        sf::VertexArray path(sf::LineStrip, line.path.points.size());
+        for (size_t i = 0; i < line.path.points.size(); ++i)
+        {
+            auto pointDisplayCoordinate = mapGeometry->toPixelVector(line.path.points[i]);
+            pointDisplayCoordinate -= {rect.left, rect.top};
+
+            path[i].color = line.color;
+            path[i].position = sf::Vector2f(pointDisplayCoordinate);
+        }
+        renderTexture.draw(path);
+    }
+
     void renderDot(sf::Vector2<double> geoCoordinate, MapGeometry *mapGeometry)
     {
         hasDots = true;
@@ -252,6 +478,12 @@ struct ChunkSprite : sf::Sprite
         renderTexture.display();
     }
 
+    // Memory of the sprite's texture, counted against the sprite cache budget
+    size_t estimateBytes() const
+    {
+        return sizeof(ChunkSprite) + size_t(rect.width + 1) * size_t(rect.height + 1) * 4;
+    }
+
     sf::RenderTexture renderTexture;
     Rectangle<double> rect;
     bool hasDots = false;
@@ -262,10 +494,31 @@ struct ChunkSprite : sf::Sprite
 class ChunkSpriteLoader
 {
 public:
-    void init(MapGeometry *mapGeometry, std::string dbFilePath)
+    ~ChunkSpriteLoader()
+    {
+        for (vector<ChunkSprite *> &row : m_grid)
+        {
+            for (ChunkSprite *sprite : row)
+            {
+                delete sprite;
+            }
+        }
+    }
+
+    void init(MapGeometry *mapGeometry, std::string dbFilePath, int workerCount)
     {
         m_pMapGeometry = mapGeometry;
-        chunkLoader.start(dbFilePath);
+        chunkLoader.start(dbFilePath, workerCount);
+    }
+
+    /*
+    Set the memory budgets of the sprite cache and of the chunk data cache
+    behind it, 0 for no limit.
+    */
+    void setByteBudgets(size_t spriteBytes, size_t chunkBytes)
+    {
+        m_lru.setByteBudget(spriteBytes);
+        chunkLoader.setByteBudget(chunkBytes);
     }
 
     std::optional<ChunkSprite *> get(int row, int col)
@@ -279,6 +532,17 @@ public:
         // return the sprite if already loaded and in the cache
         if (m_grid[row][col] != nullptr)
         {
+            m_cacheStats.hits++;
+            m_lru.touch(row, col);
+            return m_grid[row][col];
+        }
+
+        // once the graph is loaded the sprite is drawn from its road arrays right away
+        if (m_pGraph != nullptr)
+        {
+            m_cacheStats.misses++;
+            renderGraphChunkSprite(row, col);
+            m_grid[row][col]->renderTexture.display();
             return m_grid[row][col];
         }
 
@@ -290,9 +554,8 @@ public:
         }
 
         // chunk is loaded, so it can be used to render sprite
+        m_cacheStats.misses++;
         renderChunkSprite(**chunkOpt, row, col);
-        renderInterchunkEdges();
-        // chunkLoader.unCache(row, col);
 
         m_grid[row][col]->renderTexture.display();
         return m_grid[row][col];
@@ -307,6 +570,96 @@ public:
     {
         delete m_grid[row][col];
         m_grid[row][col] = nullptr;
+        m_lru.erase(row, col);
+    }
+
+    /*
+    Delete the least recently used sprites until the sprite cache fits its budget.
+    Called at the start of a frame, before any sprite is drawn, so that a sprite
+    that was drawn in the last frame can still be evicted. Evicted sprites are
+    rendered again when they are requested.
+    */
+    void evictOverBudget()
+    {
+        while (m_lru.isOverBudget())
+        {
+            auto [row, col] = m_lru.leastRecent();
+            unCache(row, col);
+            m_cacheStats.evictions++;
+        }
+    }
+
+    /*
+    Prioritise chunk loads around a point, see ChunkLoader::setFocus
+    */
+    void setLoadFocus(double row, double col, double keepDistance)
+    {
+        chunkLoader.setFocus(row, col, keepDistance);
+    }
+
+    /*
+    Start loading a chunk that is not in view yet, so that its sprite can be
+    rendered right away when it scrolls into view.
+    */
+    void prefetch(int row, int col)
+    {
+        // with the graph loaded nothing has to be fetched before rendering
+        if (m_pGraph == nullptr && !has(row, col))
+            chunkLoader.get(row, col);
+    }
+
+    /*
+    Draw chunks from the road arrays of the loaded graph from now on. The database is then
+    only used while the graph is still loading at startup. The sprites that were drawn from
+    the database are dropped so that they are drawn again the same way, and the chunk
+    loader is stopped and emptied.
+    */
+    void useGraph(const MapGraph *graph)
+    {
+        m_pGraph = graph;
+        for (ChunkSprite *sprite : getAllLoaded())
+            unCache(sprite->row, sprite->col);
+        m_crossingEdges.clear();
+        m_crossingsRecorded.clear();
+
+        chunkLoader.stop();
+        chunkLoader.clear();
+    }
+
+    /*
+    Draw lines over the roads of every chunk, replacing the previous overlay. The
+    loaded sprites are dropped so that they are drawn again with the new overlay.
+    */
+    void setOverlay(vector<OverlayLine> lines)
+    {
+        m_overlay = std::move(lines);
+        for (ChunkSprite *sprite : getAllLoaded())
+            unCache(sprite->row, sprite->col);
+    }
+
+    void clearOverlay()
+    {
+        if (!m_overlay.empty())
+            setOverlay({});
+    }
+
+    ChunkLoadStats getLoadStats()
+    {
+        return chunkLoader.getStats();
+    }
+
+    CacheStats getSpriteCacheStats() const
+    {
+        CacheStats stats = m_cacheStats;
+        stats.entries = m_lru.size();
+        stats.bytes = m_lru.bytes();
+        stats.byteBudget = m_lru.getByteBudget();
+        return stats;
+    }
+
+    CacheStats getChunkCacheStats()
+    {
+        return chunkLoader.getCacheStats();
     }
 
     std::vector<ChunkSprite *> getAllLoaded()
@@ -335,6 +688,10 @@ private:
 
         auto chunkSprite = new ChunkSprite(rect, row, col);
 
+        // the edges that cross out of a chunk are recorded the first time it is rendered, a sprite
+        // that is rendered again after it was evicted only needs to redraw them onto itself
+        bool recordCrossings = m_crossingsRecorded.insert(sql::chunkKey(row, col)).second;
+
         // render all edges in the chunk onto the chunkSprite texture
         for (auto &[_, node] : chunk.nodes)
         {
@@ -342,10 +699,13 @@ private:
             {
                 chunkSprite->renderEdge(edge, m_pMapGeometry);
 
+                if (!recordCrossings)
+                    continue;
+
                 // find edges that cross into other chunks
                 // This work by getting a bounding box that encompasses the edge,
-                // if the bounding box overlaps other chunks, these will be added
-                // to the map and drawn onto the other chunk/s on the next frame.
+                // if the bounding box overlaps other chunks, the edge is stored for
+                // those chunks and drawn onto them whenever their sprite is rendered.
                 Rectangle<double> edgeGeoBbox = edge.path.getGeoBoundingBox();
                 // get the range of chunks coordinates (r0 to r1, c0 to c1) that the
                 // edge's bounding box intersects
@@ -358,44 +718,69 @@ private:
                         if (r == chunk.data.row && c == chunk.data.col)
                             continue; // don't render edge again on current chunk
 
-                        interChunkEdges.push(std::make_pair(std::make_pair(r, c), edge));
+                        m_crossingEdges[sql::chunkKey(r, c)].push_back(edge);
+
+                        // the other chunk is already rendered, so draw the edge onto it now
+                        if (has(r, c))
+                        {
+                            m_grid[r][c]->renderEdge(edge, m_pMapGeometry);
+                            m_grid[r][c]->renderTexture.display();
+                        }
                     }
                 }
             }
         }
 
+        // draw the edges of the neighbouring chunks that cross into this chunk
+        auto crossing = m_crossingEdges.find(sql::chunkKey(row, col));
+        if (crossing != m_crossingEdges.end())
+        {
+            for (Edge &edge : crossing->second)
+                chunkSprite->renderEdge(edge, m_pMapGeometry);
+        }
+        renderOverlay(*chunkSprite, row, col);
+
         // cache the sprite
         m_grid[row][col] = chunkSprite;
+        m_lru.insert(row, col, chunkSprite->estimateBytes());
     }
 
-    void renderInterchunkEdges()
+    void renderGraphChunkSprite(int row, int col)
     {
-        // cycle through all edges on the queue and render them onto
-        // the chunks that they overlap if the chunk is loaded.
-        int n_in_queue = interChunkEdges.size();
-        for (int i = 0; i < n_in_queue; ++i)
-        {
-            // pop the next chunk cache coordinate and edge
-            auto item = interChunkEdges.front();
-            auto [coord, edge] = item;
-            auto [row, col] = coord;
-            interChunkEdges.pop();
-
-            // if the cache grid doesn't have the sprite loaded, push the work back onto queue for later
-            if (row >= m_grid.size() || col >= m_grid[row].size() || m_grid[row][col] == nullptr)
-            {
-                // the chunk is not loaded yet, so push the work back onto the queue for later
-                interChunkEdges.push(item);
-                continue;
-            }
+        double chunkGeoSize = m_pMapGeometry->getChunkGeoSize();
+        auto rect = m_pMapGeometry->toPixelRectangle({row * chunkGeoSize, col * chunkGeoSize, chunkGeoSize, chunkGeoSize});
+        auto chunkSprite = new ChunkSprite(rect, row, col);
+
+        // the graph lists every road that overlaps the chunk, including the ones that cross into it
+        for (int roadIndex : m_pGraph->getChunkRoads(row, col))
+            chunkSprite->renderRoad(*m_pGraph, roadIndex, m_pMapGeometry);
+        renderOverlay(*chunkSprite, row, col);
 
-            // chunk loaded, so the interchunk edge can be rendered onto it.
-            m_grid[row][col]->renderEdge(edge, m_pMapGeometry);
+        m_grid[row][col] = chunkSprite;
+        m_lru.insert(row, col, chunkSprite->estimateBytes());
+    }
+
+    // draws the overlay lines whose bounding box overlaps the chunk on top of its roads
+    void renderOverlay(ChunkSprite &sprite, int row, int col)
+    {
+        double chunkGeoSize = m_pMapGeometry->getChunkGeoSize();
+        double top = row * chunkGeoSize, left = col * chunkGeoSize;
+        for (const OverlayLine &line : m_overlay)
+        {
+            const Rectangle<double> &bounds = line.geoBounds;
+            if (bounds.left <= left + chunkGeoSize && bounds.right() >= left && bounds.top <= top + chunkGeoSize && bounds.bottom() >= top)
+                sprite.renderOverlayLine(line, m_pMapGeometry);
         }
     }
 
-    queue<pair<pair<int, int>, Edge>> interChunkEdges;
+    // edges from rendered chunks that also cross the keyed chunk, by sql::chunkKey
+    unordered_map<long long int, vector<Edge>> m_crossingEdges;
+    unordered_set<long long int> m_crossingsRecorded;
     vector<vector<ChunkSprite *>> m_grid;
+    LruIndex m_lru;
+    CacheStats m_cacheStats;
     ChunkLoader chunkLoader;
     MapGeometry *m_pMapGeometry;
+    const MapGraph *m_pGraph = nullptr; // set once the graph is loaded, chunks are then drawn from it
+    vector<OverlayLine> m_overlay;
 };
\ No newline at end of file
@@ -0,0 +1,650 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <string>
+#include <fstream>
+#include <utility>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+
+#include "graph.h"
+#include "binary_io.h"
+#include "search_workspace.h"
+#include "cancellation_token.h"
+
+using std::greater;
+using std::make_pair;
+using std::pair;
+using std::priority_queue;
+using std::vector;
+
+/**
+ * An edge of the contraction hierarchy. Edges either mirror an edge of the MapGraph or are
+ * shortcuts that bypass a contracted node. A shortcut is always made from exactly two lower
+ * edges, so any path through the hierarchy can be unpacked back into MapGraph edges.
+ */
+struct CHEdge
+{
+    GraphNodeIndex from;
+    GraphNodeIndex to;
+    int weight;
+    GraphEdgeIndex originalEdge; // -1 if this edge is a shortcut
+    int lowerEdgeA;              // first half of a shortcut (from -> contracted node), -1 otherwise
+    int lowerEdgeB;              // second half of a shortcut (contracted node -> to), -1 otherwise
+};
+
+/**
+ * Contraction Hierarchies speed-up technique.
+ *
+ * Preprocessing contracts the nodes of a MapGraph one at a time (least important first). When a
+ * node is removed, shortcut edges are added between its neighbours wherever the node was on the
+ * only shortest path between them. Queries then run a bidirectional Dijkstra that only ever
+ * relaxes edges leading to more important nodes, which settles a few hundred nodes instead of
+ * millions on cross-state routes.
+ */
+class ContractionHierarchy
+{
+public:
+    /**
+     * Computes the node order and the shortcut edges for the given graph. This takes a while on
+     * large graphs and is meant to be done once, then saved with `save`.
+     *
+     * @param graph The fully loaded graph to preprocess
+     * @param cancellation Checked while nodes are contracted, the hierarchy is not usable if it stopped the build
+     */
+    void build(MapGraph &graph, const CancellationToken &cancellation = CancellationToken::none())
+    {
+        int nodeCount = graph.getNodeCount();
+        isReady = false;
+
+        chEdges.clear();
+        rank.assign(nodeCount, -1);
+        outArcs.assign(nodeCount, {});
+        inArcs.assign(nodeCount, {});
+        witnessDistance.assign(nodeCount, 0);
+        witnessStamp.assign(nodeCount, 0);
+        currentStamp = 0;
+
+        // copy the graph edges into the working graph, keeping only the lightest of parallel edges
+        for (GraphNodeIndex from = 0; from < nodeCount; ++from)
+        {
+            for (GraphEdgeIndex edgeIndex : graph.getOutEdges(from))
+            {
+                GraphNodeIndex to = graph.getEdgeTarget(edgeIndex);
+                int weight = graph.getEdgeWeight(edgeIndex);
+                if (to == from || weight == forbiddenWeight)
+                    continue; // self loops are never part of a shortest path, and the hierarchy only has the car's directions
+
+                chEdges.push_back(CHEdge{from, to, weight, edgeIndex, -1, -1});
+                addOrImproveArc(from, to, weight, chEdges.size() - 1, 1);
+            }
+        }
+
+        // queue every node by its initial importance
+        vector<double> priority(nodeCount);
+        vector<int> level(nodeCount, 0);
+        priority_queue<pair<double, GraphNodeIndex>, vector<pair<double, GraphNodeIndex>>, greater<pair<double, GraphNodeIndex>>> contractionPQ;
+
+        // Nodes whose contraction adds few shortcuts (relative to the arcs it removes) and that
+        // sit low in the hierarchy are contracted first. Counting hops (the number of graph
+        // edges a shortcut stands for) keeps shortcuts from growing long too early.
+        auto computePriority = [&](GraphNodeIndex v)
+        {
+            ContractionCost cost = contractNode(v, true);
+            int removedArcs = 0, removedHops = 0;
+            for (const Arc &arc : inArcs[v])
+            {
+                removedArcs++;
+                removedHops += arc.hops;
+            }
+            for (const Arc &arc : outArcs[v])
+            {
+                removedArcs++;
+                removedHops += arc.hops;
+            }
+            if (removedArcs == 0)
+                return double(level[v]);
+            return level[v] + double(cost.shortcuts) / removedArcs + double(cost.shortcutHops) / removedHops;
+        };
+
+        for (GraphNodeIndex v = 0; v < nodeCount; ++v)
+        {
+            if (cancellation.isCancelled())
+                return;
+            priority[v] = computePriority(v);
+            contractionPQ.push(make_pair(priority[v], v));
+        }
+
+        upOut.assign(nodeCount, {});
+        upIn.assign(nodeCount, {});
+
+        int nextRank = 0;
+        while (!contractionPQ.empty())
+        {
+            if (cancellation.isCancelled())
+                return;
+
+            auto [nodePriority, v] = contractionPQ.top();
+            contractionPQ.pop();
+
+            // skip queue entries that are outdated or belong to already contracted nodes
+            if (rank[v] != -1 || nodePriority != priority[v])
+                continue;
+
+            // lazy update: the priority may have grown since it was queued
+            priority[v] = computePriority(v);
+            if (!contractionPQ.empty() && priority[v] > contractionPQ.top().first)
+            {
+                contractionPQ.push(make_pair(priority[v], v));
+                continue;
+            }
+
+            // the remaining arcs of v all lead to nodes that will be contracted later,
+            // so they are exactly the upward edges of v in the final hierarchy
+            for (const Arc &arc : outArcs[v])
+                upOut[v].push_back(arc.chEdge);
+            for (const Arc &arc : inArcs[v])
+                upIn[v].push_back(arc.chEdge);
+
+            contractNode(v, false);
+            rank[v] = nextRank++;
+
+            // detach v from the working graph and refresh the priority of its neighbours
+            vector<GraphNodeIndex> neighbors;
+            for (const Arc &arc : outArcs[v])
+            {
+                removeArc(inArcs[arc.node], v);
+                neighbors.push_back(arc.node);
+            }
+            for (const Arc &arc : inArcs[v])
+            {
+                removeArc(outArcs[arc.node], v);
+                neighbors.push_back(arc.node);
+            }
+            outArcs[v].clear();
+            outArcs[v].shrink_to_fit();
+            inArcs[v].clear();
+            inArcs[v].shrink_to_fit();
+
+            std::sort(neighbors.begin(), neighbors.end());
+            neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+
+            for (GraphNodeIndex neighbor : neighbors)
+            {
+                level[neighbor] = std::max(level[neighbor], level[v] + 1);
+                priority[neighbor] = computePriority(neighbor);
+                contractionPQ.push(make_pair(priority[neighbor], neighbor));
+            }
+        }
+
+        // the working graph is not needed for queries
+        outArcs = {};
+        inArcs = {};
+        witnessDistance = {};
+        witnessStamp = {};
+        witnessHeap = {};
+
+        graphNodeCount = nodeCount;
+        graphEdgeCount = graph.getEdgeCount();
+        graphStamp = graph.getStamp();
+        isReady = true;
+    }
+
+    /**
+     * Writes the preprocessed hierarchy to a binary file so that it does not need to be
+     * rebuilt on the next start.
+     *
+     * @param path The file to write to
+     * @return true if the file was written
+     */
+    bool save(std::string path) const
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+
+        binio::writeValue(file, fileMagic);
+        binio::writeValue(file, fileVersion);
+        binio::writeValue(file, graphNodeCount);
+        binio::writeValue(file, graphEdgeCount);
+        binio::writeValue(file, graphStamp);
+        binio::writeVector(file, rank);
+        binio::writeVector(file, chEdges);
+        for (GraphNodeIndex v = 0; v < graphNodeCount; ++v)
+        {
+            binio::writeVector(file, upOut[v]);
+            binio::writeVector(file, upIn[v]);
+        }
+
+        return bool(file);
+    }
+
+    /**
+     * Reads a hierarchy that was written by `save`. The file is rejected if it was built for a
+     * graph with a different number of nodes or edges, or from another version of the database.
+     * Edits that keep the counts, like a changed road length, are caught by the database stamp.
+     *
+     * @param path The file to read from
+     * @param graph The graph that the hierarchy will be used with
+     * @return true if the hierarchy was loaded and can be queried
+     */
+    bool load(std::string path, MapGraph &graph)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+
+        int magic = 0, version = 0, nodeCount = 0, edgeCount = 0;
+        GraphStamp stamp;
+        binio::readValue(file, magic);
+        binio::readValue(file, version);
+        binio::readValue(file, nodeCount);
+        binio::readValue(file, edgeCount);
+        binio::readValue(file, stamp);
+
+        if (!file || magic != fileMagic || version != fileVersion || nodeCount != graph.getNodeCount() || edgeCount != graph.getEdgeCount() ||
+            stamp != graph.getStamp())
+            return false;
+
+        binio::readVector(file, rank);
+        binio::readVector(file, chEdges);
+        upOut.assign(nodeCount, {});
+        upIn.assign(nodeCount, {});
+        for (GraphNodeIndex v = 0; v < nodeCount; ++v)
+        {
+            binio::readVector(file, upOut[v]);
+            binio::readVector(file, upIn[v]);
+        }
+
+        if (!file)
+            return false;
+
+        graphNodeCount = nodeCount;
+        graphEdgeCount = edgeCount;
+        graphStamp = stamp;
+        isReady = true;
+        return true;
+    }
+
+    bool isBuilt() const
+    {
+        return isReady;
+    }
+
+    int getNodeCount() const
+    {
+        return graphNodeCount;
+    }
+
+    /**
+     * Finds the shortest path between two nodes with a bidirectional upward search.
+     *
+     * @param startNodeIndex The index of the start node
+     * @param endNodeIndex The index of the end node
+     * @param onSettle Called with each node that is settled by either search direction
+     * @return The shortest path as a sequence of MapGraph edges, empty if no path exists
+     */
+    vector<GraphEdgeIndex> query(GraphNodeIndex startNodeIndex, GraphNodeIndex endNodeIndex, const std::function<void(GraphNodeIndex)> &onSettle)
+    {
+        // the labels reset in O(1), only the nodes touched by the search are ever read, which keeps short queries short
+        SearchWorkspace &workspace = SearchWorkspace::forThisThread();
+        workspace.reset(rank.size());
+        SearchLabels &forward = workspace.labels[0], &backward = workspace.labels[1];
+        SearchQueue &forwardPQ = workspace.queues[0], &backwardPQ = workspace.queues[1];
+        SearchStats &stats = workspace.stats;
+        forward.setDistance(startNodeIndex, 0, -1);
+        backward.setDistance(endNodeIndex, 0, -1);
+        forwardPQ.push(0, startNodeIndex);
+        backwardPQ.push(0, endNodeIndex);
+        stats.heapPushes += 2;
+
+        long long int bestDistance = unreachable;
+        GraphNodeIndex meetingNode = -1;
+
+        while (!forwardPQ.empty() || !backwardPQ.empty())
+        {
+            long long int forwardMin = forwardPQ.empty() ? unreachable : forwardPQ.top().first;
+            long long int backwardMin = backwardPQ.empty() ? unreachable : backwardPQ.top().first;
+
+            // neither search can find anything shorter than the best path seen so far
+            if (std::min(forwardMin, backwardMin) >= bestDistance)
+                break;
+
+            bool isForward = forwardMin <= backwardMin;
+            auto &pq = isForward ? forwardPQ : backwardPQ;
+            auto &labels = isForward ? forward : backward;
+            auto &otherLabels = isForward ? backward : forward;
+            auto &relaxEdges = isForward ? upOut : upIn;
+            auto &stallEdges = isForward ? upIn : upOut;
+
+            GraphNodeIndex v = pq.top().second;
+            long long int distance = labels.getDistance(v);
+            pq.pop();
+            stats.heapPops++;
+
+            if (labels.isSettled(v))
+                continue; // outdated queue entry
+            labels.settle(v);
+            stats.settledNodes++;
+
+            onSettle(v);
+
+            // the two searches meet at v
+            long long int otherDistance = otherLabels.getDistance(v);
+            if (otherDistance != unreachable && distance + otherDistance < bestDistance)
+            {
+                bestDistance = distance + otherDistance;
+                meetingNode = v;
+            }
+
+            // stall-on-demand: if a higher node reaches v on a shorter path, v can not be on
+            // a shortest path and its edges do not need to be relaxed
+            bool isStalled = false;
+            for (int chEdgeIndex : stallEdges[v])
+            {
+                const CHEdge &chEdge = chEdges[chEdgeIndex];
+                GraphNodeIndex higherNode = isForward ? chEdge.from : chEdge.to;
+                long long int higherDistance = labels.getDistance(higherNode);
+                if (higherDistance != unreachable && higherDistance + chEdge.weight < distance)
+                {
+                    isStalled = true;
+                    break;
+                }
+            }
+            if (isStalled)
+                continue;
+
+            for (int chEdgeIndex : relaxEdges[v])
+            {
+                const CHEdge &chEdge = chEdges[chEdgeIndex];
+                GraphNodeIndex targetNodeIndex = isForward ? chEdge.to : chEdge.from;
+                long long int distanceFromStart = distance + chEdge.weight;
+                stats.relaxedEdges++;
+
+                if (distanceFromStart < labels.getDistance(targetNodeIndex))
+                {
+                    labels.setDistance(targetNodeIndex, distanceFromStart, chEdgeIndex);
+                    pq.push(distanceFromStart, targetNodeIndex);
+                    stats.heapPushes++;
+                }
+            }
+        }
+
+        if (meetingNode == -1)
+            return vector<GraphEdgeIndex>(); // Empty vector if no path exists.
+
+        // collect the hierarchy edges from the start to the meeting node, then on to the end
+        vector<int> pathCHEdges;
+        for (GraphNodeIndex current = meetingNode; forward.getParentEdge(current) != -1;)
+        {
+            int chEdgeIndex = forward.getParentEdge(current);
+            pathCHEdges.push_back(chEdgeIndex);
+            current = chEdges[chEdgeIndex].from;
+        }
+        std::reverse(pathCHEdges.begin(), pathCHEdges.end());
+        for (GraphNodeIndex current = meetingNode; backward.getParentEdge(current) != -1;)
+        {
+            int chEdgeIndex = backward.getParentEdge(current);
+            pathCHEdges.push_back(chEdgeIndex);
+            current = chEdges[chEdgeIndex].to;
+        }
+
+        vector<GraphEdgeIndex> path;
+        for (int chEdgeIndex : pathCHEdges)
+            unpackEdge(chEdgeIndex, path);
+
+        return path;
+    }
+
+    /**
+     * Searches the hierarchy from one node, only relaxing edges to more important nodes, until it
+     * runs out of nodes. Every settled node that is not stalled is where a query from (forward) or
+     * to (backward) the node can meet the other half of the query, which is what the bucket based
+     * distance table is made of.
+     *
+     * @param isForward Follow the edges in their direction, else against it
+     * @param visit Called with (node, distance) for every settled node that is not stalled
+     */
+    template <typename Visit>
+    void upwardSearch(GraphNodeIndex origin, bool isForward, Visit visit) const
+    {
+        SearchWorkspace &workspace = SearchWorkspace::forThisThread();
+        workspace.reset(rank.size());
+        SearchLabels &labels = workspace.labels[0];
+        SearchQueue &pq = workspace.queues[0];
+        SearchStats &stats = workspace.stats;
+        auto &relaxEdges = isForward ? upOut : upIn;
+        auto &stallEdges = isForward ? upIn : upOut;
+
+        labels.setDistance(origin, 0, -1);
+        pq.push(0, origin);
+        stats.heapPushes++;
+
+        while (!pq.empty())
+        {
+            GraphNodeIndex v = pq.top().second;
+            pq.pop();
+            stats.heapPops++;
+
+            if (labels.isSettled(v))
+                continue; // outdated queue entry
+            labels.settle(v);
+            stats.settledNodes++;
+            long long int distance = labels.getDistance(v);
+
+            // stall-on-demand, the same as in `query`
+            bool isStalled = false;
+            for (int chEdgeIndex : stallEdges[v])
+            {
+                const CHEdge &chEdge = chEdges[chEdgeIndex];
+                long long int higherDistance = labels.getDistance(isForward ? chEdge.from : chEdge.to);
+                if (higherDistance != unreachable && higherDistance + chEdge.weight < distance)
+                {
+                    isStalled = true;
+                    break;
+                }
+            }
+            if (isStalled)
+                continue;
+
+            visit(v, distance);
+
+            for (int chEdgeIndex : relaxEdges[v])
+            {
+                const CHEdge &chEdge = chEdges[chEdgeIndex];
+                GraphNodeIndex targetNodeIndex = isForward ? chEdge.to : chEdge.from;
+                long long int distanceFromOrigin = distance + chEdge.weight;
+                stats.relaxedEdges++;
+
+                if (distanceFromOrigin < labels.getDistance(targetNodeIndex))
+                {
+                    labels.setDistance(targetNodeIndex, distanceFromOrigin, chEdgeIndex);
+                    pq.push(distanceFromOrigin, targetNodeIndex);
+                    stats.heapPushes++;
+                }
+            }
+        }
+    }
+
+private:
+    struct Arc
+    {
+        GraphNodeIndex node;
+        int weight;
+        int chEdge;
+        int hops; // number of graph edges the arc stands for
+    };
+
+    struct ContractionCost
+    {
+        int shortcuts = 0;
+        int shortcutHops = 0;
+    };
+
+    static constexpr long long int unreachable = 9999999999999;
+    static constexpr int simulationSettleLimit = 50;   // witness search limit when estimating priorities
+    static constexpr int contractionSettleLimit = 500; // witness search limit when adding shortcuts
+    static constexpr int fileMagic = 0x4843534f; // "OSCH"
+    static constexpr int fileVersion = 5;
+
+    /**
+     * Counts (and unless simulating, adds) the shortcuts needed to contract node v. A shortcut
+     * u -> w is needed when no path from u to w that avoids v is as short as u -> v -> w.
+     * Simulations use a smaller witness search, which can only overestimate the shortcuts.
+     */
+    ContractionCost contractNode(GraphNodeIndex v, bool simulate)
+    {
+        ContractionCost cost;
+
+        int maxOutWeight = 0;
+        for (const Arc &out : outArcs[v])
+            maxOutWeight = std::max(maxOutWeight, out.weight);
+
+        // copy the arcs since adding shortcuts can modify the arc lists of v's neighbours
+        vector<Arc> incoming = inArcs[v];
+        vector<Arc> outgoing = outArcs[v];
+
+        for (const Arc &in : incoming)
+        {
+            findWitnesses(in.node, v, (long long int)in.weight + maxOutWeight, simulate ? simulationSettleLimit : contractionSettleLimit);
+
+            for (const Arc &out : outgoing)
+            {
+                if (out.node == in.node)
+                    continue;
+
+                long long int viaDistance = (long long int)in.weight + out.weight;
+                bool hasWitness = witnessStamp[out.node] == currentStamp && witnessDistance[out.node] <= viaDistance;
+                if (hasWitness)
+                    continue;
+
+                cost.shortcuts++;
+                cost.shortcutHops += in.hops + out.hops;
+                if (!simulate)
+                {
+                    chEdges.push_back(CHEdge{in.node, out.node, int(viaDistance), -1, in.chEdge, out.chEdge});
+                    addOrImproveArc(in.node, out.node, int(viaDistance), chEdges.size() - 1, in.hops + out.hops);
+                }
+            }
+        }
+
+        return cost;
+    }
+
+    /**
+     * Local Dijkstra search from `source` that ignores the node being contracted. Stops once
+     * `maxDistance` is exceeded or enough nodes have been settled, which may miss witnesses but
+     * only ever causes extra (never missing) shortcuts.
+     */
+    void findWitnesses(GraphNodeIndex source, GraphNodeIndex ignoredNode, long long int maxDistance, int settleLimit)
+    {
+        currentStamp++;
+        witnessStamp[source] = currentStamp;
+        witnessDistance[source] = 0;
+
+        // the heap is kept as a plain vector so its storage is reused between searches
+        auto byDistance = greater<pair<long long int, GraphNodeIndex>>();
+        witnessHeap.clear();
+        witnessHeap.push_back(make_pair(0, source));
+
+        int settled = 0;
+        while (!witnessHeap.empty() && settled < settleLimit)
+        {
+            std::pop_heap(witnessHeap.begin(), witnessHeap.end(), byDistance);
+            auto [distance, v] = witnessHeap.back();
+            witnessHeap.pop_back();
+
+            if (distance > witnessDistance[v])
+                continue;
+            if (distance > maxDistance)
+                break;
+            settled++;
+
+            for (const Arc &arc : outArcs[v])
+            {
+                if (arc.node == ignoredNode)
+                    continue;
+
+                long long int distanceFromSource = distance + arc.weight;
+                if (witnessStamp[arc.node] != currentStamp || distanceFromSource < witnessDistance[arc.node])
+                {
+                    witnessStamp[arc.node] = currentStamp;
+                    witnessDistance[arc.node] = distanceFromSource;
+                    witnessHeap.push_back(make_pair(distanceFromSource, arc.node));
+                    std::push_heap(witnessHeap.begin(), witnessHeap.end(), byDistance);
+                }
+            }
+        }
+    }
+
+    // Adds the arc from -> to, or lowers the weight of the existing one if the new arc is lighter.
+    void addOrImproveArc(GraphNodeIndex from, GraphNodeIndex to, int weight, int chEdge, int hops)
+    {
+        for (Arc &arc : outArcs[from])
+        {
+            if (arc.node != to)
+                continue;
+
+            if (weight < arc.weight)
+            {
+                arc = Arc{to, weight, chEdge, hops};
+                for (Arc &reverseArc : inArcs[to])
+                {
+                    if (reverseArc.node == from)
+                        reverseArc = Arc{from, weight, chEdge, hops};
+                }
+            }
+            return;
+        }
+
+        outArcs[from].push_back(Arc{to, weight, chEdge, hops});
+        inArcs[to].push_back(Arc{from, weight, chEdge, hops});
+    }
+
+    void removeArc(vector<Arc> &arcs, GraphNodeIndex node)
+    {
+        arcs.erase(std::remove_if(arcs.begin(), arcs.end(), [node](const Arc &arc)
+                                  { return arc.node == node; }),
+                   arcs.end());
+    }
+
+    // Replaces a hierarchy edge by the MapGraph edges it stands for, in path order.
+    void unpackEdge(int chEdgeIndex, vector<GraphEdgeIndex> &path) const
+    {
+        vector<int> stack = {chEdgeIndex};
+        while (!stack.empty())
+        {
+            const CHEdge &chEdge = chEdges[stack.back()];
+            stack.pop_back();
+
+            if (chEdge.originalEdge != -1)
+            {
+                path.push_back(chEdge.originalEdge);
+                continue;
+            }
+
+            // second half goes on the stack first so that the first half is unpacked first
+            stack.push_back(chEdge.lowerEdgeB);
+            stack.push_back(chEdge.lowerEdgeA);
+        }
+    }
+
+    vector<CHEdge> chEdges;
+    vector<int> rank;
+    vector<vector<int>> upOut; // hierarchy edges v -> w where w is more important than v
+    vector<vector<int>> upIn;  // hierarchy edges u -> v where u is more important than v
+    int graphNodeCount = 0;
+    int graphEdgeCount = 0;
+    GraphStamp graphStamp; // of the graph the hierarchy was built for
+    std::atomic<bool> isReady = false;
+
+    // working state that only exists during preprocessing
+    vector<vector<Arc>> outArcs;
+    vector<vector<Arc>> inArcs;
+    vector<long long int> witnessDistance;
+    vector<int> witnessStamp;
+    int currentStamp = 0;
+    vector<pair<long long int, GraphNodeIndex>> witnessHeap;
+};
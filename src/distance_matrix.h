@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+#include "search_workspace.h"
+
+// How Algorithms::distanceMatrix fills a matrix
+enum class MatrixMethod
+{
+    OneToMany, // a Dijkstra per origin that stops once every destination is settled
+    Buckets    // upward searches in the contraction hierarchy that meet in per node buckets
+};
+
+/**
+ * Distances in meters from every origin (row) to every destination (column) of a distance matrix,
+ * with the time it took to compute them.
+ */
+struct DistanceMatrix
+{
+    int rows = 0;
+    int cols = 0;
+    std::vector<long long int> distances; // row major, SearchLabels::unreachable where there is no path
+
+    double milliseconds = 0;       // the whole matrix
+    double bucketMilliseconds = 0; // the part spent filling the buckets, only for MatrixMethod::Buckets
+    long long int settledNodes = 0; // by all searches together
+
+    long long int at(int row, int col) const
+    {
+        return distances[(size_t)row * cols + col];
+    }
+};
+
+/**
+ * Calls body(i) for every i from 0 up to count on `threadCount` worker threads. Every worker takes
+ * the next i until none are left, so uneven work still spreads over all threads. Each worker has
+ * its own SearchWorkspace, the body may run searches.
+ */
+template <typename Body>
+void parallelFor(size_t count, int threadCount, Body body)
+{
+    std::atomic<size_t> next = 0;
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threadCount; ++i)
+    {
+        workers.emplace_back([&]()
+                             {
+            for (size_t item = next++; item < count; item = next++)
+                body(item); });
+    }
+    for (std::thread &worker : workers)
+        worker.join();
+}
@@ -8,6 +8,7 @@
 #include "sql.h"
 #include "utils.h"
 #include "geometry.h"
+#include "geometry_codec.h"
 
 using std::string;
 using std::vector;
@@ -35,13 +36,8 @@ struct PointPath
     PointPath(string wktLinestring)
     {
         // string "4.3 1.2, 4.4 1.0," -> vector { {4.3, 1.2}, {4.4, 1.0} }
-        for (auto part : splitString(wktLinestring, ","))
-        {
-            auto lonLat = splitString(part, " ");
-            auto lon = stod(lonLat.at(0));
-            auto lat = stod(lonLat.at(1));
-            points.push_back(sf::Vector2<double>(lon, lat));
-        }
+        geocodec::parseText(wktLinestring, [this](double lon, double lat)
+                            { points.push_back(sf::Vector2<double>(lon, lat)); });
     }
 
     void extend(const PointPath &other)
@@ -88,42 +84,78 @@ struct PointPath
     }
 };
 
+// How a road is drawn on the map, decided by the largest road type of its two directions
+enum class RoadStyle : unsigned char
+{
+    Other,    // tracks, lanes and other paths
+    Minor,    // tertiary and residential roads
+    Major,    // primary and secondary roads
+    Highway,  // motorways and trunk roads
+};
+
+inline RoadStyle roadStyleOf(int pathCarFwd, int pathCarBwd)
+{
+    auto carFwd = (PathDescriptor)pathCarFwd;
+    auto carBwd = (PathDescriptor)pathCarBwd;
+
+    if (
+        carFwd == PathDescriptor::Motorway || carFwd == PathDescriptor::Trunk ||
+        carBwd == PathDescriptor::Motorway || carBwd == PathDescriptor::Trunk)
+    {
+        return RoadStyle::Highway;
+    }
+    else if (
+        carFwd == PathDescriptor::Primary || carFwd == PathDescriptor::Secondary ||
+        carBwd == PathDescriptor::Primary || carBwd == PathDescriptor::Secondary)
+    {
+        return RoadStyle::Major;
+    }
+    else if (
+        carFwd == PathDescriptor::Tertiary || carFwd == PathDescriptor::Residential ||
+        carBwd == PathDescriptor::Tertiary || carBwd == PathDescriptor::Residential)
+    {
+        return RoadStyle::Minor;
+    }
+    return RoadStyle::Other;
+}
+
+inline sf::Color roadStyleColor(RoadStyle style)
+{
+    switch (style)
+    {
+    case RoadStyle::Highway:
+        // return sf::Color(112, 144, 178, 255);
+        return sf::Color(70, 130, 180, 255); // Blue
+    case RoadStyle::Major:
+        // return sf::Color(0, 0, 0, 255);
+        return sf::Color(255, 165, 0, 255); // Orange
+    case RoadStyle::Minor:
+        return sf::Color(198, 202, 210, 255); // Gray
+    default:
+        return sf::Color(95, 188, 89, 255);
+    }
+}
+
 struct Edge
 {
     sql::Edge data;
     PointPath path;
     sf::Color color;
 
-    Edge(sql::Edge data) : data(data), path(data.pathOffsetPoints)
+    Edge(sql::Edge data) : data(data)
     {
-        // set the color of the edge based on the type of path
-        // for example: highways can be colored red, while bike/hiking only paths can
-        // be green
-        color = sf::Color(95, 188, 89, 255);
+        // use the binary points when the database has them, the text points otherwise
+        if (!geocodec::decodeInto(data.pathGeometry, path.points))
+            path = PointPath(data.pathOffsetPoints);
 
-        auto carFwd = (PathDescriptor)data.pathCarFwd;
-        auto carBwd = (PathDescriptor)data.pathCarBwd;
+        // the points are in `path` now, the column data does not need to be kept
+        this->data.pathOffsetPoints = string();
+        this->data.pathGeometry = vector<char>();
 
-        if (
-            carFwd == PathDescriptor::Motorway || carFwd == PathDescriptor::Trunk ||
-            carBwd == PathDescriptor::Motorway || carBwd == PathDescriptor::Trunk)
-        {
-            // color = sf::Color(112, 144, 178, 255);
-            color = sf::Color(70, 130, 180, 255); // Blue
-        }
-        else if (
-            carFwd == PathDescriptor::Primary || carFwd == PathDescriptor::Secondary ||
-            carBwd == PathDescriptor::Primary || carBwd == PathDescriptor::Secondary)
-        {
-            // color = sf::Color(0, 0, 0, 255);
-            color = sf::Color(255, 165, 0, 255); // Orange
-        }
-        else if (
-            carFwd == PathDescriptor::Tertiary || carFwd == PathDescriptor::Residential ||
-            carBwd == PathDescriptor::Tertiary || carBwd == PathDescriptor::Residential)
-        {
-            color = sf::Color(198, 202, 210, 255); // Gray
-        }
+        // set the color of the edge based on the type of path
+        // for example: highways can be colored blue, while bike/hiking only paths can
+        // be green
+        color = roadStyleColor(roadStyleOf(data.pathCarFwd, data.pathCarBwd));
     }
 };
 
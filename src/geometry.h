@@ -2,6 +2,7 @@
 
 #include <SFML/Graphics.hpp>
 #include <utility>
+#include <cmath>
 
 /**
  * Convert decimal degrees to meters.
@@ -25,6 +26,33 @@ double metersToDegrees(double x)
     return x / 110773; // value based on average conversion for latitude of map area
 }
 
+/**
+ * Convert decimal degrees of longitude to meters. A degree of longitude shrinks towards the
+ * poles, so the value for the northern edge of the map area is used. This never overestimates
+ * a distance inside the map area.
+ *
+ * @param x: input decimal degrees value
+ * @returns equivalent value in meters
+ */
+double longitudeDegreesToMeters(double x)
+{
+    return x * 95700; // 111320 * cos(30.7 deg), the northern edge of the map area
+}
+
+/**
+ * Lower bound of the travel distance between two points given in decimal degrees. Unlike
+ * degreesToMeters(distanceBetweenPoints(...)), longitude and latitude are scaled separately so
+ * the result is never larger than the real distance, which keeps A* heuristics admissible.
+ *
+ * @returns distance in meters that is at most the real distance between the points
+ */
+double geoDistanceLowerBound(double lon0, double lat0, double lon1, double lat1)
+{
+    double dx = longitudeDegreesToMeters(lon1 - lon0);
+    double dy = degreesToMeters(lat1 - lat0);
+    return 0.995 * sqrt(dx * dx + dy * dy); // small margin for the database lengths, which are not measured with this flat approximation
+}
+
 /**
  * Convert decimal degrees to pixels given the conversion ratio.
  *
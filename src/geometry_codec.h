@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Binary encoding of the point paths of edges, stored in the `path_geometry` column.
+ *
+ * Coordinates are offset degrees in fixed point with 1e-7 degree steps (about one centimeter).
+ * A blob is the point count followed by the difference of every coordinate to the one of the
+ * previous point (the first point to 0, 0), longitude first. Every number is zig-zag encoded,
+ * so that small negative differences stay small, and written as a varint: 7 bits per byte with
+ * the high bit set on all but the last byte. Neighbouring points of a road are close together,
+ * so most differences take 2 or 3 bytes instead of the ~20 characters of the text format.
+ */
+namespace geocodec
+{
+    constexpr double fixedPointScale = 1e7;
+
+    inline void writeVarint(std::vector<char> &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(char((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(char(value));
+    }
+
+    // Reads a varint at `position`, returns false if the data ends inside of it.
+    inline bool readVarint(const char *&position, const char *end, uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; position < end && shift < 64; shift += 7)
+        {
+            uint8_t byte = uint8_t(*position++);
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    inline uint64_t zigZag(int64_t value)
+    {
+        return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+    }
+
+    inline int64_t unZigZag(uint64_t value)
+    {
+        return int64_t(value >> 1) ^ -int64_t(value & 1);
+    }
+
+    /**
+     * Encodes a point path.
+     *
+     * @param lons Offset longitude of every point
+     * @param lats Offset latitude of every point
+     * @param out Replaced with the encoded blob
+     */
+    inline void encode(const std::vector<double> &lons, const std::vector<double> &lats, std::vector<char> &out)
+    {
+        out.clear();
+        writeVarint(out, lons.size());
+
+        int64_t previousLon = 0, previousLat = 0;
+        for (size_t i = 0; i < lons.size(); ++i)
+        {
+            int64_t lon = std::llround(lons[i] * fixedPointScale);
+            int64_t lat = std::llround(lats[i] * fixedPointScale);
+            writeVarint(out, zigZag(lon - previousLon));
+            writeVarint(out, zigZag(lat - previousLat));
+            previousLon = lon;
+            previousLat = lat;
+        }
+    }
+
+    /**
+     * Decodes a blob written by `encode` and calls `visit(lon, lat)` for every point, in order.
+     * Nothing is allocated.
+     *
+     * @return false if the blob is empty or cut off
+     */
+    template <typename Visit>
+    bool decode(const char *data, size_t size, Visit visit)
+    {
+        const char *position = data, *end = data + size;
+        uint64_t count;
+        if (!readVarint(position, end, count))
+            return false;
+
+        int64_t lon = 0, lat = 0;
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            uint64_t lonDelta, latDelta;
+            if (!readVarint(position, end, lonDelta) || !readVarint(position, end, latDelta))
+                return false;
+            lon += unZigZag(lonDelta);
+            lat += unZigZag(latDelta);
+            visit(lon / fixedPointScale, lat / fixedPointScale);
+        }
+        return true;
+    }
+
+    /**
+     * Decodes a blob into a reusable point buffer. The buffer is cleared first and keeps its
+     * capacity, so decoding many paths into the same buffer stops allocating once it is large enough.
+     *
+     * @param points Buffer of any point type that can be constructed from (lon, lat)
+     */
+    template <typename Point>
+    bool decodeInto(const std::vector<char> &blob, std::vector<Point> &points)
+    {
+        points.clear();
+        return decode(blob.data(), blob.size(), [&](double lon, double lat)
+                      { points.emplace_back(lon, lat); });
+    }
+
+    /**
+     * Parses the text format of the `path_offset_points` column, "lon lat,lon lat,...", and
+     * calls `visit(lon, lat)` for every point. Used for databases that have no blobs yet.
+     */
+    template <typename Visit>
+    void parseText(const std::string &text, Visit visit)
+    {
+        const char *position = text.c_str();
+        char *end;
+        while (*position)
+        {
+            double lon = std::strtod(position, &end);
+            if (end == position)
+                break;
+            double lat = std::strtod(end, &end);
+            visit(lon, lat);
+
+            position = end;
+            if (*position == ',')
+                ++position;
+        }
+    }
+}; // namespace geocodec
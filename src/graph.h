@@ -3,164 +3,991 @@
 #include <vector>
 #include <unordered_map>
 #include <cmath>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <filesystem>
+#include <algorithm>
+#include <type_traits>
 
 #include "sql.h"
 #include "utils.h"
+#include "edge.h"
+#include "geometry.h"
+#include "routing_profile.h"
+#include "mapped_file.h"
+#include "spatial_index.h"
 
 using GraphEdgeIndex = int;
 using GraphNodeIndex = int;
 
+// A copy of one edge's columns, for code outside of the search loops
 struct GraphEdge
 {
     long long int sqlID;
+    GraphNodeIndex from;
     GraphNodeIndex to;
-    int weight;
+    int weight; // meters, rounded up
     bool isPrimary;
+    int profileWeights[routingProfileCount] = {}; // by RoutingProfile, see profileWeight
 };
 
-struct GraphNode
+// A point on a road, the nearest one to a point on the map, see MapGraph::snapToRoad
+struct RoadSnap
 {
-    sql::Node data;
-    std::vector<GraphEdgeIndex> outEdges;
+    int road = -1;          // -1 if there is no road to snap to
+    int segment = -1;       // road point index where the segment the point lies on starts
+    double fraction = 0;    // how far along the road the point is, from 0 at its first point to 1 at its last
+    double distance = 0;    // from the snapped point to the road, in degrees
+    sf::Vector2<double> point; // offset longitude and latitude of the point on the road
 };
 
+/**
+ * The edge indices leaving or entering one node. Out edges are stored sorted by their source
+ * node, so the out edges of a node are a contiguous run of edge indices and need no index array.
+ * In edges are a slice of the reverse index array.
+ */
+class EdgeRange
+{
+public:
+    class Iterator
+    {
+    public:
+        Iterator(const GraphEdgeIndex *edgeIndices, int position) : edgeIndices(edgeIndices), position(position) {}
+
+        GraphEdgeIndex operator*() const
+        {
+            return edgeIndices ? edgeIndices[position] : position;
+        }
+
+        Iterator &operator++()
+        {
+            ++position;
+            return *this;
+        }
+
+        bool operator!=(const Iterator &other) const
+        {
+            return position != other.position;
+        }
+
+    private:
+        const GraphEdgeIndex *edgeIndices;
+        int position;
+    };
+
+    EdgeRange(const GraphEdgeIndex *edgeIndices, int first, int last) : edgeIndices(edgeIndices), first(first), last(last) {}
+
+    Iterator begin() const
+    {
+        return Iterator(edgeIndices, first);
+    }
+
+    Iterator end() const
+    {
+        return Iterator(edgeIndices, last);
+    }
+
+    int size() const
+    {
+        return last - first;
+    }
+
+private:
+    const GraphEdgeIndex *edgeIndices; // nullptr when the range is a run of edge indices
+    int first;
+    int last;
+};
+
+// The order that nodes are numbered in, which decides where they sit in the graph arrays
+enum class NodeOrder
+{
+    Database, // the order the database returns the rows in
+    Hilbert   // along a Hilbert curve over the node coordinates, so nearby nodes sit close in memory
+};
+
+// Identifies the database a graph was loaded from and how its nodes are numbered. Files computed
+// from the graph store it, so they are recomputed once the database changes.
+struct GraphStamp
+{
+    long long int dbFileSize = 0;
+    long long int dbModifiedTime = 0;
+    int nodeOrder = 0;
+    int padding = 0;
+
+    bool operator==(const GraphStamp &other) const
+    {
+        return dbFileSize == other.dbFileSize && dbModifiedTime == other.dbModifiedTime && nodeOrder == other.nodeOrder;
+    }
+    bool operator!=(const GraphStamp &other) const
+    {
+        return !(*this == other);
+    }
+};
+
+/**
+ * Road graph in compressed sparse row (CSR) layout.
+ *
+ * Every attribute lives in its own array (structure of arrays), so the search loops only pull
+ * the columns they read into cache: the edges of node v are indices firstOutEdge[v] up to
+ * firstOutEdge[v + 1] of the edgeTarget and edgeWeights arrays. The in edges of node v are
+ * inEdgeIndices[firstInEdge[v]] up to inEdgeIndices[firstInEdge[v + 1]].
+ *
+ * Besides the routing graph it keeps the drawn shape of every road (database edge) in one flat
+ * point array, and per chunk the roads that pass through it, so the map and routes can be drawn
+ * without going back to the database.
+ */
 class MapGraph
 {
 public:
     /**
      * Loads graph data from the specified database path and initializes internal graph.
      *
-     * Populates nodes and edges from the database into the graph. It updates chunked node storage
-     * and maps SQL node IDs to graph node indices. Edges are also loaded and linked to the appropriate nodes.
-     * This method is idempotent.
+     * If a snapshot path is given and the snapshot there was written from the current version of the
+     * database, the graph arrays are memory mapped from it instead, which needs no parsing at all.
+     * Otherwise the graph is built from the database and the snapshot is (re)written for the next
+     * start. This method is idempotent.
      *
      * @param dbPath The path to the database file from which to load graph data.
+     * @param snapshotPath The path of the binary graph snapshot, or empty to always use the database.
+     * @param order The order to number the nodes in, a snapshot with a different order is rebuilt.
      */
-    void load(std::string dbPath)
+    void load(std::string dbPath, std::string snapshotPath = "", NodeOrder order = NodeOrder::Hilbert)
     {
         if (isLoaded)
             return;
 
-        auto storage = sql::loadStorage(dbPath);
+        // an outdated database is rewritten by the schema upgrade, so it is stamped after that
+        sql::ensureCurrentSchema(dbPath);
+        nodeOrder = order;
+        stamp = GraphStamp();
+        stamp.nodeOrder = (int)order;
+        getDatabaseStamp(dbPath, stamp.dbFileSize, stamp.dbModifiedTime);
+        if (!snapshotPath.empty() && loadSnapshot(snapshotPath, dbPath))
+        {
+            isLoaded = true;
+            return;
+        }
 
-        // load all nodes from the db into graph
-        for (sql::Node node : storage.iterate<sql::Node>())
+        loadDatabase(dbPath);
+        if (!snapshotPath.empty())
+            saveSnapshot(snapshotPath, dbPath);
+
+        isLoaded = true;
+    }
+
+    /**
+     * Finds the node with the shortest straight line distance to a point, anywhere on the map.
+     *
+     * @param offsetLongitude The offset longitude of the point.
+     * @param offsetLatitude The offset latitude of the point.
+     *
+     * @return The index of the nearest node, -1 if the graph has no nodes or the point is outside
+     * of the map's chunk grid
+     */
+    GraphNodeIndex findNearestNode(double offsetLongitude, double offsetLatitude) const
+    {
+        if (!isOnMap(offsetLongitude, offsetLatitude))
+            return -1;
+        return nodeIndex.nearest(offsetLongitude, offsetLatitude);
+    }
+
+    /**
+     * Finds the `count` nodes nearest to a point.
+     *
+     * @param nodes Replaced with the (distance in degrees, node index) of the nodes, nearest first,
+     * empty if the point is outside of the map's chunk grid
+     */
+    void findNearestNodes(double offsetLongitude, double offsetLatitude, int count, std::vector<std::pair<double, GraphNodeIndex>> &nodes) const
+    {
+        nodes.clear();
+        if (!isOnMap(offsetLongitude, offsetLatitude))
+            return;
+        nodeIndex.kNearest(offsetLongitude, offsetLatitude, count, nodes);
+    }
+
+    /**
+     * Finds the nodes at most `radius` degrees away from a point.
+     *
+     * @param nodes Replaced with the indices of the nodes, in no particular order, empty if the
+     * point is outside of the map's chunk grid
+     */
+    void findNodesWithin(double offsetLongitude, double offsetLatitude, double radius, std::vector<GraphNodeIndex> &nodes) const
+    {
+        nodes.clear();
+        if (!isOnMap(offsetLongitude, offsetLatitude))
+            return;
+        nodeIndex.withinRadius(offsetLongitude, offsetLatitude, radius, nodes);
+    }
+
+    /**
+     * Finds the point on a road that is nearest to a point, anywhere on the map. Only roads with at
+     * least one graph edge are considered, so a route can always start or end on the snapped road.
+     * The snap has no road if the point is outside of the map's chunk grid.
+     */
+    RoadSnap snapToRoad(double offsetLongitude, double offsetLatitude) const
+    {
+        RoadSnap snap;
+        if (!isOnMap(offsetLongitude, offsetLatitude))
+            return snap;
+
+        double along;
+        snap.segment = roadSegmentIndex.nearest(offsetLongitude, offsetLatitude, [&](int segment)
+                                                { return squaredDistanceToSegment(offsetLongitude, offsetLatitude, segment, along); });
+        if (snap.segment == -1)
+            return snap;
+
+        snap.road = std::upper_bound(firstRoadPoint.begin(), firstRoadPoint.end(), snap.segment) - firstRoadPoint.begin() - 1;
+        snap.distance = std::sqrt(squaredDistanceToSegment(offsetLongitude, offsetLatitude, snap.segment, along));
+        sf::Vector2<double> start = getRoadPoint(snap.segment), end = getRoadPoint(snap.segment + 1);
+        snap.point = sf::Vector2<double>(start.x + (end.x - start.x) * along, start.y + (end.y - start.y) * along);
+
+        // the fraction is measured in meters with the scaling of geoDistanceLowerBound, so the part
+        // of a road's weight up to the point is never below the straight line bound to the point,
+        // however much the road turns between north-south and east-west
+        double lengthBefore = 0, length = 0;
+        for (int i = getRoadPointsBegin(snap.road); i + 1 < getRoadPointsEnd(snap.road); ++i)
+        {
+            sf::Vector2<double> step = getRoadPoint(i + 1) - getRoadPoint(i);
+            double dx = longitudeDegreesToMeters(step.x), dy = degreesToMeters(step.y);
+            double stepLength = std::sqrt(dx * dx + dy * dy);
+            if (i < snap.segment)
+                lengthBefore += stepLength;
+            else if (i == snap.segment)
+                lengthBefore += stepLength * along;
+            length += stepLength;
+        }
+        snap.fraction = length > 0 ? std::min(lengthBefore / length, 1.0) : 0;
+        return snap;
+    }
+
+    /**
+     * The weight of the part of an edge between two points on its road. The edge is driven from
+     * `enter` to `leave`, or from its source node or up to its target node when they are nullptr.
+     * Forbidden edges stay forbiddenWeight.
+     */
+    long long int getPartialEdgeWeight(GraphEdgeIndex edgeIndex, const RoadSnap *enter, const RoadSnap *leave, RoutingProfile profile = RoutingProfile::Distance) const
+    {
+        return getPartialEdgeWeight(edgeIndex, enter, leave, getEdgeWeights(profile));
+    }
+
+    // getPartialEdgeWeight with the weights of a column, such as one with live traffic
+    long long int getPartialEdgeWeight(GraphEdgeIndex edgeIndex, const RoadSnap *enter, const RoadSnap *leave, const Column<int> &weights) const
+    {
+        int weight = weights[edgeIndex];
+        if (weight == forbiddenWeight)
+            return forbiddenWeight;
+        double driven = edgeIsPrimary[edgeIndex] ? (leave ? leave->fraction : 1) - (enter ? enter->fraction : 0)
+                                                 : (enter ? enter->fraction : 1) - (leave ? leave->fraction : 0);
+        return std::llround(weight * std::max(driven, 0.0));
+    }
+
+    /**
+     * Weight of a path for a profile, its first edge is entered at `origin` and its last edge is
+     * left at `destination`, see getPartialEdgeWeight. Without them every edge counts in full.
+     */
+    long long int getPathWeight(const std::vector<GraphEdgeIndex> &path, RoutingProfile profile, const RoadSnap *origin = nullptr, const RoadSnap *destination = nullptr) const
+    {
+        return getPathWeight(path, getEdgeWeights(profile), origin, destination);
+    }
+
+    long long int getPathWeight(const std::vector<GraphEdgeIndex> &path, const Column<int> &weights, const RoadSnap *origin = nullptr, const RoadSnap *destination = nullptr) const
+    {
+        long long int weight = 0;
+        for (size_t i = 0; i < path.size(); ++i)
+            weight += getPartialEdgeWeight(path[i], i == 0 ? origin : nullptr, i + 1 == path.size() ? destination : nullptr, weights);
+        return weight;
+    }
+
+    // Length in meters of a path, see getPathWeight.
+    long long int getPathLength(const std::vector<GraphEdgeIndex> &path, const RoadSnap *origin = nullptr, const RoadSnap *destination = nullptr) const
+    {
+        return getPathWeight(path, edgeLength, origin, destination);
+    }
+
+    /**
+     * Appends the shape of the part of an edge between two points on its road to `points`, in
+     * driving order. The edge is driven from `enter` to `leave`, or from its source node or up to
+     * its target node when they are nullptr.
+     */
+    void appendEdgePoints(GraphEdgeIndex edgeIndex, const RoadSnap *enter, const RoadSnap *leave, std::vector<sf::Vector2<double>> &points) const
+    {
+        int road = edgeRoad[edgeIndex];
+        if (enter)
+            points.push_back(enter->point);
+        if (edgeIsPrimary[edgeIndex])
+        {
+            int last = leave ? leave->segment : getRoadPointsEnd(road) - 1;
+            for (int i = enter ? enter->segment + 1 : getRoadPointsBegin(road); i <= last; ++i)
+                points.push_back(getRoadPoint(i));
+        }
+        else
         {
-            nodes.push_back(GraphNode{node, {}});
-            nodeSQLIdToNodeIndex.emplace(node.id, nodes.size() - 1);
+            int last = leave ? leave->segment + 1 : getRoadPointsBegin(road);
+            for (int i = enter ? enter->segment : getRoadPointsEnd(road) - 1; i >= last; --i)
+                points.push_back(getRoadPoint(i));
+        }
+        if (leave)
+            points.push_back(leave->point);
+    }
+
+    bool isDataLoaded() const
+    {
+        return isLoaded;
+    }
+
+    // The database and node order the graph was loaded with
+    GraphStamp getStamp() const
+    {
+        return stamp;
+    }
+
+    int getNodeCount() const
+    {
+        return nodeLon.size();
+    }
+
+    int getEdgeCount() const
+    {
+        return edgeTarget.size();
+    }
+
+    double getNodeLon(GraphNodeIndex nodeIndex) const
+    {
+        return nodeLon[nodeIndex];
+    }
+
+    double getNodeLat(GraphNodeIndex nodeIndex) const
+    {
+        return nodeLat[nodeIndex];
+    }
+
+    EdgeRange getOutEdges(GraphNodeIndex nodeIndex) const
+    {
+        return EdgeRange(nullptr, firstOutEdge[nodeIndex], firstOutEdge[nodeIndex + 1]);
+    }
+
+    EdgeRange getInEdges(GraphNodeIndex nodeIndex) const
+    {
+        return EdgeRange(inEdgeIndices.data(), firstInEdge[nodeIndex], firstInEdge[nodeIndex + 1]);
+    }
+
+    GraphNodeIndex getEdgeSource(GraphEdgeIndex edgeIndex) const
+    {
+        return edgeSource[edgeIndex];
+    }
+
+    GraphNodeIndex getEdgeTarget(GraphEdgeIndex edgeIndex) const
+    {
+        return edgeTarget[edgeIndex];
+    }
+
+    // Length of an edge in meters, rounded up to whole meters
+    int getEdgeLength(GraphEdgeIndex edgeIndex) const
+    {
+        return edgeLength[edgeIndex];
+    }
+
+    // Weight of an edge for shortest routes, its length, or forbiddenWeight if a car may not drive it
+    int getEdgeWeight(GraphEdgeIndex edgeIndex) const
+    {
+        return edgeWeights[0][edgeIndex];
+    }
+
+    // Weight of an edge for a profile, forbiddenWeight if the profile may not use it
+    int getEdgeWeight(GraphEdgeIndex edgeIndex, RoutingProfile profile) const
+    {
+        return edgeWeights[(int)profile][edgeIndex];
+    }
+
+    /**
+     * The weight column of a profile, indexed by edge. Searches read the column of their profile
+     * directly, so a search by travel time costs the same as one by distance. These are the free
+     * flow weights, live traffic is a TrafficOverlay on top of them.
+     */
+    const Column<int> &getEdgeWeights(RoutingProfile profile) const
+    {
+        return edgeWeights[(int)profile];
+    }
+
+    GraphEdge getEdge(GraphEdgeIndex edgeIndex) const
+    {
+        GraphEdge edge{edgeSQLId[edgeIndex], edgeSource[edgeIndex], edgeTarget[edgeIndex], getEdgeLength(edgeIndex), bool(edgeIsPrimary[edgeIndex])};
+        for (int profile = 0; profile < routingProfileCount; ++profile)
+            edge.profileWeights[profile] = edgeWeights[profile][edgeIndex];
+        return edge;
+    }
+
+    // Number of roads, a road is one row of the database's edge table
+    int getRoadCount() const
+    {
+        return roadStyle.size();
+    }
+
+    RoadStyle getRoadStyle(int roadIndex) const
+    {
+        return (RoadStyle)roadStyle[roadIndex];
+    }
+
+    // The points of a road are the point indices from getRoadPointsBegin up to getRoadPointsEnd.
+    int getRoadPointsBegin(int roadIndex) const
+    {
+        return firstRoadPoint[roadIndex];
+    }
+
+    int getRoadPointsEnd(int roadIndex) const
+    {
+        return firstRoadPoint[roadIndex + 1];
+    }
+
+    // The graph edge that drives a road from its first point to its last, or from its last to its first if not `forward`. -1 if that way is forbidden.
+    GraphEdgeIndex getRoadEdge(int roadIndex, bool forward) const
+    {
+        return forward ? roadForwardEdge[roadIndex] : roadBackwardEdge[roadIndex];
+    }
+
+    // A point of a road's shape, as offset longitude and latitude
+    sf::Vector2<double> getRoadPoint(int pointIndex) const
+    {
+        return sf::Vector2<double>(roadPointLon[pointIndex], roadPointLat[pointIndex]);
+    }
+
+    // The road a graph edge belongs to. Its points run from the edge source to the target only if the edge is primary.
+    int getEdgeRoad(GraphEdgeIndex edgeIndex) const
+    {
+        return edgeRoad[edgeIndex];
+    }
+
+    /**
+     * The roads whose bounding box overlaps a chunk. A road that crosses chunk borders is listed in
+     * every chunk it overlaps, so drawing the roads of a chunk draws everything inside of it.
+     */
+    EdgeRange getChunkRoads(int chunkRow, int chunkCol) const
+    {
+        if (chunkRow < 0 || chunkRow >= chunkRows || chunkCol < 0 || chunkCol >= chunkCols)
+            return EdgeRange(nullptr, 0, 0);
 
-            int chunkRow = std::stoi(splitString(node.chunkId, ",")[0]);
-            int chunkCol = std::stoi(splitString(node.chunkId, ",")[1]);
+        int chunkIndex = chunkRow * chunkCols + chunkCol;
+        return EdgeRange(chunkRoadIndices.data(), firstChunkRoad[chunkIndex], firstChunkRoad[chunkIndex + 1]);
+    }
 
-            if (chunkedGraphNodes.size() <= chunkRow)
-                chunkedGraphNodes.resize(chunkRow + 1);
+private:
+    static constexpr int snapshotMagic = 0x4852474f; // "OGRH"
+    static constexpr int snapshotVersion = 8;
+
+    // Fixed size start of a snapshot file, the columns follow in the order of `forEachColumn`.
+    struct SnapshotHeader
+    {
+        int magic;
+        int version;
+        int nodeOrder;
+        int padding;
+        long long int dbFileSize; // the database the snapshot was written from, to detect a stale snapshot
+        long long int dbModifiedTime;
+        int nodeCount;
+        int edgeCount;
+        int chunkRows;
+        int chunkCols;
+        int roadCount;
+        int roadPointCount;
+        int chunkRoadCount;
+        int segmentCellCount;
+        int segmentEntryCount;
+        int padding2;
+        double chunkGeoSize;
+    };
 
-            if (chunkedGraphNodes[chunkRow].size() <= chunkCol)
-                chunkedGraphNodes[chunkRow].resize(chunkCol + 1);
+    // Reads nodes and edges from the database, and sorts them into the arrays.
+    void loadDatabase(std::string dbPath)
+    {
+        auto storage = sql::loadStorage(dbPath);
+        std::unordered_map<long long int, int> nodeSQLIdToNodeIndex;
+        std::vector<double> lons, lats;
+
+        // load all nodes from the db into graph
+        chunkRows = chunkCols = 0;
+        // in id order, the tables are stored by chunk, and the node numbering must not depend on that
+        using namespace sqlite_orm;
+        for (sql::Node node : storage.iterate<sql::Node>(order_by(&sql::Node::id)))
+        {
+            lons.push_back(node.offsetLon);
+            lats.push_back(node.offsetLat);
+            nodeSQLIdToNodeIndex.emplace(node.id, lons.size() - 1);
 
-            chunkedGraphNodes[chunkRow][chunkCol].push_back(nodes.size() - 1);
+            chunkRows = std::max(chunkRows, sql::chunkKeyRow(node.chunkId) + 1);
+            chunkCols = std::max(chunkCols, sql::chunkKeyCol(node.chunkId) + 1);
         }
 
-        // load and insert all edges
-        for (sql::Edge edge : storage.iterate<sql::Edge>())
+        // the chunk size in degrees, chunk (row, col) has its top left corner at (row, col) times the size
+        chunkGeoSize = 1e9; // a map with a single chunk
+        for (sql::Chunk chunk : storage.get_all<sql::Chunk>(where(c(&sql::Chunk::row) > 0 or c(&sql::Chunk::col) > 0), limit(1)))
+            chunkGeoSize = chunk.col > 0 ? chunk.offsetLonLeft / chunk.col : chunk.offsetLatTop / chunk.row;
+
+        // load all edges, they are sorted into the CSR arrays once all of them are known
+        std::vector<GraphEdge> loadedEdges;
+        std::unordered_map<long long int, int> roadIndexOfSQLId;
+        std::vector<int> firstPoint = {0};
+        std::vector<float> pointLons, pointLats;
+        std::vector<unsigned char> styles;
+        for (sql::Edge edge : storage.iterate<sql::Edge>(order_by(&sql::Edge::id)))
         {
-            // TODO improve heuristic
-            int weight = int(edge.pathLengthMeters);
+            // every database edge is also a road with a shape to draw
+            roadIndexOfSQLId.emplace(edge.id, styles.size());
+            styles.push_back((unsigned char)roadStyleOf(edge.pathCarFwd, edge.pathCarBwd));
+            auto addPoint = [&](double lon, double lat)
+            {
+                pointLons.push_back(lon);
+                pointLats.push_back(lat);
+            };
+            if (!geocodec::decode(edge.pathGeometry.data(), edge.pathGeometry.size(), addPoint))
+            {
+                // no blob, or a cut off one, read the text points instead
+                pointLons.resize(firstPoint.back());
+                pointLats.resize(firstPoint.back());
+                geocodec::parseText(edge.pathOffsetPoints, addPoint);
+            }
+            firstPoint.push_back(pointLons.size());
+
+            // rounded up, so that no edge is shorter than the straight line between its ends and the A* heuristics stay admissible
+            int weight = int(std::ceil(edge.pathLengthMeters));
 
             int idxSourceNode = nodeSQLIdToNodeIndex.at(edge.sourceNodeId);
             int idxTargetNode = nodeSQLIdToNodeIndex.at(edge.targetNodeId);
 
-            GraphNode &sourceNode = nodes.at(idxSourceNode);
-            GraphNode &targetNode = nodes.at(idxTargetNode);
+            // The graph has the roads a car may drive, in every direction that any profile may use
+            // them. Each profile weighs those edges by the path descriptor of its own mode in that
+            // direction, so a one way street has an edge against its direction that only bikes or
+            // pedestrians can use. Shortest routes are by car, they use the car's directions only.
+            auto addEdge = [&](int from, int to, bool isPrimary, int car, int bike)
+            {
+                PathDescriptor carPath = (PathDescriptor)car;
+                PathDescriptor paths[routingProfileCount] = {carPath == PathDescriptor::Forbidden ? carPath : PathDescriptor::Allowed, carPath, (PathDescriptor)bike, (PathDescriptor)edge.pathFoot};
+                GraphEdge graphEdge{edge.id, from, to, weight, isPrimary};
+                bool isUsable = false;
+                for (int profile = 0; profile < routingProfileCount; ++profile)
+                {
+                    graphEdge.profileWeights[profile] = profileWeight((RoutingProfile)profile, weight, paths[profile]);
+                    isUsable = isUsable || graphEdge.profileWeights[profile] != forbiddenWeight;
+                }
+                if (isUsable)
+                    loadedEdges.push_back(graphEdge);
+            };
 
-            if ((PathDescriptor)edge.pathCarFwd != PathDescriptor::Forbidden)
+            if ((PathDescriptor)edge.pathCarFwd != PathDescriptor::Forbidden || (PathDescriptor)edge.pathCarBwd != PathDescriptor::Forbidden)
             {
-                edges.push_back(GraphEdge{edge.id, idxTargetNode, weight, true});
-                sourceNode.outEdges.push_back(edges.size() - 1);
+                addEdge(idxSourceNode, idxTargetNode, true, edge.pathCarFwd, edge.pathBikeFwd);
+                addEdge(idxTargetNode, idxSourceNode, false, edge.pathCarBwd, edge.pathBikeBwd);
             }
+        }
+
+        if (nodeOrder == NodeOrder::Hilbert)
+            renumberNodes(hilbertOrder(lons, lats), lons, lats, loadedEdges);
 
-            if ((PathDescriptor)edge.pathCarBwd != PathDescriptor::Forbidden)
+        nodeIndex.build(lons, lats);
+        nodeLon.assign(std::move(lons));
+        nodeLat.assign(std::move(lats));
+        buildEdgeArrays(loadedEdges);
+        buildRoadArrays(roadIndexOfSQLId, std::move(firstPoint), std::move(pointLons), std::move(pointLats), std::move(styles));
+    }
+
+    // Position of the point (x, y) along a Hilbert curve that fills a 2^16 by 2^16 grid.
+    static long long int hilbertIndex(unsigned int x, unsigned int y)
+    {
+        const unsigned int n = 1u << 16;
+        long long int d = 0;
+        for (unsigned int s = n / 2; s > 0; s /= 2)
+        {
+            unsigned int rx = (x & s) > 0;
+            unsigned int ry = (y & s) > 0;
+            d += (long long int)s * s * ((3 * rx) ^ ry);
+
+            // rotate the quadrant so that the curve inside it has the right orientation
+            if (ry == 0)
             {
-                edges.push_back(GraphEdge{edge.id, idxSourceNode, weight, false});
-                targetNode.outEdges.push_back(edges.size() - 1);
+                if (rx == 1)
+                {
+                    x = n - 1 - x;
+                    y = n - 1 - y;
+                }
+                std::swap(x, y);
             }
         }
+        return d;
+    }
 
-        isLoaded = true;
+    // The nodes sorted by their position along a Hilbert curve over the bounding box of the graph.
+    static std::vector<GraphNodeIndex> hilbertOrder(const std::vector<double> &lons, const std::vector<double> &lats)
+    {
+        std::vector<GraphNodeIndex> order(lons.size());
+        if (lons.empty())
+            return order;
+
+        double minLon = *std::min_element(lons.begin(), lons.end()), maxLon = *std::max_element(lons.begin(), lons.end());
+        double minLat = *std::min_element(lats.begin(), lats.end()), maxLat = *std::max_element(lats.begin(), lats.end());
+        double scale = 65535 / std::max({maxLon - minLon, maxLat - minLat, 1e-9});
+
+        std::vector<long long int> keys(lons.size());
+        for (size_t v = 0; v < lons.size(); ++v)
+        {
+            keys[v] = hilbertIndex((lons[v] - minLon) * scale, (lats[v] - minLat) * scale);
+            order[v] = v;
+        }
+        std::sort(order.begin(), order.end(), [&](GraphNodeIndex a, GraphNodeIndex b)
+                  { return keys[a] < keys[b]; });
+        return order;
     }
 
     /**
-     * Finds the index of the node that is nearest to a given point specified by longitude and latitude offsets.
-     *
-     * This method searches through the nodes in a given chunk and find the node with the shortest straight
-     * line distance to the given point.
-     *
-     * @param chunkRow The row index of the chunk in which to search for nodes.
-     * @param chunkCol The column index of the chunk in which to search for nodes.
-     * @param offsetLongitude The offset longitude of the point.
-     * @param offsetLatitude The offset latitude of the point.
-     *
-     * @return The index of the nearest node within the specified chunk
+     * Moves the node at order[i] to index i, and updates the node references of the edges.
+     * Since edges are sorted by their source node afterwards, they follow the new order too.
      */
-    GraphNodeIndex findNearestNode(int chunkRow, int chunkCol, double offsetLongitude, double offsetLatitude)
+    static void renumberNodes(const std::vector<GraphNodeIndex> &order, std::vector<double> &lons, std::vector<double> &lats, std::vector<GraphEdge> &edges)
     {
-        using std::pow;
-        using std::sqrt;
+        std::vector<GraphNodeIndex> newIndex(order.size());
+        std::vector<double> newLons(order.size()), newLats(order.size());
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            newIndex[order[i]] = i;
+            newLons[i] = lons[order[i]];
+            newLats[i] = lats[order[i]];
+        }
+
+        for (GraphEdge &edge : edges)
+        {
+            edge.from = newIndex[edge.from];
+            edge.to = newIndex[edge.to];
+        }
+
+        lons = std::move(newLons);
+        lats = std::move(newLats);
+    }
+
+    // Counting sort of the edges by source node into the out edge arrays, then by target node
+    // into the in edge index.
+    void buildEdgeArrays(const std::vector<GraphEdge> &loadedEdges)
+    {
+        int nodeCount = getNodeCount();
+        int edgeCount = loadedEdges.size();
+
+        std::vector<int> firstOut(nodeCount + 1, 0), firstIn(nodeCount + 1, 0);
+        for (const GraphEdge &edge : loadedEdges)
+        {
+            firstOut[edge.from + 1]++;
+            firstIn[edge.to + 1]++;
+        }
+        for (int v = 0; v < nodeCount; ++v)
+        {
+            firstOut[v + 1] += firstOut[v];
+            firstIn[v + 1] += firstIn[v];
+        }
+
+        std::vector<GraphNodeIndex> sources(edgeCount), targets(edgeCount);
+        std::vector<std::vector<int>> weights(routingProfileCount, std::vector<int>(edgeCount));
+        std::vector<int> lengths(edgeCount);
+        std::vector<long long int> sqlIds(edgeCount);
+        std::vector<unsigned char> primary(edgeCount);
+        std::vector<int> nextOutEdge(firstOut.begin(), firstOut.end() - 1);
+        for (const GraphEdge &edge : loadedEdges)
+        {
+            GraphEdgeIndex edgeIndex = nextOutEdge[edge.from]++;
+            sources[edgeIndex] = edge.from;
+            targets[edgeIndex] = edge.to;
+            for (int profile = 0; profile < routingProfileCount; ++profile)
+                weights[profile][edgeIndex] = edge.profileWeights[profile];
+            lengths[edgeIndex] = edge.weight;
+            sqlIds[edgeIndex] = edge.sqlID;
+            primary[edgeIndex] = edge.isPrimary;
+        }
+
+        std::vector<GraphEdgeIndex> inIndices(edgeCount);
+        std::vector<int> nextInEdge(firstIn.begin(), firstIn.end() - 1);
+        for (GraphEdgeIndex edgeIndex = 0; edgeIndex < edgeCount; ++edgeIndex)
+            inIndices[nextInEdge[targets[edgeIndex]]++] = edgeIndex;
+
+        firstOutEdge.assign(std::move(firstOut));
+        edgeSource.assign(std::move(sources));
+        edgeTarget.assign(std::move(targets));
+        for (int profile = 0; profile < routingProfileCount; ++profile)
+            edgeWeights[profile].assign(std::move(weights[profile]));
+        edgeLength.assign(std::move(lengths));
+        edgeSQLId.assign(std::move(sqlIds));
+        edgeIsPrimary.assign(std::move(primary));
+        firstInEdge.assign(std::move(firstIn));
+        inEdgeIndices.assign(std::move(inIndices));
+    }
 
-        double x0 = offsetLongitude;
-        double y0 = offsetLatitude;
-        double smallestDistance = 100000000; // no distance will be larger than this;
-        GraphEdgeIndex closestNodeIndex = -1;
+    /**
+     * Stores the road shapes, links every graph edge to its road and back, sorts the roads into the
+     * chunks that their bounding box overlaps (counting sort, the same as the edges) and builds the
+     * segment grid for snapping to roads.
+     */
+    void buildRoadArrays(const std::unordered_map<long long int, int> &roadIndexOfSQLId, std::vector<int> firstPoint,
+                         std::vector<float> pointLons, std::vector<float> pointLats, std::vector<unsigned char> styles)
+    {
+        int roadCount = styles.size();
+        std::vector<int> roads(getEdgeCount());
+        std::vector<GraphEdgeIndex> forwardEdges(roadCount, -1), backwardEdges(roadCount, -1);
+        for (GraphEdgeIndex edgeIndex = 0; edgeIndex < getEdgeCount(); ++edgeIndex)
+        {
+            roads[edgeIndex] = roadIndexOfSQLId.at(edgeSQLId[edgeIndex]);
+            (edgeIsPrimary[edgeIndex] ? forwardEdges : backwardEdges)[roads[edgeIndex]] = edgeIndex;
+        }
 
-        for (const GraphNodeIndex &idx : chunkedGraphNodes.at(chunkRow).at(chunkCol))
+        // the segments of the roads that can be driven, for snapping points to roads
+        std::vector<int> segments;
+        for (int road = 0; road < roadCount; ++road)
         {
-            const GraphNode &node = nodes.at(idx);
-            double x1 = node.data.offsetLon;
-            double y1 = node.data.offsetLat;
+            if (forwardEdges[road] == -1 && backwardEdges[road] == -1)
+                continue;
+            for (int i = firstPoint[road]; i + 1 < firstPoint[road + 1]; ++i)
+                segments.push_back(i);
+        }
+        roadSegmentIndex.build(pointLons, pointLats, segments);
 
-            // euclidean distance with pythagorean theorem
-            double distance = sqrt(pow(x1 - x0, 2) + pow(y1 - y0, 2));
+        // calls visit(chunkIndex) for every chunk that the bounding box of a road overlaps
+        auto forEachRoadChunk = [&](int road, auto visit)
+        {
+            if (firstPoint[road] == firstPoint[road + 1])
+                return;
 
-            if (distance < smallestDistance)
+            float minLon = pointLons[firstPoint[road]], maxLon = minLon;
+            float minLat = pointLats[firstPoint[road]], maxLat = minLat;
+            for (int i = firstPoint[road] + 1; i < firstPoint[road + 1]; ++i)
             {
-                smallestDistance = distance;
-                closestNodeIndex = idx;
+                minLon = std::min(minLon, pointLons[i]);
+                maxLon = std::max(maxLon, pointLons[i]);
+                minLat = std::min(minLat, pointLats[i]);
+                maxLat = std::max(maxLat, pointLats[i]);
             }
-        }
 
-        return closestNodeIndex;
+            int topRow = std::max(0, int(minLat / chunkGeoSize)), bottomRow = std::min(chunkRows - 1, int(maxLat / chunkGeoSize));
+            int leftCol = std::max(0, int(minLon / chunkGeoSize)), rightCol = std::min(chunkCols - 1, int(maxLon / chunkGeoSize));
+            for (int row = topRow; row <= bottomRow; ++row)
+            {
+                for (int col = leftCol; col <= rightCol; ++col)
+                    visit(row * chunkCols + col);
+            }
+        };
+
+        int chunkCount = chunkRows * chunkCols;
+        std::vector<int> first(chunkCount + 1, 0);
+        for (int road = 0; road < roadCount; ++road)
+            forEachRoadChunk(road, [&](int chunk)
+                             { first[chunk + 1]++; });
+        for (int chunk = 0; chunk < chunkCount; ++chunk)
+            first[chunk + 1] += first[chunk];
+
+        std::vector<int> indices(first[chunkCount]);
+        std::vector<int> next(first.begin(), first.end() - 1);
+        for (int road = 0; road < roadCount; ++road)
+            forEachRoadChunk(road, [&](int chunk)
+                             { indices[next[chunk]++] = road; });
+
+        edgeRoad.assign(std::move(roads));
+        firstRoadPoint.assign(std::move(firstPoint));
+        roadPointLon.assign(std::move(pointLons));
+        roadPointLat.assign(std::move(pointLats));
+        roadStyle.assign(std::move(styles));
+        roadForwardEdge.assign(std::move(forwardEdges));
+        roadBackwardEdge.assign(std::move(backwardEdges));
+        firstChunkRoad.assign(std::move(first));
+        chunkRoadIndices.assign(std::move(indices));
     }
 
-    bool isDataLoaded() const
+    // Calls `visit(column, expectedSize)` for every column in the order they are stored in a snapshot.
+    template <typename Visitor>
+    void forEachColumn(const SnapshotHeader &header, Visitor visit)
     {
-        return isLoaded;
+        size_t nodeCount = header.nodeCount, edgeCount = header.edgeCount;
+        visit(nodeLon, nodeCount);
+        visit(nodeLat, nodeCount);
+        visit(firstOutEdge, nodeCount + 1);
+        visit(edgeSource, edgeCount);
+        visit(edgeTarget, edgeCount);
+        for (Column<int> &weights : edgeWeights)
+            visit(weights, edgeCount);
+        visit(edgeLength, edgeCount);
+        visit(edgeSQLId, edgeCount);
+        visit(edgeIsPrimary, edgeCount);
+        visit(firstInEdge, nodeCount + 1);
+        visit(inEdgeIndices, edgeCount);
+        visit(edgeRoad, edgeCount);
+        visit(firstRoadPoint, (size_t)header.roadCount + 1);
+        visit(roadPointLon, (size_t)header.roadPointCount);
+        visit(roadPointLat, (size_t)header.roadPointCount);
+        visit(roadStyle, (size_t)header.roadCount);
+        visit(firstChunkRoad, (size_t)header.chunkRows * header.chunkCols + 1);
+        visit(chunkRoadIndices, (size_t)header.chunkRoadCount);
+        nodeIndex.forEachColumn(nodeCount, visit);
+        visit(roadForwardEdge, (size_t)header.roadCount);
+        visit(roadBackwardEdge, (size_t)header.roadCount);
+        roadSegmentIndex.forEachColumn(header.segmentCellCount, header.segmentEntryCount, visit);
     }
 
-    GraphNode &getNode(GraphNodeIndex nodeIndex)
+    /**
+     * Squared distance in degrees from a point to the road segment from road point `segment` to the
+     * next point. `along` is set to where the nearest point of the segment is, from 0 at its start to 1 at its end.
+     */
+    double squaredDistanceToSegment(double x, double y, int segment, double &along) const
     {
-        return nodes[nodeIndex];
+        double startX = roadPointLon[segment], startY = roadPointLat[segment];
+        double dx = roadPointLon[segment + 1] - startX, dy = roadPointLat[segment + 1] - startY;
+        double squaredLength = dx * dx + dy * dy;
+        along = squaredLength > 0 ? std::clamp(((x - startX) * dx + (y - startY) * dy) / squaredLength, 0.0, 1.0) : 0;
+        double offsetX = startX + dx * along - x, offsetY = startY + dy * along - y;
+        return offsetX * offsetX + offsetY * offsetY;
     }
 
-    GraphEdge &getEdge(GraphEdgeIndex edgeIndex)
+    // Whether a point is inside of the chunk grid. Clicks in the map's bounding box can be past the
+    // last row or column of node chunks, the lookups find nothing for them.
+    bool isOnMap(double offsetLongitude, double offsetLatitude) const
     {
-        return edges[edgeIndex];
+        double row = std::floor(offsetLatitude / chunkGeoSize), col = std::floor(offsetLongitude / chunkGeoSize);
+        return row >= 0 && row < chunkRows && col >= 0 && col < chunkCols;
     }
 
-    int getNodeCount()
+    // Size and modification time of the database, or false if it does not exist.
+    static bool getDatabaseStamp(std::string dbPath, long long int &fileSize, long long int &modifiedTime)
     {
-        return nodes.size();
+        std::error_code error;
+        fileSize = std::filesystem::file_size(dbPath, error);
+        if (error)
+            return false;
+        modifiedTime = std::filesystem::last_write_time(dbPath, error).time_since_epoch().count();
+        return !error;
     }
 
-    int getEdgeCount()
+    /**
+     * Writes all graph arrays to a binary snapshot. Every column starts at a multiple of 8 bytes
+     * so that it can be used in place once the file is memory mapped. The file is written under a
+     * temporary name first so a crash never leaves a half written snapshot behind.
+     */
+    bool saveSnapshot(std::string snapshotPath, std::string dbPath)
     {
-        return edges.size();
+        SnapshotHeader header = {snapshotMagic, snapshotVersion, (int)nodeOrder, 0, 0, 0, getNodeCount(), getEdgeCount(), chunkRows, chunkCols,
+                                 getRoadCount(), (int)roadPointLon.size(), (int)chunkRoadIndices.size(), (int)roadSegmentIndex.getCellCount(),
+                                 (int)roadSegmentIndex.getEntryCount(), 0, chunkGeoSize};
+        if (!getDatabaseStamp(dbPath, header.dbFileSize, header.dbModifiedTime))
+            return false;
+
+        std::string temporaryPath = snapshotPath + ".tmp";
+        {
+            std::ofstream file(temporaryPath, std::ios::binary);
+            if (!file)
+                return false;
+
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            forEachColumn(header, [&](auto &column, size_t)
+                          {
+                const char padding[8] = {};
+                file.write(padding, (8 - file.tellp() % 8) % 8);
+                file.write(reinterpret_cast<const char *>(column.data()), column.size() * sizeof(column[0])); });
+
+            if (!file)
+                return false;
+        }
+
+        return std::rename(temporaryPath.c_str(), snapshotPath.c_str()) == 0;
     }
 
-private:
-    std::unordered_map<long long int, int> nodeSQLIdToNodeIndex;
-    std::vector<GraphNode> nodes;
-    std::vector<GraphEdge> edges;
-    bool isLoaded = false;
+    /**
+     * Maps a snapshot written by `saveSnapshot` and points the columns into it. The snapshot is
+     * rejected if it was written by another version of this code or from a different database file.
+     *
+     * @return true if the graph was loaded from the snapshot
+     */
+    bool loadSnapshot(std::string snapshotPath, std::string dbPath)
+    {
+        if (!snapshotFile.open(snapshotPath) || snapshotFile.size() < sizeof(SnapshotHeader))
+            return false;
+
+        SnapshotHeader header;
+        std::memcpy(&header, snapshotFile.data(), sizeof(header));
+
+        long long int dbFileSize, dbModifiedTime;
+        if (header.magic != snapshotMagic || header.version != snapshotVersion || header.nodeOrder != (int)nodeOrder ||
+            !getDatabaseStamp(dbPath, dbFileSize, dbModifiedTime) ||
+            header.dbFileSize != dbFileSize || header.dbModifiedTime != dbModifiedTime)
+        {
+            snapshotFile.close();
+            return false;
+        }
 
-    std::vector<std::vector<std::vector<GraphNodeIndex>>> chunkedGraphNodes;
-};
\ No newline at end of file
+        // check that every column fits in the file before pointing any of them into it
+        bool isComplete = true;
+        size_t offset = sizeof(header);
+        forEachColumn(header, [&](auto &column, size_t count)
+                      {
+            offset += (8 - offset % 8) % 8;
+            offset += count * sizeof(column[0]);
+            isComplete = isComplete && offset <= snapshotFile.size(); });
+        if (!isComplete)
+        {
+            snapshotFile.close();
+            return false;
+        }
+
+        offset = sizeof(header);
+        forEachColumn(header, [&](auto &column, size_t count)
+                      {
+            using T = std::remove_reference_t<decltype(column[0])>;
+            offset += (8 - offset % 8) % 8;
+            column.view(reinterpret_cast<const T *>(snapshotFile.data() + offset), count);
+            offset += count * sizeof(T); });
+
+        chunkRows = header.chunkRows;
+        chunkCols = header.chunkCols;
+        chunkGeoSize = header.chunkGeoSize;
+        return true;
+    }
+
+    // Backs the columns when the graph was loaded from a snapshot, declared first so that it outlives them.
+    MappedFile snapshotFile;
+
+    // node columns
+    Column<double> nodeLon;
+    Column<double> nodeLat;
+
+    // edge columns, sorted by source node
+    Column<int> firstOutEdge; // node count + 1 offsets
+    Column<GraphNodeIndex> edgeSource;
+    Column<GraphNodeIndex> edgeTarget;
+    Column<int> edgeWeights[routingProfileCount]; // by RoutingProfile, meters for Distance
+    Column<int> edgeLength;                       // meters, also of the edges that Distance forbids
+    Column<long long int> edgeSQLId;
+    Column<unsigned char> edgeIsPrimary;
+
+    // reverse index, edge indices sorted by target node
+    Column<int> firstInEdge; // node count + 1 offsets
+    Column<GraphEdgeIndex> inEdgeIndices;
+
+    // k-d tree over the node positions, for snapping points to nodes
+    KdTree nodeIndex;
+
+    // the chunk grid, chunk (row, col) has index row * chunkCols + col in the chunk columns
+    int chunkRows = 0;
+    int chunkCols = 0;
+    double chunkGeoSize = 0; // degrees
+
+    // road shapes, road i has the points firstRoadPoint[i] up to firstRoadPoint[i + 1]
+    Column<int> edgeRoad; // road of every graph edge
+    Column<int> firstRoadPoint; // road count + 1 offsets
+    Column<float> roadPointLon; // offset degrees, float is precise to a few centimeters at the map's size
+    Column<float> roadPointLat;
+    Column<unsigned char> roadStyle;
+    Column<GraphEdgeIndex> roadForwardEdge; // graph edge of every road in its point order, -1 if forbidden
+    Column<GraphEdgeIndex> roadBackwardEdge;
+
+    // uniform grid over the segments of the drivable roads, for snapping points to roads
+    SegmentGrid roadSegmentIndex;
+
+    // roads bucketed by the chunks they overlap, a road is in every chunk its bounding box touches
+    Column<int> firstChunkRoad; // chunk count + 1 offsets
+    Column<int> chunkRoadIndices;
+
+    NodeOrder nodeOrder = NodeOrder::Hilbert;
+    GraphStamp stamp;
+    bool isLoaded = false;
+};
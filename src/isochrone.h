@@ -0,0 +1,250 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+#include <unordered_map>
+
+#include <SFML/System.hpp>
+
+#include "graph.h"
+
+/**
+ * The part of the map that can be reached from an origin within one or more budgets, see
+ * Algorithms::isochrone. A band is the area reachable within one of the budgets, so the bands
+ * are nested and the last one is the largest.
+ */
+struct Isochrone
+{
+    RoutingProfile profile = RoutingProfile::Distance;
+    std::vector<double> budgets; // ascending, in meters for RoutingProfile::Distance and seconds for the others
+
+    // The reachable nodes in the order the search settled them, which is by cost. The nodes
+    // nodes[0] up to nodes[bandEnds[k]] are the ones that are reachable within budgets[k].
+    std::vector<GraphNodeIndex> nodes;
+    std::vector<double> costs; // meters or seconds from the origin to every node
+    std::vector<size_t> bandEnds;
+
+    // The outline of every band as closed rings of offset lon, lat points, the first point of a
+    // ring is repeated at its end. A band has a ring around every separate reachable area and one
+    // around every unreachable hole inside of them.
+    std::vector<std::vector<std::vector<sf::Vector2<double>>>> bandRings;
+
+    double searchMilliseconds = 0;
+    double outlineMilliseconds = 0;
+};
+
+/**
+ * A raster of the map area that a band covers, with the outline traced by marching squares.
+ *
+ * The reachable roads are drawn into the cells, then the gaps of a cell between neighbouring
+ * roads are filled in. The outline follows the cells the roads run through, so it is a concave
+ * hull of the roads at the resolution of the cells instead of a convex one that would cover
+ * unreachable water and wetland.
+ */
+class ReachabilityGrid
+{
+public:
+    /**
+     * @param left, top The corner of the area, offset degrees
+     * @param width, height The size of the area, offset degrees
+     * @param cellsAcross The number of cells along the longer side of the area
+     */
+    ReachabilityGrid(double left, double top, double width, double height, int cellsAcross)
+    {
+        cellSize = std::max({width, height, 1e-6}) / cellsAcross;
+
+        // a border of empty cells around the area, so that every outline is closed
+        this->left = left - border * cellSize;
+        this->top = top - border * cellSize;
+        cols = int(width / cellSize) + 1 + 2 * border;
+        rows = int(height / cellSize) + 1 + 2 * border;
+        cells.assign((size_t)rows * cols, 0);
+    }
+
+    void clear()
+    {
+        std::fill(cells.begin(), cells.end(), 0);
+    }
+
+    void markPoint(sf::Vector2<double> point)
+    {
+        int col = int(std::floor((point.x - left) / cellSize)), row = int(std::floor((point.y - top) / cellSize));
+        if (row >= border && row < rows - border && col >= border && col < cols - border)
+            cells[(size_t)row * cols + col] = 1;
+    }
+
+    // Marks every cell the line from a to b runs through, sampled at half a cell.
+    void markLine(sf::Vector2<double> a, sf::Vector2<double> b)
+    {
+        double length = std::hypot(b.x - a.x, b.y - a.y);
+        int steps = int(length / (cellSize / 2)) + 1;
+        for (int i = 0; i <= steps; ++i)
+            markPoint(sf::Vector2<double>(a.x + (b.x - a.x) * i / steps, a.y + (b.y - a.y) * i / steps));
+    }
+
+    /**
+     * Traces the outline of the marked cells. Changes the marked cells.
+     *
+     * @return Closed rings of offset lon, lat points, see Isochrone::bandRings
+     */
+    std::vector<std::vector<sf::Vector2<double>>> traceRings()
+    {
+        // Closing (grow, then shrink) fills the gaps between neighbouring roads. The outline runs
+        // between cell centres and cuts the corners of the cells on it, so the cells are grown
+        // once more to keep every marked cell inside of the outline.
+        grow();
+        grow();
+        shrink();
+
+        // Marching squares over the cell centres. A square between four centres has a segment
+        // across it wherever its corners differ, and a segment runs between the midpoints of two
+        // sides of the square. Every crossed side is shared by exactly two squares, so the
+        // segments link up into rings. Side `2 * (row * cols + col)` is the one to the right of
+        // centre (row, col) and `2 * (row * cols + col) + 1` the one below it.
+        std::unordered_map<int, std::pair<int, int>> links; // side -> the sides its segments lead to
+        auto link = [&](int a, int b)
+        {
+            auto add = [&](int from, int to)
+            {
+                auto [it, isNew] = links.try_emplace(from, to, -1);
+                if (!isNew)
+                    it->second.second = to;
+            };
+            add(a, b);
+            add(b, a);
+        };
+
+        for (int row = 0; row + 1 < rows; ++row)
+        {
+            for (int col = 0; col + 1 < cols; ++col)
+            {
+                int topSide = 2 * (row * cols + col), bottomSide = 2 * ((row + 1) * cols + col);
+                int leftSide = 2 * (row * cols + col) + 1, rightSide = 2 * (row * cols + col + 1) + 1;
+                int corners = at(row, col) << 3 | at(row, col + 1) << 2 | at(row + 1, col + 1) << 1 | at(row + 1, col);
+
+                // the saddles (5 and 10) keep the two marked corners connected
+                switch (corners)
+                {
+                case 1:
+                case 14:
+                    link(leftSide, bottomSide);
+                    break;
+                case 2:
+                case 13:
+                    link(bottomSide, rightSide);
+                    break;
+                case 3:
+                case 12:
+                    link(leftSide, rightSide);
+                    break;
+                case 4:
+                case 11:
+                    link(topSide, rightSide);
+                    break;
+                case 5:
+                    link(leftSide, topSide);
+                    link(bottomSide, rightSide);
+                    break;
+                case 6:
+                case 9:
+                    link(topSide, bottomSide);
+                    break;
+                case 7:
+                case 8:
+                    link(leftSide, topSide);
+                    break;
+                case 10:
+                    link(topSide, rightSide);
+                    link(leftSide, bottomSide);
+                    break;
+                }
+            }
+        }
+
+        // walk every ring once, from any side that is not on a ring yet
+        std::vector<std::vector<sf::Vector2<double>>> rings;
+        for (auto &[start, _] : links)
+        {
+            if (links.at(start).first == -2)
+                continue;
+
+            std::vector<sf::Vector2<double>> ring;
+            int previous = -1, side = start;
+            do
+            {
+                ring.push_back(sideMidpoint(side));
+                auto &next = links.at(side);
+                int following = next.first != previous ? next.first : next.second;
+                next.first = -2; // walked
+                previous = side;
+                side = following;
+            } while (side != start && side >= 0);
+            ring.push_back(ring.front());
+            rings.push_back(std::move(ring));
+        }
+        return rings;
+    }
+
+private:
+    static constexpr int border = 3;
+
+    int at(int row, int col) const
+    {
+        return cells[(size_t)row * cols + col];
+    }
+
+    // the midpoint of a side of a marching square, between two neighbouring cell centres
+    sf::Vector2<double> sideMidpoint(int side) const
+    {
+        int cell = side / 2, row = cell / cols, col = cell % cols;
+        double x = left + (col + 0.5) * cellSize, y = top + (row + 0.5) * cellSize;
+        return side % 2 == 0 ? sf::Vector2<double>(x + cellSize / 2, y) : sf::Vector2<double>(x, y + cellSize / 2);
+    }
+
+    // marks the cells next to a marked cell, in all 8 directions
+    void grow()
+    {
+        scratch.assign(cells.size(), 0);
+        for (int row = 1; row + 1 < rows; ++row)
+        {
+            for (int col = 1; col + 1 < cols; ++col)
+            {
+                if (!at(row, col))
+                    continue;
+                for (int dr = -1; dr <= 1; ++dr)
+                {
+                    for (int dc = -1; dc <= 1; ++dc)
+                        scratch[(size_t)(row + dr) * cols + col + dc] = 1;
+                }
+            }
+        }
+        cells.swap(scratch);
+    }
+
+    // unmarks the cells next to an unmarked cell, in all 8 directions
+    void shrink()
+    {
+        scratch.assign(cells.size(), 0);
+        for (int row = 1; row + 1 < rows; ++row)
+        {
+            for (int col = 1; col + 1 < cols; ++col)
+            {
+                bool isInside = true;
+                for (int dr = -1; dr <= 1 && isInside; ++dr)
+                {
+                    for (int dc = -1; dc <= 1 && isInside; ++dc)
+                        isInside = at(row + dr, col + dc);
+                }
+                scratch[(size_t)row * cols + col] = isInside;
+            }
+        }
+        cells.swap(scratch);
+    }
+
+    double left, top, cellSize;
+    int rows, cols;
+    std::vector<unsigned char> cells;
+    std::vector<unsigned char> scratch;
+};
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <string>
+#include <fstream>
+#include <utility>
+#include <atomic>
+#include <climits>
+#include <algorithm>
+#include <functional>
+
+#include "graph.h"
+#include "binary_io.h"
+#include "cancellation_token.h"
+
+using std::greater;
+using std::make_pair;
+using std::pair;
+using std::priority_queue;
+using std::vector;
+
+/**
+ * Distance lower bounds for the ALT (A*, Landmarks, Triangle inequality) heuristic.
+ *
+ * A few landmark nodes are picked far apart around the edge of the map, and the exact distances
+ * from every landmark to every node and from every node to every landmark are stored. For any
+ * nodes v, t and landmark L the triangle inequality gives
+ *   d(v, t) >= d(L, t) - d(L, v)   and   d(v, t) >= d(v, L) - d(t, L)
+ * which is a much tighter lower bound than the straight line distance, since it follows the roads.
+ */
+class Landmarks
+{
+public:
+    /**
+     * The landmarks that give the best bound between one start and end node. Only a few of the
+     * landmarks are used per query since evaluating all of them for every relaxed edge is slow.
+     */
+    class QueryBounds
+    {
+    public:
+        QueryBounds(const Landmarks *landmarks, GraphNodeIndex startNodeIndex, GraphNodeIndex endNodeIndex, vector<int> active)
+            : landmarks(landmarks), startNodeIndex(startNodeIndex), endNodeIndex(endNodeIndex), active(active) {}
+
+        // Lower bound of the distance from the node to the end node
+        double toEnd(GraphNodeIndex nodeIndex) const
+        {
+            return landmarks->lowerBound(nodeIndex, endNodeIndex, active);
+        }
+
+        // Lower bound of the distance from the start node to the node
+        double fromStart(GraphNodeIndex nodeIndex) const
+        {
+            return landmarks->lowerBound(startNodeIndex, nodeIndex, active);
+        }
+
+    private:
+        const Landmarks *landmarks;
+        GraphNodeIndex startNodeIndex;
+        GraphNodeIndex endNodeIndex;
+        vector<int> active;
+    };
+
+    /**
+     * Picks `count` landmarks with farthest selection and computes their distance tables.
+     * This runs three full graph searches per landmark, so it should be done in the background.
+     *
+     * @param graph The fully loaded graph
+     * @param count Number of landmarks to pick
+     * @param cancellation Checked between the searches, the landmarks are not usable if it stopped the build
+     */
+    void build(MapGraph &graph, int count, const CancellationToken &cancellation = CancellationToken::none())
+    {
+        isReady = false;
+        nodeCount = graph.getNodeCount();
+        edgeCount = graph.getEdgeCount();
+        graphStamp = graph.getStamp();
+        requestedCount = count;
+        landmarkNodes.clear();
+
+        if (nodeCount == 0)
+            return;
+
+        // Farthest selection: each landmark is the node farthest away from the ones picked so far.
+        // The first one is the node farthest from an arbitrary node, which lands it on the map edge.
+        vector<GraphNodeIndex> sources = {0};
+        for (int i = 0; i < count; ++i)
+        {
+            if (cancellation.isCancelled())
+                return;
+            vector<int> distances = distancesFrom(graph, sources, false);
+
+            GraphNodeIndex farthest = -1;
+            for (GraphNodeIndex v = 0; v < nodeCount; ++v)
+            {
+                if (distances[v] != unreachableDistance && (farthest == -1 || distances[v] > distances[farthest]))
+                    farthest = v;
+            }
+
+            if (farthest == -1 || std::find(landmarkNodes.begin(), landmarkNodes.end(), farthest) != landmarkNodes.end())
+                break; // the graph has fewer distinct far away nodes than requested
+
+            landmarkNodes.push_back(farthest);
+            sources = landmarkNodes;
+        }
+
+        // Tables are stored node-major so the bounds for one node sit next to each other in memory.
+        int landmarkCount = landmarkNodes.size();
+        fromLandmark.assign((size_t)nodeCount * landmarkCount, unreachableDistance);
+        toLandmark.assign((size_t)nodeCount * landmarkCount, unreachableDistance);
+        for (int i = 0; i < landmarkCount; ++i)
+        {
+            if (cancellation.isCancelled())
+                return;
+            vector<int> from = distancesFrom(graph, {landmarkNodes[i]}, false);
+            vector<int> to = distancesFrom(graph, {landmarkNodes[i]}, true);
+            for (GraphNodeIndex v = 0; v < nodeCount; ++v)
+            {
+                fromLandmark[(size_t)v * landmarkCount + i] = from[v];
+                toLandmark[(size_t)v * landmarkCount + i] = to[v];
+            }
+        }
+
+        isReady = true;
+    }
+
+    /**
+     * Writes the landmarks and their distance tables to a binary file so they do not need to be
+     * recomputed on the next start.
+     *
+     * @param path The file to write to
+     * @return true if the file was written
+     */
+    bool save(std::string path) const
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+
+        binio::writeValue(file, fileMagic);
+        binio::writeValue(file, fileVersion);
+        binio::writeValue(file, nodeCount);
+        binio::writeValue(file, edgeCount);
+        binio::writeValue(file, requestedCount);
+        binio::writeValue(file, graphStamp);
+        binio::writeVector(file, landmarkNodes);
+        binio::writeVector(file, fromLandmark);
+        binio::writeVector(file, toLandmark);
+
+        return bool(file);
+    }
+
+    /**
+     * Reads the landmarks written by `save`. The file is rejected if it was made for a graph with
+     * a different number of nodes or edges or from another version of the database, or with a
+     * different number of landmarks.
+     *
+     * @param path The file to read from
+     * @param graph The graph that the landmarks will be used with
+     * @param count The number of landmarks that is expected
+     * @return true if the landmarks were loaded and can be used
+     */
+    bool load(std::string path, MapGraph &graph, int count)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+
+        int magic = 0, version = 0, fileNodeCount = 0, fileEdgeCount = 0, fileRequestedCount = 0;
+        GraphStamp fileStamp;
+        binio::readValue(file, magic);
+        binio::readValue(file, version);
+        binio::readValue(file, fileNodeCount);
+        binio::readValue(file, fileEdgeCount);
+        binio::readValue(file, fileRequestedCount);
+        binio::readValue(file, fileStamp);
+
+        if (!file || magic != fileMagic || version != fileVersion || fileNodeCount != graph.getNodeCount() || fileEdgeCount != graph.getEdgeCount() || fileRequestedCount != count ||
+            fileStamp != graph.getStamp())
+            return false;
+
+        binio::readVector(file, landmarkNodes);
+        binio::readVector(file, fromLandmark);
+        binio::readVector(file, toLandmark);
+
+        size_t tableSize = (size_t)fileNodeCount * landmarkNodes.size();
+        if (!file || fromLandmark.size() != tableSize || toLandmark.size() != tableSize)
+            return false;
+
+        nodeCount = fileNodeCount;
+        edgeCount = fileEdgeCount;
+        graphStamp = fileStamp;
+        requestedCount = fileRequestedCount;
+        isReady = true;
+        return true;
+    }
+
+    bool isBuilt() const
+    {
+        return isReady;
+    }
+
+    /**
+     * Picks the landmarks that give the largest lower bound between the start and end node.
+     *
+     * @param startNodeIndex The index of the start node
+     * @param endNodeIndex The index of the end node
+     * @param activeCount How many landmarks to use for the query
+     */
+    QueryBounds prepareQuery(GraphNodeIndex startNodeIndex, GraphNodeIndex endNodeIndex, int activeCount = 4) const
+    {
+        vector<pair<double, int>> ranked;
+        for (int i = 0; i < (int)landmarkNodes.size(); ++i)
+            ranked.push_back(make_pair(lowerBound(startNodeIndex, endNodeIndex, {i}), i));
+
+        std::sort(ranked.begin(), ranked.end(), greater<pair<double, int>>());
+
+        vector<int> active;
+        for (int i = 0; i < (int)ranked.size() && i < activeCount; ++i)
+            active.push_back(ranked[i].second);
+
+        return QueryBounds(this, startNodeIndex, endNodeIndex, active);
+    }
+
+private:
+    static constexpr int unreachableDistance = INT_MAX;
+    static constexpr int fileMagic = 0x544c414f; // "OALT"
+    static constexpr int fileVersion = 4;
+
+    // Largest triangle inequality bound of d(from, to) over the given landmarks.
+    double lowerBound(GraphNodeIndex from, GraphNodeIndex to, const vector<int> &active) const
+    {
+        int landmarkCount = landmarkNodes.size();
+        const int *fromRowFrom = &fromLandmark[(size_t)from * landmarkCount];
+        const int *fromRowTo = &fromLandmark[(size_t)to * landmarkCount];
+        const int *toRowFrom = &toLandmark[(size_t)from * landmarkCount];
+        const int *toRowTo = &toLandmark[(size_t)to * landmarkCount];
+
+        long long int bound = 0;
+        for (int i : active)
+        {
+            // d(L, to) - d(L, from)
+            if (fromRowTo[i] != unreachableDistance && fromRowFrom[i] != unreachableDistance)
+                bound = std::max(bound, (long long int)fromRowTo[i] - fromRowFrom[i]);
+            // d(from, L) - d(to, L)
+            if (toRowFrom[i] != unreachableDistance && toRowTo[i] != unreachableDistance)
+                bound = std::max(bound, (long long int)toRowFrom[i] - toRowTo[i]);
+        }
+
+        return bound;
+    }
+
+    // Exact distances from the nearest source to every node, or to the nearest source when `backward`.
+    vector<int> distancesFrom(MapGraph &graph, const vector<GraphNodeIndex> &sources, bool backward) const
+    {
+        vector<int> distances(graph.getNodeCount(), unreachableDistance);
+
+        using QueueItem = pair<int, GraphNodeIndex>;
+        priority_queue<QueueItem, vector<QueueItem>, greater<QueueItem>> minPQ;
+        for (GraphNodeIndex source : sources)
+        {
+            distances[source] = 0;
+            minPQ.push(make_pair(0, source));
+        }
+
+        while (!minPQ.empty())
+        {
+            auto [distance, v] = minPQ.top();
+            minPQ.pop();
+
+            if (distance > distances[v])
+                continue;
+
+            for (GraphEdgeIndex edgeIndex : backward ? graph.getInEdges(v) : graph.getOutEdges(v))
+            {
+                GraphNodeIndex targetNodeIndex = backward ? graph.getEdgeSource(edgeIndex) : graph.getEdgeTarget(edgeIndex);
+                if (graph.getEdgeWeight(edgeIndex) == forbiddenWeight)
+                    continue;
+                int distanceFromSource = distance + graph.getEdgeWeight(edgeIndex);
+                if (distanceFromSource < distances[targetNodeIndex])
+                {
+                    distances[targetNodeIndex] = distanceFromSource;
+                    minPQ.push(make_pair(distanceFromSource, targetNodeIndex));
+                }
+            }
+        }
+
+        return distances;
+    }
+
+    vector<GraphNodeIndex> landmarkNodes;
+    vector<int> fromLandmark; // fromLandmark[v * landmarkCount + i] = d(landmark i, v)
+    vector<int> toLandmark;   // toLandmark[v * landmarkCount + i] = d(v, landmark i)
+    int nodeCount = 0;
+    int edgeCount = 0;
+    int requestedCount = 0;
+    GraphStamp graphStamp; // of the graph the distance tables were computed for
+    std::atomic<bool> isReady = false;
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <list>
+#include <cstddef>
+#include <utility>
+#include <unordered_map>
+
+// Counters of a chunk cache, read by the app and the benchmarks
+struct CacheStats
+{
+    long long int hits = 0;
+    long long int misses = 0;
+    long long int evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t byteBudget = 0;
+};
+
+/**
+ * Recency order and byte accounting for a cache of chunk grid cells. The cache itself keeps
+ * owning its entries, the index only tells it which cell was used least recently and whether
+ * the cached entries add up to more bytes than the budget.
+ */
+class LruIndex
+{
+public:
+    /**
+     * @param byteBudget Number of bytes the cached entries may use, 0 means no limit
+     */
+    explicit LruIndex(size_t byteBudget = 0) : byteBudget(byteBudget) {}
+
+    void setByteBudget(size_t budget)
+    {
+        byteBudget = budget;
+    }
+
+    size_t getByteBudget() const
+    {
+        return byteBudget;
+    }
+
+    /**
+     * Adds a cell as the most recently used one, or updates its size if it is already indexed.
+     */
+    void insert(int row, int col, size_t bytes)
+    {
+        erase(row, col);
+        order.push_front({row, col});
+        entries.emplace(key(row, col), Entry{order.begin(), bytes});
+        totalBytes += bytes;
+    }
+
+    /**
+     * Marks a cell as the most recently used one.
+     */
+    void touch(int row, int col)
+    {
+        auto it = entries.find(key(row, col));
+        if (it != entries.end())
+            order.splice(order.begin(), order, it->second.position);
+    }
+
+    void erase(int row, int col)
+    {
+        auto it = entries.find(key(row, col));
+        if (it == entries.end())
+            return;
+
+        totalBytes -= it->second.bytes;
+        order.erase(it->second.position);
+        entries.erase(it);
+    }
+
+    bool isOverBudget() const
+    {
+        return byteBudget != 0 && totalBytes > byteBudget;
+    }
+
+    bool empty() const
+    {
+        return order.empty();
+    }
+
+    // row and column of the least recently used cell, the index must not be empty
+    std::pair<int, int> leastRecent() const
+    {
+        return order.back();
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+    size_t bytes() const
+    {
+        return totalBytes;
+    }
+
+private:
+    struct Entry
+    {
+        std::list<std::pair<int, int>>::iterator position;
+        size_t bytes;
+    };
+
+    static long long int key(int row, int col)
+    {
+        return ((long long int)row << 32) | (unsigned int)col;
+    }
+
+    std::list<std::pair<int, int>> order; // most recently used first
+    std::unordered_map<long long int, Entry> entries;
+    size_t totalBytes = 0;
+    size_t byteBudget;
+};
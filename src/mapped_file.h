@@ -0,0 +1,169 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * A read only view of a whole file. On POSIX systems the file is memory mapped, so opening it
+ * costs nothing up front and pages are read in by the OS as they are first touched. Elsewhere the
+ * file is read into memory in one go.
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    /**
+     * Maps the file at `path`, replacing the file that was mapped before.
+     *
+     * @return true if the file exists and could be mapped
+     */
+    bool open(std::string path)
+    {
+        close();
+
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void *mapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps its own reference to the file
+        if (mapping == MAP_FAILED)
+            return false;
+
+        bytes = static_cast<const char *>(mapping);
+        byteCount = fileStat.st_size;
+#else
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+
+        // doubles are used as the buffer type so that the contents are 8 byte aligned like a mapping
+        byteCount = file.tellg();
+        buffer.resize((byteCount + sizeof(double) - 1) / sizeof(double));
+        file.seekg(0);
+        file.read(reinterpret_cast<char *>(buffer.data()), byteCount);
+        if (!file)
+        {
+            close();
+            return false;
+        }
+        bytes = reinterpret_cast<const char *>(buffer.data());
+#endif
+        return true;
+    }
+
+    void close()
+    {
+#ifndef _WIN32
+        if (bytes)
+            munmap(const_cast<char *>(bytes), byteCount);
+#else
+        buffer.clear();
+        buffer.shrink_to_fit();
+#endif
+        bytes = nullptr;
+        byteCount = 0;
+    }
+
+    const char *data() const
+    {
+        return bytes;
+    }
+
+    size_t size() const
+    {
+        return byteCount;
+    }
+
+private:
+#ifdef _WIN32
+    std::vector<double> buffer;
+#endif
+    const char *bytes = nullptr;
+    size_t byteCount = 0;
+};
+
+/**
+ * A read only array that either owns its elements or points into a `MappedFile`, so the search
+ * code reads the same way whether the graph was built from the database or mapped from a snapshot.
+ */
+template <typename T>
+class Column
+{
+public:
+    Column() = default;
+    Column(const Column &) = delete;
+    Column &operator=(const Column &) = delete;
+
+    // Takes ownership of the values.
+    void assign(std::vector<T> values)
+    {
+        owned = std::move(values);
+        items = owned.data();
+        count = owned.size();
+    }
+
+    // Points the column at `size` elements that are owned by someone else, usually a mapped file.
+    void view(const T *data, size_t size)
+    {
+        owned.clear();
+        owned.shrink_to_fit();
+        items = data;
+        count = size;
+    }
+
+    const T &operator[](size_t index) const
+    {
+        return items[index];
+    }
+
+    const T *data() const
+    {
+        return items;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    const T *begin() const
+    {
+        return items;
+    }
+
+    const T *end() const
+    {
+        return items + count;
+    }
+
+private:
+    std::vector<T> owned;
+    const T *items = nullptr;
+    size_t count = 0;
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <optional>
+#include <cstdint>
+
+/**
+ * Bounded lock-free queue for many producer threads and a single consumer thread, after Dmitry
+ * Vyukov's bounded MPMC queue.
+ *
+ * Every cell carries a sequence number that says whose turn it is: a producer may fill the cell
+ * when the sequence equals its claimed position, the consumer may empty it once the sequence is
+ * one past that. Producers claim positions with a compare and swap on `enqueuePosition`, so they
+ * never block each other for longer than one failed CAS, and the consumer needs no atomic RMW at all.
+ */
+template <typename T>
+class MPSCQueue
+{
+public:
+    /**
+     * @param capacity Number of elements the queue can hold, rounded up to a power of two
+     */
+    explicit MPSCQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+
+        mask = size - 1;
+        cells = std::make_unique<Cell[]>(size);
+        for (size_t i = 0; i < size; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MPSCQueue(const MPSCQueue &) = delete;
+    MPSCQueue &operator=(const MPSCQueue &) = delete;
+
+    /**
+     * Moves the value into the queue. Can be called from any thread.
+     *
+     * @return false if the queue is full, the value is left untouched then
+     */
+    bool tryPush(T &&value)
+    {
+        Cell *cell;
+        size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &cells[position & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+            if (difference == 0)
+            {
+                // the cell is free, claim it unless another producer was faster
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (difference < 0)
+            {
+                return false; // the consumer has not emptied this cell yet, the queue is full
+            }
+            else
+            {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value.emplace(std::move(value));
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Takes the oldest value out of the queue. Must only be called from the consumer thread.
+     *
+     * @return The value, or nothing if the queue is empty
+     */
+    std::optional<T> tryPop()
+    {
+        size_t position = dequeuePosition.load(std::memory_order_relaxed);
+        Cell *cell = &cells[position & mask];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        if ((intptr_t)sequence - (intptr_t)(position + 1) < 0)
+            return std::nullopt; // the producer of this cell has not finished writing it
+
+        std::optional<T> value = std::move(cell->value);
+        cell->value.reset();
+        cell->sequence.store(position + mask + 1, std::memory_order_release); // free for the producers of the next lap
+        dequeuePosition.store(position + 1, std::memory_order_relaxed);
+        return value;
+    }
+
+    // Number of values in the queue, only exact when no producer is pushing at the same time.
+    size_t sizeApprox() const
+    {
+        size_t enqueued = enqueuePosition.load(std::memory_order_relaxed);
+        size_t dequeued = dequeuePosition.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        std::optional<T> value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+
+    // on separate cache lines so that producers and the consumer do not invalidate each other's line
+    alignas(64) std::atomic<size_t> enqueuePosition = 0;
+    alignas(64) std::atomic<size_t> dequeuePosition = 0;
+};
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <iostream>
 #include <functional>
 
@@ -7,12 +9,8 @@
 #include "viewport.h"
 #include "geometry.h"
 #include "pubsub.h"
-
-enum class AlgoName
-{
-    AStar,
-    Dijkstras
-};
+#include "algo_name.h"
+#include "routing_profile.h"
 
 class Pin
 {
@@ -88,6 +86,9 @@ public:
         originFieldFilled = false;
         destinationFieldFilled = false;
         animate = false;
+        bidirectional = false;
+        useLandmarks = false;
+        profile = RoutingProfile::Distance;
         font.loadFromFile("assets/fonts/Roboto-Light.ttf");
         initBackgroundBox(width, height);
         initInputBoxes(height);
@@ -135,10 +136,22 @@ public:
         {
             selectAStar();
         }
+        else if (chCheckBox.getGlobalBounds().contains(x, y))
+        {
+            selectContractionHierarchies();
+        }
         else if (animationCheckBox.getGlobalBounds().contains(x, y))
         {
             selectAnimate();
         }
+        else if (bidirectionalCheckBox.getGlobalBounds().contains(x, y))
+        {
+            selectBidirectional();
+        }
+        else if (landmarksCheckBox.getGlobalBounds().contains(x, y))
+        {
+            selectLandmarks();
+        }
         // Only one field can be active at a time.
         else if (originInputBox.getGlobalBounds().contains(x, y))
         {
@@ -166,8 +179,8 @@ public:
             {
                 submissionResultText.setString("");
                 ps::Event event(ps::EventType::NavBoxSubmitted);
-                event.data = ps::Data::NavBoxForm(offsetLonLatOrigin, offsetLonLatDestination, (int)selectedAlgorithm);
-                emitEvent(event);
+                event.data = ps::Data::NavBoxForm(offsetLonLatOrigin, offsetLonLatDestination, (int)getSelectedAlgorithm());
+                emitEvent(std::move(event));
             }
             else
             {
@@ -214,9 +227,25 @@ public:
             }
         }
 
+        // P switches between routing by distance and by car, bike or foot travel time
+        if (isPressed && keyEvent.key.code == sf::Keyboard::P)
+        {
+            profile = (RoutingProfile)(((int)profile + 1) % routingProfileCount);
+            submissionResultText.setString(profile == RoutingProfile::Distance ? "Shortest route" : "Fastest route by " + routingProfileToString(profile));
+            formChanged = true;
+        }
+
         if (formChanged)
             emitEvent(ps::Event(ps::EventType::NavBoxFormChanged));
 
+        // I shows how far can be driven from the origin
+        if (isPressed && keyEvent.key.code == sf::Keyboard::I && originFieldFilled)
+        {
+            ps::Event event(ps::EventType::IsochroneRequested);
+            event.data = ps::Data::NavBoxForm(offsetLonLatOrigin, offsetLonLatDestination, (int)getSelectedAlgorithm());
+            emitEvent(std::move(event));
+        }
+
         setPlaceHolders();
     }
 
@@ -292,8 +321,14 @@ public:
         window.draw(dijkstraCheckBox);
         window.draw(aStarCheckBoxLabel);
         window.draw(aStarCheckBox);
+        window.draw(chCheckBoxLabel);
+        window.draw(chCheckBox);
         window.draw(animationCheckBoxLabel);
         window.draw(animationCheckBox);
+        window.draw(bidirectionalCheckBoxLabel);
+        window.draw(bidirectionalCheckBox);
+        window.draw(landmarksCheckBoxLabel);
+        window.draw(landmarksCheckBox);
         window.draw(submitButton);
         window.draw(submitButtonLabel);
         window.draw(submissionResultText);
@@ -311,9 +346,15 @@ public:
         }
     }
 
-    // Returns the selected algorithm
+    // Returns the selected algorithm, taking the bidirectional and ALT checkboxes into account
     AlgoName getSelectedAlgorithm()
     {
+        if (bidirectional && selectedAlgorithm == AlgoName::Dijkstras)
+            return AlgoName::BidirectionalDijkstras;
+        if (selectedAlgorithm == AlgoName::AStar && useLandmarks)
+            return bidirectional ? AlgoName::BidirectionalALT : AlgoName::ALT;
+        if (bidirectional && selectedAlgorithm == AlgoName::AStar)
+            return AlgoName::BidirectionalAStar;
         return selectedAlgorithm;
     }
 
@@ -329,6 +370,12 @@ public:
         return animate;
     }
 
+    // Returns the routing profile the user has selected with the P key
+    RoutingProfile getProfile()
+    {
+        return profile;
+    }
+
 private:
     Viewport *viewport;
     sf::RenderWindow *window;
@@ -340,6 +387,9 @@ private:
     bool originFieldFilled;
     bool destinationFieldFilled;
     bool animate;
+    bool bidirectional;
+    bool useLandmarks;
+    RoutingProfile profile;
 
     sf::Vector2<double> offsetLonLatOrigin;
     sf::Vector2<double> offsetLonLatDestination;
@@ -367,8 +417,14 @@ private:
     sf::RectangleShape dijkstraCheckBox;
     sf::Text aStarCheckBoxLabel;
     sf::RectangleShape aStarCheckBox;
+    sf::Text chCheckBoxLabel;
+    sf::RectangleShape chCheckBox;
     sf::Text animationCheckBoxLabel;
     sf::RectangleShape animationCheckBox;
+    sf::Text bidirectionalCheckBoxLabel;
+    sf::RectangleShape bidirectionalCheckBox;
+    sf::Text landmarksCheckBoxLabel;
+    sf::RectangleShape landmarksCheckBox;
 
     sf::Text submitButtonLabel;
     sf::RectangleShape submitButton;
@@ -481,6 +537,7 @@ private:
         {
             dijkstraCheckBox.setFillColor(sf::Color::Black);
             aStarCheckBox.setFillColor(sf::Color::White);
+            chCheckBox.setFillColor(sf::Color::White);
             selectedAlgorithm = AlgoName::Dijkstras;
         }
     }
@@ -492,10 +549,23 @@ private:
         {
             aStarCheckBox.setFillColor(sf::Color::Black);
             dijkstraCheckBox.setFillColor(sf::Color::White);
+            chCheckBox.setFillColor(sf::Color::White);
             selectedAlgorithm = AlgoName::AStar;
         }
     }
 
+    // Select the contraction hierarchies checkbox by changing the color of the box
+    void selectContractionHierarchies()
+    {
+        if (selectedAlgorithm != AlgoName::ContractionHierarchies)
+        {
+            chCheckBox.setFillColor(sf::Color::Black);
+            dijkstraCheckBox.setFillColor(sf::Color::White);
+            aStarCheckBox.setFillColor(sf::Color::White);
+            selectedAlgorithm = AlgoName::ContractionHierarchies;
+        }
+    }
+
     // Select the animation checkbox by changing the color of the box
     void selectAnimate()
     {
@@ -511,6 +581,36 @@ private:
         }
     }
 
+    // Select the bidirectional checkbox by changing the color of the box
+    void selectBidirectional()
+    {
+        if (bidirectionalCheckBox.getFillColor() == sf::Color::White)
+        {
+            bidirectionalCheckBox.setFillColor(sf::Color::Black);
+            bidirectional = true;
+        }
+        else
+        {
+            bidirectionalCheckBox.setFillColor(sf::Color::White);
+            bidirectional = false;
+        }
+    }
+
+    // Select the ALT (A* with landmarks) checkbox by changing the color of the box
+    void selectLandmarks()
+    {
+        if (landmarksCheckBox.getFillColor() == sf::Color::White)
+        {
+            landmarksCheckBox.setFillColor(sf::Color::Black);
+            useLandmarks = true;
+        }
+        else
+        {
+            landmarksCheckBox.setFillColor(sf::Color::White);
+            useLandmarks = false;
+        }
+    }
+
     //////////////////////////
     // Initial Construction //
     //////////////////////////
@@ -578,6 +678,17 @@ private:
         aStarCheckBox.setOutlineThickness(1);
         aStarCheckBox.setPosition(aStarCheckBoxLabel.getPosition().x + aStarCheckBoxLabel.getGlobalBounds().width + 5, window->getSize().y - height + 75);
 
+        chCheckBoxLabel.setFont(font);
+        chCheckBoxLabel.setCharacterSize(15);
+        chCheckBoxLabel.setFillColor(sf::Color::Black);
+        chCheckBoxLabel.setString("CH:");
+        chCheckBoxLabel.setPosition(aStarCheckBox.getPosition().x + aStarCheckBox.getSize().x + 10, window->getSize().y - height + 70);
+        chCheckBox.setSize(sf::Vector2f(10, 10));
+        chCheckBox.setFillColor(sf::Color::White);
+        chCheckBox.setOutlineColor(sf::Color(128, 128, 128));
+        chCheckBox.setOutlineThickness(1);
+        chCheckBox.setPosition(chCheckBoxLabel.getPosition().x + chCheckBoxLabel.getGlobalBounds().width + 5, window->getSize().y - height + 75);
+
         animationCheckBoxLabel.setFont(font);
         animationCheckBoxLabel.setCharacterSize(15);
         animationCheckBoxLabel.setFillColor(sf::Color::Black);
@@ -588,6 +699,28 @@ private:
         animationCheckBox.setOutlineColor(sf::Color(128, 128, 128));
         animationCheckBox.setOutlineThickness(1);
         animationCheckBox.setPosition(animationCheckBoxLabel.getPosition().x + animationCheckBoxLabel.getGlobalBounds().width + 5, window->getSize().y - height + 95);
+
+        bidirectionalCheckBoxLabel.setFont(font);
+        bidirectionalCheckBoxLabel.setCharacterSize(15);
+        bidirectionalCheckBoxLabel.setFillColor(sf::Color::Black);
+        bidirectionalCheckBoxLabel.setString("Bidirectional:");
+        bidirectionalCheckBoxLabel.setPosition(animationCheckBox.getPosition().x + animationCheckBox.getSize().x + 10, window->getSize().y - height + 90);
+        bidirectionalCheckBox.setSize(sf::Vector2f(10, 10));
+        bidirectionalCheckBox.setFillColor(sf::Color::White);
+        bidirectionalCheckBox.setOutlineColor(sf::Color(128, 128, 128));
+        bidirectionalCheckBox.setOutlineThickness(1);
+        bidirectionalCheckBox.setPosition(bidirectionalCheckBoxLabel.getPosition().x + bidirectionalCheckBoxLabel.getGlobalBounds().width + 5, window->getSize().y - height + 95);
+
+        landmarksCheckBoxLabel.setFont(font);
+        landmarksCheckBoxLabel.setCharacterSize(15);
+        landmarksCheckBoxLabel.setFillColor(sf::Color::Black);
+        landmarksCheckBoxLabel.setString("ALT:");
+        landmarksCheckBoxLabel.setPosition(bidirectionalCheckBox.getPosition().x + bidirectionalCheckBox.getSize().x + 10, window->getSize().y - height + 90);
+        landmarksCheckBox.setSize(sf::Vector2f(10, 10));
+        landmarksCheckBox.setFillColor(sf::Color::White);
+        landmarksCheckBox.setOutlineColor(sf::Color(128, 128, 128));
+        landmarksCheckBox.setOutlineThickness(1);
+        landmarksCheckBox.setPosition(landmarksCheckBoxLabel.getPosition().x + landmarksCheckBoxLabel.getGlobalBounds().width + 5, window->getSize().y - height + 95);
     }
 
     void initTextElements(float height)
@@ -4,7 +4,9 @@
 
 ps::Publisher::~Publisher()
 {
-    for (auto &[eventType, subscribers] : m_subscribers)
+    // removeSubscriber erases from m_subscribers, so iterate over a copy
+    SubscriberMap subscriberMap = m_subscribers;
+    for (auto &[eventType, subscribers] : subscriberMap)
     {
         for (auto subscriber : subscribers)
         {
@@ -61,11 +63,31 @@ void ps::Publisher::emitEvent(const Event &event)
     }
 }
 
+void ps::Publisher::emitEvent(Event &&event)
+{
+    auto it = m_subscribers.find(event.type);
+    if (it == m_subscribers.end())
+        return; // event type has no subscribers so return
+
+    // every subscriber but the last one sees a const event, the last one may move its data
+    const SubscriberSet &subscribers = it->second;
+    size_t remaining = subscribers.size();
+    for (auto pSubscriber : subscribers)
+    {
+        if (--remaining == 0)
+            pSubscriber->onEvent(std::move(event));
+        else
+            pSubscriber->onEvent(static_cast<const Event &>(event));
+    }
+}
+
 // SUBSCRIBER IMPL
 
 ps::ISubscriber::~ISubscriber()
 {
-    for (auto &[eventType, publishers] : m_publishers)
+    // unsubscribe erases from m_publishers, so iterate over a copy
+    PublisherMap publisherMap = m_publishers;
+    for (auto &[eventType, publishers] : publisherMap)
     {
         for (auto publisher : publishers)
         {
@@ -101,6 +123,11 @@ void ps::ISubscriber::unsubscribe(Publisher *publisher, EventType eventType)
         publisher->removeSubscriber(this, eventType);
 }
 
+void ps::ISubscriber::onEvent(Event &&event)
+{
+    onEvent(static_cast<const Event &>(event));
+}
+
 bool ps::ISubscriber::isSubscribedTo(Publisher *publisher, EventType eventType)
 {
     auto it = m_publishers.find(eventType);
@@ -113,37 +140,79 @@ bool ps::ISubscriber::isSubscribedTo(Publisher *publisher, EventType eventType)
 
 // EVENT QUEUE IMPL
 
+ps::EventQueue::EventQueue(size_t capacity) : ring(capacity) {}
+
 void ps::EventQueue::onEvent(const ps::Event &event)
 {
-    pushEvent(event);
+    pushEvent(event.clone());
+}
+
+void ps::EventQueue::onEvent(ps::Event &&event)
+{
+    pushEvent(std::move(event));
+}
+
+void ps::EventQueue::pushEvent(ps::Event &&event)
+{
+    // while the overflow is in use new events have to go there too, or they would overtake it
+    if (!isOverflowing.load(std::memory_order_acquire) && ring.tryPush(std::move(event)))
+        return;
+
+    const std::lock_guard<std::mutex> lock_guard(overflowLock);
+    overflow.push_back(std::move(event));
+    isOverflowing.store(true, std::memory_order_release);
+}
+
+size_t ps::EventQueue::drainInto(std::vector<ps::Event> &events)
+{
+    size_t before = events.size();
+    while (std::optional<ps::Event> event = ring.tryPop())
+        events.push_back(std::move(*event));
+
+    if (isOverflowing.load(std::memory_order_acquire))
+        drainOverflowInto(events);
+
+    return events.size() - before;
 }
 
-void ps::EventQueue::pushEvent(const ps::Event &event)
+void ps::EventQueue::drainOverflowInto(std::vector<ps::Event> &events)
 {
-    const std::lock_guard<std::mutex> lock_guard(lock);
-    queue.push(event);
+    const std::lock_guard<std::mutex> lock_guard(overflowLock);
+
+    // a producer may have won a ring cell just before the overflow started, those come first
+    while (std::optional<ps::Event> event = ring.tryPop())
+        events.push_back(std::move(*event));
+
+    for (ps::Event &event : overflow)
+        events.push_back(std::move(event));
+    overflow.clear();
+    isOverflowing.store(false, std::memory_order_release);
 }
 
 ps::Event ps::EventQueue::popNext()
 {
-    const std::lock_guard<std::mutex> lock_guard(lock);
-    if (queue.empty())
+    if (std::optional<ps::Event> event = ring.tryPop())
+        return std::move(*event);
+
+    const std::lock_guard<std::mutex> lock_guard(overflowLock);
+    if (overflow.empty())
     {
         throw std::runtime_error("Attempt to pop from an empty queue");
     }
-    ps::Event res = queue.front();
-    queue.pop();
+    ps::Event res = std::move(overflow.front());
+    overflow.pop_front();
+    if (overflow.empty())
+        isOverflowing.store(false, std::memory_order_release);
     return res;
 }
 
 bool ps::EventQueue::empty() const
 {
-    std::lock_guard<std::mutex> lock_guard(lock);
-    return queue.empty();
+    return size() == 0;
 }
 
 size_t ps::EventQueue::size() const
 {
-    std::lock_guard<std::mutex> lock_guard(lock);
-    return queue.size();
+    const std::lock_guard<std::mutex> lock_guard(overflowLock);
+    return ring.sizeApprox() + overflow.size();
 }
@@ -7,12 +7,15 @@
 #include <map>
 #include <unordered_set>
 #include <mutex>
-#include <queue>
+#include <deque>
+#include <atomic>
 #include <vector>
 #include <chrono>
 
 #include <SFML/System.hpp>
 
+#include "mpsc_queue.h"
+
 using std::map;
 using std::string;
 using std::unordered_set;
@@ -31,7 +34,11 @@ namespace ps
         NavBoxSubmitted, // NavBoxForm
         NavBoxFormChanged, // NavBoxForm
         RouteCompleted,  // CompleteRoute
-        NodeTouched  // Vector2
+        SearchProgress, // NodeBatch
+        ContractionHierarchyReady, // n/a
+        IsochroneRequested, // NavBoxForm
+        IsochroneCompleted, // IsochroneBands
+        RouteFailed // Message
     };
 
     namespace Data
@@ -53,11 +60,19 @@ namespace ps
          */
         struct CompleteRoute
         {
-            CompleteRoute(std::vector<int> edgeIndices, std::chrono::duration<double> runTime)
-                : edgeIndices(edgeIndices), runTime(runTime) {}
+            CompleteRoute(std::vector<int> edgeIndices, std::chrono::duration<double> runTime, sf::Vector2<double> origin, sf::Vector2<double> destination, bool snappedToRoads,
+                          int originNode, int destinationNode, int profile)
+                : edgeIndices(edgeIndices), runTime(runTime), origin(origin), destination(destination), snappedToRoads(snappedToRoads),
+                  originNode(originNode), destinationNode(destinationNode), profile(profile) {}
 
             std::vector<int> edgeIndices;
             std::chrono::duration<double> runTime;
+            sf::Vector2<double> origin;      // offset coordinates the route was requested for
+            sf::Vector2<double> destination;
+            bool snappedToRoads;             // the route starts and ends on the road nearest to them, not at a node
+            int originNode;                  // the nodes a route between nodes starts and ends at, -1 if snapped to roads or off the map
+            int destinationNode;
+            int profile;                     // the RoutingProfile the route was found for
         };
 
         struct Vector2
@@ -66,6 +81,40 @@ namespace ps
             double x = 0;
             double y = 0;
         };
+
+        /**
+         * Offset coordinates of nodes that a running search has settled
+         */
+        struct NodeBatch
+        {
+            NodeBatch(std::vector<Vector2> points) : points(std::move(points)) {}
+
+            std::vector<Vector2> points;
+        };
+
+        /**
+         * Contains the outlines of a computed isochrone, see Algorithms::isochrone
+         */
+        struct IsochroneBands
+        {
+            IsochroneBands(std::vector<std::vector<std::vector<sf::Vector2<double>>>> bandRings, std::vector<double> minutes, size_t reachedNodes, std::chrono::duration<double> runTime)
+                : bandRings(std::move(bandRings)), minutes(std::move(minutes)), reachedNodes(reachedNodes), runTime(runTime) {}
+
+            std::vector<std::vector<std::vector<sf::Vector2<double>>>> bandRings; // closed rings of offset coordinates per band
+            std::vector<double> minutes;                                          // driving time of every band
+            size_t reachedNodes;
+            std::chrono::duration<double> runTime;
+        };
+
+        /**
+         * Text to show the user, like why a search failed
+         */
+        struct Message
+        {
+            Message(std::string text) : text(std::move(text)) {}
+
+            std::string text;
+        };
     };
 
     struct Event
@@ -79,8 +128,22 @@ namespace ps
 
         Event(EventType type) : type(type) {}
 
+        // Events are move only so that payloads like a route's edges are never copied by accident,
+        // use clone() where a copy is really needed.
+        Event(Event &&) = default;
+        Event &operator=(Event &&) = default;
+        Event(const Event &) = delete;
+        Event &operator=(const Event &) = delete;
+
+        Event clone() const
+        {
+            Event copy(type);
+            copy.data = data;
+            return copy;
+        }
+
         EventType type;
-        std::variant<std::monostate, Data::NavBoxForm, Data::CompleteRoute, Data::Vector2> data;
+        std::variant<std::monostate, Data::NavBoxForm, Data::CompleteRoute, Data::Vector2, Data::NodeBatch, Data::IsochroneBands, Data::Message> data;
     };
 
     class ISubscriber; // fwd declaration
@@ -133,6 +196,13 @@ namespace ps
          */
         virtual void emitEvent(const Event &event);
 
+        /**
+         * Emit an event that the publisher no longer needs, the last subscriber gets to move
+         * its data instead of copying it.
+         * @param event The event to be emitted
+         */
+        virtual void emitEvent(Event &&event);
+
     private:
         using SubscriberSet = std::unordered_set<ISubscriber *>;
         using SubscriberMap = std::map<EventType, SubscriberSet>;
@@ -179,6 +249,13 @@ namespace ps
          */
         virtual void onEvent(const Event &event) = 0;
 
+        /**
+         * Handle an event that the subscriber may take the data out of. Subscribers that keep
+         * events should override this, by default it calls the const version.
+         * @param event The event to handle
+         */
+        virtual void onEvent(Event &&event);
+
     private:
         using PublisherSet = std::unordered_set<Publisher *>;
         using PublisherMap = std::map<EventType, PublisherSet>;
@@ -186,25 +263,42 @@ namespace ps
     };
 
     /**
-     * Threadsafe event queue using the pubsub pattern.
+     * Threadsafe event queue using the pubsub pattern. Any thread can push events, only one thread
+     * (the UI thread) may take them out.
+     *
+     * Events go into a lock-free ring buffer. If the ring is ever full, events spill into a mutex
+     * protected overflow list instead, so no event is lost and producers never wait on the consumer.
+     * The overflow is used until the consumer has emptied it, which keeps the events in order.
      */
     class EventQueue : public ps::ISubscriber
     {
     public:
+        /**
+         * @param capacity Number of events the lock-free ring buffer can hold
+         */
+        explicit EventQueue(size_t capacity = 4096);
+
         /**
          * Should not normally be called manually, this is the function that a ps::Publisher
          * will invoke when emitting an event.
          */
         void onEvent(const ps::Event &event) override;
+        void onEvent(ps::Event &&event) override;
 
         /**
          * Push an event into the queue. Threadsafe.
          * @param event the event to queue
          */
-        void pushEvent(const ps::Event &event);
+        void pushEvent(ps::Event &&event);
 
         /**
-         * Pop the next event from the queue and return it.
+         * Move all queued events to the end of `events`. Only call from the consuming thread.
+         * @returns the number of events that were moved
+         */
+        size_t drainInto(std::vector<ps::Event> &events);
+
+        /**
+         * Pop the next event from the queue and return it. Only call from the consuming thread.
          */
         ps::Event popNext();
 
@@ -214,12 +308,17 @@ namespace ps
         bool empty() const;
 
         /**
-         * Get current size.
+         * Get current size. Approximate while other threads are pushing.
          */
         size_t size() const;
 
     private:
-        std::queue<ps::Event> queue;
-        mutable std::mutex lock;
+        // Moves the overflow list to the end of `events` and switches producers back to the ring.
+        void drainOverflowInto(std::vector<ps::Event> &events);
+
+        MPSCQueue<ps::Event> ring;
+        std::deque<ps::Event> overflow;
+        std::atomic<bool> isOverflowing = false;
+        mutable std::mutex overflowLock;
     };
 }; // namespace pubsub
\ No newline at end of file
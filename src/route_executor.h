@@ -0,0 +1,175 @@
+#pragma once
+
+#include <deque>
+#include <exception>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "cancellation_token.h"
+
+/**
+ * Runs route searches on a fixed pool of worker threads.
+ *
+ * Every job belongs to a client (for example the nav box), and a client only ever cares about its
+ * newest route. Submitting a job cancels the client's previous job, whether it is still waiting in
+ * the queue or already running, so a user who resubmits quickly does not pile up searches that all
+ * race to report their result. Queued jobs that were cancelled are dropped without running.
+ */
+class RouteExecutor
+{
+public:
+    using Job = std::function<void(const CancellationToken &)>;
+    using FailureHandler = std::function<void(const std::string &client, const std::string &error)>;
+
+    RouteExecutor() = default;
+    RouteExecutor(const RouteExecutor &) = delete;
+    RouteExecutor &operator=(const RouteExecutor &) = delete;
+
+    ~RouteExecutor()
+    {
+        stop();
+    }
+
+    /**
+     * Starts the worker threads.
+     *
+     * @param threadCount Number of searches that can run at the same time
+     * @param maxQueued Number of jobs that can wait for a free worker before `submit` rejects more
+     * @param onJobFailed Called on the worker thread when a job that was not cancelled throws, the
+     * worker then goes on with the next job
+     */
+    void start(int threadCount, int maxQueued = 64, FailureHandler onJobFailed = nullptr)
+    {
+        maxQueuedJobs = maxQueued;
+        this->onJobFailed = std::move(onJobFailed);
+        for (int i = 0; i < std::max(1, threadCount); ++i)
+            workers.emplace_back([this]()
+                                 { runWorker(); });
+    }
+
+    /**
+     * Cancels all jobs and waits for the workers to finish the ones they are running.
+     */
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isStopping = true;
+            for (auto &[client, token] : latestTokens)
+                token.cancel();
+            queuedJobs.clear();
+        }
+        jobAvailable.notify_all();
+
+        for (std::thread &worker : workers)
+            worker.join();
+        workers.clear();
+    }
+
+    /**
+     * Queues a job for the client, cancelling the client's previous job.
+     *
+     * @param client Identifies who the job is for, only the newest job of a client is kept
+     * @param job Called on a worker thread with the job's cancellation token, it should check the
+     * token while it runs and not report a result once it is cancelled
+     * @return The job's token, or a cancelled token if the queue is full
+     */
+    CancellationToken submit(std::string client, Job job)
+    {
+        CancellationToken token;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            auto previous = latestTokens.find(client);
+            if (previous != latestTokens.end())
+                previous->second.cancel();
+
+            // cancelled jobs are dropped here rather than when a worker gets to them, so they do not count against the limit
+            queuedJobs.erase(std::remove_if(queuedJobs.begin(), queuedJobs.end(), [](const QueuedJob &queued)
+                                            { return queued.token.isCancelled(); }),
+                             queuedJobs.end());
+            if (isStopping || (int)queuedJobs.size() >= maxQueuedJobs)
+            {
+                token.cancel();
+                return token;
+            }
+
+            latestTokens[client] = token;
+            queuedJobs.push_back(QueuedJob{std::move(job), token, std::move(client)});
+        }
+        jobAvailable.notify_one();
+        return token;
+    }
+
+    /**
+     * Cancels the client's newest job, if it has one.
+     */
+    void cancel(std::string client)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto latest = latestTokens.find(client);
+        if (latest != latestTokens.end())
+            latest->second.cancel();
+    }
+
+private:
+    struct QueuedJob
+    {
+        Job job;
+        CancellationToken token;
+        std::string client;
+    };
+
+    void runWorker()
+    {
+        while (true)
+        {
+            QueuedJob next;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobAvailable.wait(lock, [this]()
+                                  { return isStopping || !queuedJobs.empty(); });
+                if (isStopping)
+                    return;
+
+                next = std::move(queuedJobs.front());
+                queuedJobs.pop_front();
+            }
+
+            if (next.token.isCancelled())
+                continue;
+
+            // an exception that left the thread would end the program
+            std::string error;
+            try
+            {
+                next.job(next.token);
+            }
+            catch (const std::exception &exception)
+            {
+                error = exception.what();
+            }
+            catch (...)
+            {
+                error = "unknown error";
+            }
+            if (!error.empty() && onJobFailed && !next.token.isCancelled())
+                onJobFailed(next.client, error);
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::deque<QueuedJob> queuedJobs;
+    std::unordered_map<std::string, CancellationToken> latestTokens;
+    std::vector<std::thread> workers;
+    int maxQueuedJobs = 64;
+    FailureHandler onJobFailed;
+    bool isStopping = false;
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include <string>
+
+#include "edge.h"
+
+// What a route minimises. The graph has a weight column for every profile, see MapGraph::getEdgeWeights
+enum class RoutingProfile
+{
+    Distance, // meters
+    Car,      // milliseconds of driving
+    Bike,     // milliseconds of cycling
+    Foot      // milliseconds of walking
+};
+
+constexpr int routingProfileCount = 4;
+
+// The weight of an edge that the profile may not use, searches skip these edges
+constexpr int forbiddenWeight = std::numeric_limits<int>::max();
+
+// Short names of the profiles, as used on the command line of the tools
+static const char *const routingProfileStrings[] = {"distance", "car", "bike", "foot"};
+
+inline std::string routingProfileToString(RoutingProfile profile)
+{
+    return routingProfileStrings[(int)profile];
+}
+
+/**
+ * Finds the profile with the given short name.
+ *
+ * @param name One of the names in `routingProfileStrings`
+ * @param profile Set to the profile if the name is known
+ * @return true if the name is known
+ */
+inline bool parseRoutingProfile(const std::string &name, RoutingProfile &profile)
+{
+    for (int i = 0; i < routingProfileCount; ++i)
+    {
+        if (name == routingProfileStrings[i])
+        {
+            profile = (RoutingProfile)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Typical speed in km/h on a path of the given descriptor, 0 if the profile may not use it. Car
+ * paths are described by road class, bike paths by whether there is a lane or track and foot paths
+ * only by whether walking is allowed.
+ */
+inline int profileSpeed(RoutingProfile profile, PathDescriptor path)
+{
+    if (path == PathDescriptor::Forbidden)
+        return 0;
+
+    switch (profile)
+    {
+    case RoutingProfile::Car:
+        switch (path)
+        {
+        case PathDescriptor::Motorway:
+            return 110;
+        case PathDescriptor::Trunk:
+            return 90;
+        case PathDescriptor::Primary:
+            return 70;
+        case PathDescriptor::Secondary:
+            return 60;
+        case PathDescriptor::Tertiary:
+            return 50;
+        case PathDescriptor::Residential:
+            return 30;
+        default:
+            return 20;
+        }
+    case RoutingProfile::Bike:
+        return path == PathDescriptor::Track || path == PathDescriptor::Lane ? 18 : 15;
+    case RoutingProfile::Foot:
+        return 5;
+    default:
+        return 0;
+    }
+}
+
+// The highest speed of profileSpeed for the profile
+inline int maxProfileSpeed(RoutingProfile profile)
+{
+    switch (profile)
+    {
+    case RoutingProfile::Car:
+        return 110;
+    case RoutingProfile::Bike:
+        return 18;
+    default:
+        return 5;
+    }
+}
+
+/**
+ * The weight of an edge for a profile, from its length in meters and the descriptor of the path
+ * in the driven direction. Travel times are rounded up so that they are never below the length
+ * times profileCostPerMeter, which keeps the A* heuristics admissible.
+ */
+inline int profileWeight(RoutingProfile profile, int meters, PathDescriptor path)
+{
+    if (path == PathDescriptor::Forbidden)
+        return forbiddenWeight;
+    if (profile == RoutingProfile::Distance)
+        return meters;
+
+    int speed = profileSpeed(profile, path);
+    if (speed == 0)
+        return forbiddenWeight;
+    return (int)std::ceil(meters * 3600.0 / speed);
+}
+
+// Lower bound of the weight per meter of road, for turning straight line distances into A* heuristics.
+inline double profileCostPerMeter(RoutingProfile profile)
+{
+    if (profile == RoutingProfile::Distance)
+        return 1;
+    return 3600.0 / maxProfileSpeed(profile);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <utility>
+#include <functional>
+
+#include "pubsub.h"
+
+/**
+ * Collects the coordinates of the nodes that a search settles and hands them out in batches, so
+ * that an animated search publishes one event per few hundred nodes instead of one per node.
+ *
+ * A batch is published once it holds at least `batchSize` nodes and at least `minInterval` has
+ * passed since the previous one. While the interval has not passed the batch keeps growing, so
+ * no nodes are lost, only the number of events is bounded. The clock is only read when the batch
+ * reaches another multiple of `batchSize`, which keeps the cost per node to a vector push.
+ */
+class SearchProgress
+{
+public:
+    using Publish = std::function<void(ps::Event &&)>;
+
+    static constexpr size_t batchSize = 512;
+    static constexpr std::chrono::milliseconds minInterval{16}; // about one frame
+
+    /**
+     * @param enabled When false every call is a no-op, for searches that are not animated
+     * @param publish Called with each SearchProgress event
+     */
+    SearchProgress(bool enabled, Publish publish) : enabled(enabled), publish(std::move(publish)) {}
+
+    SearchProgress(const SearchProgress &) = delete;
+    SearchProgress &operator=(const SearchProgress &) = delete;
+
+    // The nodes that are still buffered are published when the search ends.
+    ~SearchProgress()
+    {
+        flush();
+    }
+
+    void add(double offsetLon, double offsetLat)
+    {
+        if (!enabled)
+            return;
+
+        points.emplace_back(offsetLon, offsetLat);
+        if (points.size() % batchSize == 0 && std::chrono::steady_clock::now() - lastPublished >= minInterval)
+            flush();
+    }
+
+    // Publishes the buffered nodes right away.
+    void flush()
+    {
+        if (points.empty())
+            return;
+
+        ps::Event event(ps::EventType::SearchProgress);
+        event.data = ps::Data::NodeBatch(std::move(points));
+        publish(std::move(event));
+
+        points = std::vector<ps::Data::Vector2>();
+        points.reserve(batchSize);
+        lastPublished = std::chrono::steady_clock::now();
+    }
+
+    // Forgets the buffered nodes, for a search that was cancelled.
+    void discard()
+    {
+        points.clear();
+    }
+
+private:
+    bool enabled;
+    Publish publish;
+    std::vector<ps::Data::Vector2> points;
+    std::chrono::steady_clock::time_point lastPublished = std::chrono::steady_clock::now();
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+
+#include "graph.h"
+
+/**
+ * Per node labels of one graph search (distance, parent edge and whether the node is settled).
+ *
+ * Instead of refilling the arrays before every search, each label is stamped with the generation
+ * of the search that wrote it and labels with an older stamp read as untouched. Starting a new
+ * search only bumps the generation, so a short query only pays for the nodes it actually touches.
+ */
+class SearchLabels
+{
+public:
+    static constexpr long long int unreachable = 9999999999999;
+
+    /**
+     * Forgets all labels of the previous search.
+     *
+     * @param nodeCount Number of nodes in the graph that will be searched
+     */
+    void reset(int nodeCount)
+    {
+        if ((int)touchedStamps.size() != nodeCount)
+        {
+            touchedStamps.assign(nodeCount, 0);
+            settledStamps.assign(nodeCount, 0);
+            distances.resize(nodeCount);
+            parentEdges.resize(nodeCount);
+            generation = 0;
+        }
+
+        // On overflow the old stamps could match again, so they are cleared once every 4 billion searches.
+        if (++generation == 0)
+        {
+            std::fill(touchedStamps.begin(), touchedStamps.end(), 0);
+            std::fill(settledStamps.begin(), settledStamps.end(), 0);
+            generation = 1;
+        }
+    }
+
+    long long int getDistance(GraphNodeIndex nodeIndex) const
+    {
+        return touchedStamps[nodeIndex] == generation ? distances[nodeIndex] : unreachable;
+    }
+
+    // Edge that the shortest path found so far reached the node through, -1 for the search origin.
+    GraphEdgeIndex getParentEdge(GraphNodeIndex nodeIndex) const
+    {
+        return touchedStamps[nodeIndex] == generation ? parentEdges[nodeIndex] : -1;
+    }
+
+    void setDistance(GraphNodeIndex nodeIndex, long long int distance, GraphEdgeIndex parentEdge)
+    {
+        touchedStamps[nodeIndex] = generation;
+        distances[nodeIndex] = distance;
+        parentEdges[nodeIndex] = parentEdge;
+    }
+
+    bool isSettled(GraphNodeIndex nodeIndex) const
+    {
+        return settledStamps[nodeIndex] == generation;
+    }
+
+    void settle(GraphNodeIndex nodeIndex)
+    {
+        settledStamps[nodeIndex] = generation;
+    }
+
+private:
+    std::vector<unsigned int> touchedStamps;
+    std::vector<unsigned int> settledStamps;
+    std::vector<long long int> distances;
+    std::vector<GraphEdgeIndex> parentEdges;
+    unsigned int generation = 0;
+};
+
+// Work done by one search, read by the benchmarks
+struct SearchStats
+{
+    long long int settledNodes = 0;
+    long long int relaxedEdges = 0;
+    long long int heapPushes = 0;
+    long long int heapPops = 0;
+};
+
+/**
+ * Min priority queue of (key, node) pairs that keeps its memory between searches.
+ */
+class SearchQueue
+{
+public:
+    using Item = std::pair<double, GraphNodeIndex>;
+
+    void clear()
+    {
+        items.clear();
+    }
+
+    bool empty() const
+    {
+        return items.empty();
+    }
+
+    const Item &top() const
+    {
+        return items.front();
+    }
+
+    void push(double key, GraphNodeIndex nodeIndex)
+    {
+        items.emplace_back(key, nodeIndex);
+        std::push_heap(items.begin(), items.end(), std::greater<Item>());
+    }
+
+    void pop()
+    {
+        std::pop_heap(items.begin(), items.end(), std::greater<Item>());
+        items.pop_back();
+    }
+
+private:
+    std::vector<Item> items;
+};
+
+/**
+ * Everything a shortest path search needs besides the graph. A workspace is owned by one thread
+ * and reused for all of its queries, index 0 is used by forward searches and index 1 by the
+ * backward half of bidirectional searches.
+ */
+struct SearchWorkspace
+{
+    SearchLabels labels[2];
+    SearchQueue queues[2];
+    SearchStats stats; // counters of the last search that ran on this thread
+
+    /**
+     * Prepares the workspace for a new search on a graph with `nodeCount` nodes.
+     */
+    void reset(int nodeCount)
+    {
+        for (int direction = 0; direction < 2; ++direction)
+        {
+            labels[direction].reset(nodeCount);
+            queues[direction].clear();
+        }
+        stats = SearchStats();
+    }
+
+    // The workspace of the calling thread.
+    static SearchWorkspace &forThisThread()
+    {
+        static thread_local SearchWorkspace workspace;
+        return workspace;
+    }
+};
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <numeric>
+#include <utility>
+#include <algorithm>
+
+#include "mapped_file.h"
+
+/**
+ * Static 2-d tree over points, for nearest neighbour and radius queries.
+ *
+ * The tree is implicit: the points are stored in tree order, where the points of a subtree are one
+ * range of the arrays and the middle point of the range is the subtree's root. Roots split their
+ * range on x at even depths and on y at odd depths. So the tree is only the coordinates and ids of
+ * the points in that order, and it is saved and memory mapped like the other graph columns.
+ */
+class KdTree
+{
+public:
+    /**
+     * Builds the tree over the points (x[i], y[i]), the id of a point is its index i.
+     */
+    void build(const std::vector<double> &x, const std::vector<double> &y)
+    {
+        std::vector<int> order(x.size());
+        std::iota(order.begin(), order.end(), 0);
+        buildRange(order, x, y, 0, order.size(), true);
+
+        std::vector<double> treeX(order.size()), treeY(order.size());
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            treeX[i] = x[order[i]];
+            treeY[i] = y[order[i]];
+        }
+        pointX.assign(std::move(treeX));
+        pointY.assign(std::move(treeY));
+        pointIds.assign(std::move(order));
+    }
+
+    size_t size() const
+    {
+        return pointIds.size();
+    }
+
+    /**
+     * @return The id of the point nearest to (x, y), or -1 if the tree is empty
+     */
+    int nearest(double x, double y) const
+    {
+        int nearestId = -1;
+        double bound = std::numeric_limits<double>::infinity();
+        search(0, size(), true, x, y, bound, [&](double squaredDistance, int id)
+               {
+            if (squaredDistance < bound || (squaredDistance == bound && id < nearestId))
+            {
+                bound = squaredDistance;
+                nearestId = id;
+            } });
+        return nearestId;
+    }
+
+    /**
+     * Finds the `count` points nearest to (x, y).
+     *
+     * @param points Replaced with (distance, id) of the points, nearest first. Keeps its capacity.
+     */
+    void kNearest(double x, double y, int count, std::vector<std::pair<double, int>> &points) const
+    {
+        points.clear();
+        if (count <= 0)
+            return;
+
+        // a max heap of the nearest points so far, its top is the farthest of them
+        double bound = std::numeric_limits<double>::infinity();
+        search(0, size(), true, x, y, bound, [&](double squaredDistance, int id)
+               {
+            if ((int)points.size() == count)
+            {
+                std::pop_heap(points.begin(), points.end());
+                points.pop_back();
+            }
+            points.emplace_back(squaredDistance, id);
+            std::push_heap(points.begin(), points.end());
+            if ((int)points.size() == count)
+                bound = points.front().first; });
+
+        std::sort_heap(points.begin(), points.end());
+        for (auto &point : points)
+            point.first = std::sqrt(point.first);
+    }
+
+    /**
+     * Finds the points at most `radius` away from (x, y).
+     *
+     * @param ids Replaced with the ids of the points, in no particular order. Keeps its capacity.
+     */
+    void withinRadius(double x, double y, double radius, std::vector<int> &ids) const
+    {
+        ids.clear();
+        double bound = radius * radius;
+        search(0, size(), true, x, y, bound, [&](double, int id)
+               { ids.push_back(id); });
+    }
+
+    // Calls visit(column, element count) for every column, in the order they are stored in a snapshot.
+    template <typename Visit>
+    void forEachColumn(size_t count, Visit visit)
+    {
+        visit(pointX, count);
+        visit(pointY, count);
+        visit(pointIds, count);
+    }
+
+private:
+    static void buildRange(std::vector<int> &order, const std::vector<double> &x, const std::vector<double> &y, size_t begin, size_t end, bool splitOnX)
+    {
+        if (end - begin < 2)
+            return;
+
+        // the median goes to the middle, the points before it are not greater on the split axis
+        size_t middle = begin + (end - begin) / 2;
+        const std::vector<double> &axis = splitOnX ? x : y;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](int a, int b)
+                         { return axis[a] < axis[b]; });
+
+        buildRange(order, x, y, begin, middle, !splitOnX);
+        buildRange(order, x, y, middle + 1, end, !splitOnX);
+    }
+
+    /**
+     * Calls offer(squared distance, id) for every point of the subtree in [begin, end) whose squared
+     * distance to (x, y) is at most `bound`. The offer may lower the bound to prune the search.
+     */
+    template <typename Offer>
+    void search(size_t begin, size_t end, bool splitOnX, double x, double y, double &bound, Offer &&offer) const
+    {
+        while (begin < end)
+        {
+            size_t middle = begin + (end - begin) / 2;
+            double dx = pointX[middle] - x, dy = pointY[middle] - y;
+            double squaredDistance = dx * dx + dy * dy;
+            if (squaredDistance <= bound)
+                offer(squaredDistance, pointIds[middle]);
+
+            // search the side of the split the point is on first, then the other side only if the
+            // splitting line is within the bound
+            double split = splitOnX ? -dx : -dy;
+            if (split < 0)
+            {
+                search(begin, middle, !splitOnX, x, y, bound, offer);
+                begin = middle + 1;
+            }
+            else
+            {
+                search(middle + 1, end, !splitOnX, x, y, bound, offer);
+                end = middle;
+            }
+            if (split * split > bound)
+                return;
+            splitOnX = !splitOnX;
+        }
+    }
+
+    Column<double> pointX;
+    Column<double> pointY;
+    Column<int> pointIds;
+};
+
+/**
+ * Uniform grid over line segments, for finding the segment nearest to a point.
+ *
+ * Every cell lists the segments whose bounding box overlaps it, as offsets into one index array
+ * (the same layout as the graph's chunk roads). A query visits the cells in square rings around
+ * the cell of the point and stops once the nearest segment found is closer than every cell left.
+ */
+class SegmentGrid
+{
+public:
+    /**
+     * Builds the grid over the segments from (x[i], y[i]) to (x[i + 1], y[i + 1]), for every i in
+     * `segments`. The id of a segment is its i.
+     */
+    void build(const std::vector<float> &x, const std::vector<float> &y, const std::vector<int> &segments)
+    {
+        double left = std::numeric_limits<double>::infinity(), top = left;
+        double right = -left, bottom = -left;
+        for (int i : segments)
+        {
+            left = std::min({left, (double)x[i], (double)x[i + 1]});
+            right = std::max({right, (double)x[i], (double)x[i + 1]});
+            top = std::min({top, (double)y[i], (double)y[i + 1]});
+            bottom = std::max({bottom, (double)y[i], (double)y[i + 1]});
+        }
+        if (segments.empty())
+            left = top = right = bottom = 0;
+
+        // about as many cells as segments, which keeps the cells of a road network at a few segments each
+        double cellSize = std::max(std::sqrt((right - left) * (bottom - top) / std::max<size_t>(segments.size(), 1)), 1e-7);
+        int cols = int((right - left) / cellSize) + 1;
+        int rows = int((bottom - top) / cellSize) + 1;
+
+        // calls visit(cell) for every cell that the bounding box of a segment overlaps
+        auto forEachCell = [&](int i, auto visit)
+        {
+            int leftCol = int((std::min(x[i], x[i + 1]) - left) / cellSize), rightCol = int((std::max(x[i], x[i + 1]) - left) / cellSize);
+            int topRow = int((std::min(y[i], y[i + 1]) - top) / cellSize), bottomRow = int((std::max(y[i], y[i + 1]) - top) / cellSize);
+            for (int row = std::max(topRow, 0); row <= std::min(bottomRow, rows - 1); ++row)
+            {
+                for (int col = std::max(leftCol, 0); col <= std::min(rightCol, cols - 1); ++col)
+                    visit(row * cols + col);
+            }
+        };
+
+        std::vector<int> first((size_t)rows * cols + 1, 0);
+        for (int i : segments)
+            forEachCell(i, [&](int cell)
+                        { first[cell + 1]++; });
+        for (size_t cell = 0; cell + 1 < first.size(); ++cell)
+            first[cell + 1] += first[cell];
+
+        std::vector<int> ids(first.back());
+        std::vector<int> next(first.begin(), first.end() - 1);
+        for (int i : segments)
+            forEachCell(i, [&](int cell)
+                        { ids[next[cell]++] = i; });
+
+        shape.assign({left, top, cellSize, (double)rows, (double)cols});
+        firstCellSegment.assign(std::move(first));
+        segmentIds.assign(std::move(ids));
+    }
+
+    size_t getCellCount() const
+    {
+        return firstCellSegment.size() ? firstCellSegment.size() - 1 : 0;
+    }
+
+    size_t getEntryCount() const
+    {
+        return segmentIds.size();
+    }
+
+    /**
+     * Finds the segment nearest to (x, y).
+     *
+     * @param squaredDistance Returns the squared distance from (x, y) to the segment with the given id
+     * @return The id of the nearest segment, the lower id on a tie, or -1 if the grid is empty
+     */
+    template <typename SquaredDistance>
+    int nearest(double x, double y, SquaredDistance squaredDistance) const
+    {
+        if (segmentIds.size() == 0)
+            return -1;
+
+        double left = shape[0], top = shape[1], cellSize = shape[2];
+        int rows = shape[3], cols = shape[4];
+        int centerCol = std::clamp(int(std::floor((x - left) / cellSize)), 0, cols - 1);
+        int centerRow = std::clamp(int(std::floor((y - top) / cellSize)), 0, rows - 1);
+
+        int nearestId = -1;
+        double bound = std::numeric_limits<double>::infinity();
+        auto visitCell = [&](int row, int col)
+        {
+            if (row < 0 || row >= rows || col < 0 || col >= cols)
+                return;
+            int cell = row * cols + col;
+            for (int entry = firstCellSegment[cell]; entry < firstCellSegment[cell + 1]; ++entry)
+            {
+                int id = segmentIds[entry];
+                double distance = squaredDistance(id);
+                if (distance < bound || (distance == bound && id < nearestId))
+                {
+                    bound = distance;
+                    nearestId = id;
+                }
+            }
+        };
+
+        for (int ring = 0;; ++ring)
+        {
+            int topRow = centerRow - ring, bottomRow = centerRow + ring;
+            int leftCol = centerCol - ring, rightCol = centerCol + ring;
+            for (int col = leftCol; col <= rightCol; ++col)
+            {
+                visitCell(topRow, col);
+                if (ring > 0)
+                    visitCell(bottomRow, col);
+            }
+            for (int row = topRow + 1; row < bottomRow; ++row)
+            {
+                visitCell(row, leftCol);
+                visitCell(row, rightCol);
+            }
+
+            if (topRow <= 0 && leftCol <= 0 && bottomRow >= rows - 1 && rightCol >= cols - 1)
+                break;
+
+            // every cell outside of the rings is at least this far away, for a point inside of them
+            double outside = std::min({x - (left + leftCol * cellSize), left + (rightCol + 1) * cellSize - x,
+                                       y - (top + topRow * cellSize), top + (bottomRow + 1) * cellSize - y});
+            if (outside > 0 && outside * outside > bound)
+                break;
+        }
+        return nearestId;
+    }
+
+    // Calls visit(column, element count) for every column, in the order they are stored in a snapshot.
+    template <typename Visit>
+    void forEachColumn(size_t cellCount, size_t entryCount, Visit visit)
+    {
+        visit(shape, 5);
+        visit(firstCellSegment, cellCount + 1);
+        visit(segmentIds, entryCount);
+    }
+
+private:
+    Column<double> shape; // left, top, cell size, rows and columns of the grid
+    Column<int> firstCellSegment; // cell count + 1 offsets, cell (row, col) has index row * columns + col
+    Column<int> segmentIds;
+};
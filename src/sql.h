@@ -1,13 +1,64 @@
 #pragma once
 
+#include <mutex>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <filesystem>
+#include <unordered_set>
+
 #include <sqlite_orm/sqlite_orm.h>
 
+#include "geometry_codec.h"
+
 namespace sql
 {
 
+    inline uint64_t spreadBits(unsigned int value)
+    {
+        uint64_t bits = value & 0xffff;
+        bits = (bits | (bits << 8)) & 0x00ff00ff;
+        bits = (bits | (bits << 4)) & 0x0f0f0f0f;
+        bits = (bits | (bits << 2)) & 0x33333333;
+        bits = (bits | (bits << 1)) & 0x55555555;
+        return bits;
+    }
+
+    inline unsigned int compactBits(uint64_t bits)
+    {
+        bits &= 0x55555555;
+        bits = (bits | (bits >> 1)) & 0x33333333;
+        bits = (bits | (bits >> 2)) & 0x0f0f0f0f;
+        bits = (bits | (bits >> 4)) & 0x00ff00ff;
+        bits = (bits | (bits >> 8)) & 0x0000ffff;
+        return bits;
+    }
+
+    /**
+     * Key of the chunk at (row, col) in the `chunk_id` columns: the bits of the row and column
+     * interleaved (a Morton code). Nodes and edges are stored sorted by it, so the rows of a chunk are
+     * next to each other in the file, and chunks that are close on the map are mostly close in the
+     * file too. Rows and columns must be below 2^16.
+     */
+    inline long long int chunkKey(int row, int col)
+    {
+        return (long long int)(spreadBits(col) | (spreadBits(row) << 1));
+    }
+
+    inline int chunkKeyRow(long long int key)
+    {
+        return compactBits(uint64_t(key) >> 1);
+    }
+
+    inline int chunkKeyCol(long long int key)
+    {
+        return compactBits(uint64_t(key));
+    }
+
     struct Chunk
     {
-        std::string id;
+        long long int id; // chunkKey(row, col)
         int row;
         int col;
         float offsetLatTop;
@@ -20,7 +71,7 @@ namespace sql
     {
         long long int id;
         long long int osmId;
-        std::string chunkId;
+        long long int chunkId;
         long long int sourceNodeId;
         long long int targetNodeId;
         double pathLengthMeters;
@@ -30,22 +81,117 @@ namespace sql
         int pathBikeFwd;
         int pathBikeBwd;
         int pathTrain;
-        std::string pathOffsetPoints;
+        std::string pathOffsetPoints;  // "lon lat,lon lat,...", empty once a database only keeps the blobs
+        std::vector<char> pathGeometry; // the same points encoded by geocodec::encode
     };
 
     struct Node
     {
         long long int id;
-        std::string chunkId;
+        long long int chunkId;
         double offsetLon;
         double offsetLat;
         int numOutEdges;
         int numInEdges;
     };
 
-    inline auto loadStorage(std::string dbPath)
+    /**
+     * Adds the binary `path_geometry` column to a database that was written before it existed, and
+     * fills it from the text points of every edge that has no blob yet.
+     *
+     * @return the number of edges that were encoded, 0 if the database was already up to date
+     */
+    inline long long int addEdgeGeometry(const std::string &dbPath)
+    {
+        sqlite3 *db;
+        if (sqlite3_open_v2(dbPath.c_str(), &db, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK)
+        {
+            sqlite3_close(db);
+            return 0;
+        }
+
+        // returns true if the query has at least one row
+        auto hasRow = [db](const char *query)
+        {
+            sqlite3_stmt *statement;
+            bool result = sqlite3_prepare_v2(db, query, -1, &statement, nullptr) == SQLITE_OK && sqlite3_step(statement) == SQLITE_ROW;
+            sqlite3_finalize(statement);
+            return result;
+        };
+
+        long long int encoded = 0;
+        if (!hasRow("SELECT 1 FROM pragma_table_info('edge') WHERE name = 'path_geometry'"))
+            sqlite3_exec(db, "ALTER TABLE edge ADD COLUMN path_geometry BLOB", nullptr, nullptr, nullptr);
+
+        if (hasRow("SELECT 1 FROM edge WHERE path_geometry IS NULL AND path_offset_points != '' LIMIT 1"))
+        {
+            std::cout << "encoding the edge points of " << dbPath << ", this only happens once" << std::endl;
+
+            sqlite3_stmt *select, *update;
+            sqlite3_prepare_v2(db, "SELECT id, path_offset_points FROM edge WHERE path_geometry IS NULL AND path_offset_points != '' AND id > ? ORDER BY id LIMIT 10000", -1, &select, nullptr);
+            sqlite3_prepare_v2(db, "UPDATE edge SET path_geometry = ? WHERE id = ?", -1, &update, nullptr);
+            sqlite3_exec(db, "BEGIN", nullptr, nullptr, nullptr);
+
+            // the edges are encoded in batches so that the rows are not updated while the select is reading them
+            std::vector<std::pair<long long int, std::vector<char>>> batch;
+            std::vector<double> lons, lats;
+            long long int lastId = -1;
+            do
+            {
+                batch.clear();
+                sqlite3_bind_int64(select, 1, lastId);
+                while (sqlite3_step(select) == SQLITE_ROW)
+                {
+                    lastId = sqlite3_column_int64(select, 0);
+                    const char *text = (const char *)sqlite3_column_text(select, 1);
+
+                    lons.clear();
+                    lats.clear();
+                    geocodec::parseText(text ? text : "", [&](double lon, double lat)
+                                        { lons.push_back(lon); lats.push_back(lat); });
+                    batch.emplace_back(lastId, std::vector<char>());
+                    geocodec::encode(lons, lats, batch.back().second);
+                }
+                sqlite3_reset(select);
+
+                for (auto &[id, blob] : batch)
+                {
+                    sqlite3_bind_blob(update, 1, blob.data(), blob.size(), SQLITE_STATIC);
+                    sqlite3_bind_int64(update, 2, id);
+                    sqlite3_step(update);
+                    sqlite3_reset(update);
+                }
+                encoded += batch.size();
+            } while (!batch.empty());
+
+            sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr);
+            sqlite3_finalize(select);
+            sqlite3_finalize(update);
+        }
+
+        sqlite3_close(db);
+        return encoded;
+    }
+
+    /**
+     * Empties the text points of every edge that has a blob and compacts the database file.
+     */
+    inline void dropEdgeText(const std::string &dbPath)
+    {
+        sqlite3 *db;
+        if (sqlite3_open_v2(dbPath.c_str(), &db, SQLITE_OPEN_READWRITE, nullptr) == SQLITE_OK)
+        {
+            sqlite3_exec(db, "UPDATE edge SET path_offset_points = '' WHERE path_geometry IS NOT NULL", nullptr, nullptr, nullptr);
+            sqlite3_exec(db, "VACUUM", nullptr, nullptr, nullptr);
+        }
+        sqlite3_close(db);
+    }
+
+    // The storage of the tables as they are now, see loadStorage.
+    inline auto makeStorage(std::string dbPath)
     {
         using namespace sqlite_orm;
+
 #define mt make_table
 #define mc make_column
 #define fk foreign_key
@@ -55,11 +201,11 @@ namespace sql
             dbPath,
             mi("idx_node_offset_lon", &Node::offsetLon),
             mi("idx_node_offset_lat", &Node::offsetLat),
-            mi("idx_node_chunk_id", &Node::chunkId),
+            make_unique_index("idx_node_id", &Node::id),
 
             mi("idx_edge_source_node_id", &Edge::sourceNodeId),
             mi("idx_edge_target_node_id", &Edge::targetNodeId),
-            mi("idx_edge_chunk_id", &Edge::chunkId),
+            make_unique_index("idx_edge_id", &Edge::id),
 
             mi("idx_chunk_row", &Chunk::row),
             mi("idx_chunk_col", &Chunk::col),
@@ -75,8 +221,9 @@ namespace sql
                mc("num_nodes", &Chunk::numNodes),
                mc("num_edges", &Chunk::numEdges)),
 
+            // nodes and edges are clustered on (chunk, id), so loading a chunk reads one range of the table
             mt("edge",
-               mc("id", &Edge::id, primary_key().autoincrement()),
+               mc("id", &Edge::id),
                mc("osm_id", &Edge::osmId),
                mc("chunk_id", &Edge::chunkId),
                mc("source_node_id", &Edge::sourceNodeId),
@@ -89,23 +236,131 @@ namespace sql
                mc("path_bike_bwd", &Edge::pathBikeBwd),
                mc("path_train", &Edge::pathTrain),
                mc("path_offset_points", &Edge::pathOffsetPoints),
+               mc("path_geometry", &Edge::pathGeometry),
+               primary_key(&Edge::chunkId, &Edge::id),
                fk(&Edge::sourceNodeId).references(&Node::id),
                fk(&Edge::targetNodeId).references(&Node::id),
-               fk(&Edge::chunkId).references(&Chunk::id)),
+               fk(&Edge::chunkId).references(&Chunk::id))
+                .without_rowid(),
 
             mt("node",
-               mc("id", &Node::id, primary_key()),
+               mc("id", &Node::id),
                mc("chunk_id", &Node::chunkId),
                mc("offset_lon", &Node::offsetLon),
                mc("offset_lat", &Node::offsetLat),
                mc("num_out_edges", &Node::numOutEdges),
                mc("num_in_edges", &Node::numInEdges),
-               fk(&Node::chunkId).references(&Chunk::id)));
+               primary_key(&Node::chunkId, &Node::id),
+               fk(&Node::chunkId).references(&Chunk::id))
+                .without_rowid());
+    }
+
+    /**
+     * Moves a database with the old "row,col" text chunk keys over to chunkKey. The tables are
+     * created as they are mapped in makeStorage in a new file next to the database, the rows are
+     * copied into it in key order in one transaction, and the new file is renamed over the old one.
+     * The database is left as it was if any step fails.
+     *
+     * @return true if the database was converted, false if it already used the integer keys or
+     * could not be converted
+     */
+    inline bool migrateChunkKeys(const std::string &dbPath)
+    {
+        sqlite3 *db;
+        if (sqlite3_open_v2(dbPath.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+        {
+            sqlite3_close(db);
+            return false;
+        }
+
+        sqlite3_stmt *statement;
+        bool hasTextKeys = sqlite3_prepare_v2(db, "SELECT 1 FROM chunk WHERE typeof(id) = 'text' LIMIT 1", -1, &statement, nullptr) == SQLITE_OK &&
+                           sqlite3_step(statement) == SQLITE_ROW;
+        sqlite3_finalize(statement);
+        sqlite3_close(db);
+        if (!hasTextKeys)
+            return false;
+        std::cout << "converting the chunk keys of " << dbPath << ", this only happens once" << std::endl;
+
+        std::string convertedPath = dbPath + ".convert";
+        std::error_code fileError;
+        std::filesystem::remove(convertedPath, fileError);
+        makeStorage(convertedPath).sync_schema();
+
+        std::string error;
+        auto execute = [&](const std::string &sqlText)
+        {
+            char *message = nullptr;
+            if (error.empty() && sqlite3_exec(db, sqlText.c_str(), nullptr, nullptr, &message) != SQLITE_OK)
+                error = message ? message : sqlite3_errmsg(db);
+            sqlite3_free(message);
+        };
+
+        auto keyFunction = [](sqlite3_context *context, int, sqlite3_value **values)
+        {
+            sqlite3_result_int64(context, chunkKey(sqlite3_value_int(values[0]), sqlite3_value_int(values[1])));
+        };
+        if (sqlite3_open_v2(convertedPath.c_str(), &db, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK ||
+            sqlite3_create_function(db, "chunk_key", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr, keyFunction, nullptr, nullptr) != SQLITE_OK)
+            error = sqlite3_errmsg(db);
+
+        // the old database is only read, through a second schema of the new one's connection
+        char *attach = sqlite3_mprintf("ATTACH DATABASE %Q AS old", dbPath.c_str());
+        execute(attach);
+        sqlite3_free(attach);
+
+#define TEXT_KEY "chunk_key(CAST(substr(chunk_id, 1, instr(chunk_id, ',') - 1) AS INTEGER), CAST(substr(chunk_id, instr(chunk_id, ',') + 1) AS INTEGER))"
+        execute("BEGIN");
+        execute("INSERT INTO main.chunk (id, row, col, offset_lat_top, offset_lon_left, num_nodes, num_edges) "
+                "SELECT chunk_key(row, col), row, col, offset_lat_top, offset_lon_left, num_nodes, num_edges FROM old.chunk");
+        execute("INSERT INTO main.node (id, chunk_id, offset_lon, offset_lat, num_out_edges, num_in_edges) "
+                "SELECT id, " TEXT_KEY ", offset_lon, offset_lat, num_out_edges, num_in_edges FROM old.node ORDER BY 2, 1");
+        execute("INSERT INTO main.edge (id, osm_id, chunk_id, source_node_id, target_node_id, path_length_meters, path_foot, path_car_fwd, "
+                "path_car_bwd, path_bike_fwd, path_bike_bwd, path_train, path_offset_points, path_geometry) "
+                "SELECT id, osm_id, " TEXT_KEY ", source_node_id, target_node_id, path_length_meters, path_foot, path_car_fwd, "
+                "path_car_bwd, path_bike_fwd, path_bike_bwd, path_train, coalesce(path_offset_points, ''), coalesce(path_geometry, x'') FROM old.edge ORDER BY 3, 1");
+        execute("COMMIT");
+#undef TEXT_KEY
+
+        if (!error.empty() && !sqlite3_get_autocommit(db))
+            sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+        sqlite3_close(db);
+
+        if (error.empty())
+            std::filesystem::rename(convertedPath, dbPath, fileError);
+        if (!error.empty() || fileError)
+        {
+            std::cerr << "could not convert the chunk keys of " << dbPath << ": " << (error.empty() ? fileError.message() : error) << std::endl;
+            std::filesystem::remove(convertedPath, fileError);
+            return false;
+        }
+        return true;
+    }
+
+    // Brings a database written by an older version of the scripts up to date, once per path and process.
+    inline void ensureCurrentSchema(const std::string &dbPath)
+    {
+        static std::mutex mutex;
+        static std::unordered_set<std::string> checkedPaths;
+
+        const std::lock_guard<std::mutex> lock(mutex);
+        if (checkedPaths.insert(dbPath).second)
+        {
+            addEdgeGeometry(dbPath);
+            migrateChunkKeys(dbPath);
+        }
+    }
+
+    inline auto loadStorage(std::string dbPath)
+    {
+        // the tables must match the mapping of makeStorage
+        ensureCurrentSchema(dbPath);
+        return makeStorage(dbPath);
     }
 
     // We need to use decltype here because the type returned by sqlite_orm::make_storage
     // depends on the indices and tables that it contains. Decltype will make a new
     // type that matches what is actually returned by loadStorage so that the type
     // can be used as a member variable of other classes.
-    using Storage = decltype(loadStorage(""));
+    using Storage = decltype(makeStorage(""));
 };
@@ -0,0 +1,124 @@
+// Chunk loading latency benchmark. Moves a square window of chunks across the map and requests
+// every chunk in it the way the viewport does, row by row. It measures how long it takes from a
+// chunk request until the chunk is ready, until the centre of the window is ready and until the
+// whole window is ready. The cache is emptied between steps so that every step loads cold chunks.
+//
+// usage: bench_chunk_loader <db> [--threads 4] [--size 8] [--steps 30] [--row 0] [--col 0] [--focus 1]
+//
+// `--focus 0` does not tell the loader where the centre is, so chunks load in request order.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../chunk_sprite.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::printf("usage: %s <db> [--threads 4] [--size 8] [--steps 30] [--row 0] [--col 0] [--focus 1]\n", argv[0]);
+        return 1;
+    }
+
+    std::string dbPath = argv[1];
+    int threadCount = 4, size = 8, steps = 30, startRow = 0, startCol = 0;
+    bool useFocus = true;
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        std::string option = argv[i];
+        int value = std::atoi(argv[i + 1]);
+        if (option == "--threads")
+            threadCount = std::max(1, value);
+        else if (option == "--size")
+            size = std::max(1, value);
+        else if (option == "--steps")
+            steps = std::max(1, value);
+        else if (option == "--row")
+            startRow = std::max(0, value);
+        else if (option == "--col")
+            startCol = std::max(0, value);
+        else if (option == "--focus")
+            useFocus = value != 0;
+    }
+
+    // the window moves one chunk down and right per step, so each step needs a new row and column
+    auto storage = sql::loadStorage(dbPath);
+    int lastRow = *storage.max(&sql::Chunk::row);
+    int lastCol = *storage.max(&sql::Chunk::col);
+    steps = std::min({steps, lastRow - startRow - size + 2, lastCol - startCol - size + 2});
+    if (steps < 1)
+    {
+        std::printf("the map has %d x %d chunks, too few for a %d chunk window\n", lastRow + 1, lastCol + 1, size);
+        return 1;
+    }
+
+    ChunkLoader loader;
+    loader.start(dbPath, threadCount);
+
+    std::vector<double> centreTimes, windowTimes;
+    for (int step = 0; step < steps; ++step)
+    {
+        int top = startRow + step, left = startCol + step;
+        auto startTime = std::chrono::steady_clock::now();
+        if (useFocus)
+            loader.setFocus(top + size / 2.0, left + size / 2.0, size);
+
+        // poll like the render loop does, but every millisecond instead of every frame
+        bool centreReady = false, windowReady = false;
+        while (!windowReady)
+        {
+            centreReady = true;
+            windowReady = true;
+            for (int row = top; row < top + size; ++row)
+            {
+                for (int col = left; col < left + size; ++col)
+                {
+                    if (loader.get(row, col).has_value())
+                        continue;
+                    windowReady = false;
+                    // the centre is the middle half of the window on both axes
+                    if (std::abs(2 * (row - top) + 1 - size) <= size / 2 && std::abs(2 * (col - left) + 1 - size) <= size / 2)
+                        centreReady = false;
+                }
+            }
+
+            double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+            if (centreReady && centreTimes.size() == (size_t)step)
+                centreTimes.push_back(elapsed);
+            if (windowReady)
+                windowTimes.push_back(elapsed);
+            else
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        for (int row = top; row < top + size; ++row)
+        {
+            for (int col = left; col < left + size; ++col)
+                loader.unCache(row, col);
+        }
+    }
+
+    ChunkLoadStats stats = loader.getStats();
+    auto summary = [](std::vector<double> &times)
+    {
+        std::sort(times.begin(), times.end());
+        double mean = 0;
+        for (double time : times)
+            mean += time;
+        std::printf("mean %.2f ms, median %.2f ms, max %.2f ms\n", mean / times.size(), times[times.size() / 2], times.back());
+    };
+
+    std::printf("%d threads, %dx%d window, %d steps, %d chunks loaded, focus %s\n", threadCount, size, size, steps, stats.loadedChunks, useFocus ? "on" : "off");
+    std::printf("chunk request to ready: mean %.2f ms (%.2f ms queued), max %.2f ms, %d stale requests dropped\n", stats.meanReady(), stats.meanQueueWait(), stats.maxReady, stats.droppedRequests);
+    std::printf("window centre ready: ");
+    summary(centreTimes);
+    std::printf("whole window ready:  ");
+    summary(windowTimes);
+    return 0;
+}
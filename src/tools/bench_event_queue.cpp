@@ -0,0 +1,150 @@
+// Contention benchmark for ps::EventQueue. Several producer threads push events as fast as they can
+// while one consumer thread drains them, the same way the route workers and the UI thread share the
+// queue in the app. The lock-free queue is compared against the mutex queue it replaced.
+//
+// usage: bench_event_queue [--events 1000000] [--producers 1,2,4,8] [--capacity 4096] [--points 0]
+//
+// `--points` attaches a node batch with that many points to every event, 0 sends empty events.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../pubsub.h"
+
+/**
+ * The event queue as it was before the ring buffer: one std::queue behind a mutex that producers
+ * and the consumer both take for every event.
+ */
+class MutexEventQueue
+{
+public:
+    explicit MutexEventQueue(size_t) {}
+
+    void pushEvent(ps::Event &&event)
+    {
+        const std::lock_guard<std::mutex> lock_guard(mutex);
+        events.push(std::move(event));
+    }
+
+    size_t drainInto(std::vector<ps::Event> &out)
+    {
+        // the old App::processEvents read the size, then popped that many events one lock at a time
+        size_t count;
+        {
+            const std::lock_guard<std::mutex> lock_guard(mutex);
+            count = events.size();
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            const std::lock_guard<std::mutex> lock_guard(mutex);
+            out.push_back(std::move(events.front()));
+            events.pop();
+        }
+        return count;
+    }
+
+private:
+    std::queue<ps::Event> events;
+    std::mutex mutex;
+};
+
+struct BenchResult
+{
+    double seconds;
+    size_t drains; // number of drainInto calls that returned at least one event
+};
+
+template <typename Queue>
+BenchResult runBenchmark(int producerCount, long long int eventCount, size_t capacity, int points)
+{
+    Queue queue(capacity);
+    std::atomic<bool> go = false;
+    long long int perProducer = eventCount / producerCount;
+    long long int total = perProducer * producerCount;
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producerCount; ++p)
+    {
+        producers.emplace_back([&]()
+                               {
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            for (long long int i = 0; i < perProducer; ++i)
+            {
+                ps::Event event(ps::EventType::SearchProgress);
+                if (points)
+                    event.data = ps::Data::NodeBatch(std::vector<ps::Data::Vector2>(points, ps::Data::Vector2(0, 0)));
+                queue.pushEvent(std::move(event));
+            } });
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+
+    BenchResult result{0, 0};
+    std::vector<ps::Event> events;
+    long long int received = 0;
+    while (received < total)
+    {
+        events.clear();
+        size_t count = queue.drainInto(events);
+        received += count;
+        if (count)
+            result.drains++;
+        else
+            std::this_thread::yield();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    for (std::thread &producer : producers)
+        producer.join();
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    long long int eventCount = 1000000;
+    std::vector<int> producerCounts = {1, 2, 4, 8};
+    size_t capacity = 4096;
+    int points = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string option = argv[i], value = argv[i + 1];
+        if (option == "--events")
+            eventCount = std::max(1ll, std::atoll(value.c_str()));
+        else if (option == "--capacity")
+            capacity = std::max(2ll, std::atoll(value.c_str()));
+        else if (option == "--points")
+            points = std::max(0, std::atoi(value.c_str()));
+        else if (option == "--producers")
+        {
+            producerCounts.clear();
+            std::stringstream stream(value);
+            std::string count;
+            while (std::getline(stream, count, ','))
+                producerCounts.push_back(std::max(1, std::atoi(count.c_str())));
+        }
+    }
+
+    std::printf("%lld events, ring capacity %zu, %d points per event, %u hardware threads\n",
+                eventCount, capacity, points, std::thread::hardware_concurrency());
+    std::printf("%-10s %-10s %12s %14s %10s\n", "queue", "producers", "time_ms", "events/s", "drains");
+    for (int producerCount : producerCounts)
+    {
+        BenchResult mutexResult = runBenchmark<MutexEventQueue>(producerCount, eventCount, capacity, points);
+        BenchResult ringResult = runBenchmark<ps::EventQueue>(producerCount, eventCount, capacity, points);
+        std::printf("%-10s %-10d %12.1f %14.0f %10zu\n", "mutex", producerCount, mutexResult.seconds * 1000, eventCount / mutexResult.seconds, mutexResult.drains);
+        std::printf("%-10s %-10d %12.1f %14.0f %10zu\n", "lockfree", producerCount, ringResult.seconds * 1000, eventCount / ringResult.seconds, ringResult.drains);
+    }
+
+    return 0;
+}
@@ -0,0 +1,328 @@
+// Routing benchmark. Generates seeded query sets on the graph and runs every algorithm on them,
+// reporting the median and 99th percentile query time and the work each search did.
+//
+// usage: bench_routing <db path> [--queries 200] [--seed 1] [--algorithms astar,dijkstra,...] [--config ./config/config.toml] [--node-order]
+//
+// --node-order instead compares Dijkstra and A* with the nodes numbered in database order and
+// along a Hilbert curve.
+//
+// Query sets:
+//   local - the destination is within a few kilometers of the origin
+//   rank  - the destination is the node that Dijkstra settles 2^k-th from the origin, for every k
+//   cross - the origin is on the western edge of the map and the destination on the eastern edge
+// The sets only depend on the graph and the seed, std::mt19937 produces the same numbers everywhere.
+//
+// The `wrong` column counts the routes that are longer or shorter than Dijkstra's, every algorithm
+// must find shortest routes, so the tool exits with 1 if any is not 0.
+
+#include <chrono>
+#include <random>
+#include <map>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <filesystem>
+#include <functional>
+
+#include "tomlplusplus/toml.hpp"
+
+#include "../algorithms.h"
+
+using Clock = std::chrono::steady_clock;
+using Query = pair<GraphNodeIndex, GraphNodeIndex>;
+using Search = std::function<vector<GraphEdgeIndex>(GraphNodeIndex, GraphNodeIndex)>;
+
+struct QuerySet
+{
+    std::string name;
+    vector<Query> queries;
+};
+
+struct BenchResult
+{
+    vector<double> milliseconds;
+    vector<long long int> lengths; // of every route in meters, -1 if none was found
+    SearchStats totals;
+};
+
+/**
+ * Runs every query with the given search, recording the time of each and adding up the work.
+ */
+BenchResult runQueries(const vector<Query> &queries, const MapGraph &graph, const Search &search)
+{
+    BenchResult result;
+    for (auto [start, end] : queries)
+    {
+        auto startTime = Clock::now();
+        vector<GraphEdgeIndex> path = search(start, end);
+        result.milliseconds.push_back(std::chrono::duration<double, std::milli>(Clock::now() - startTime).count());
+        result.lengths.push_back(path.empty() && start != end ? -1 : graph.getPathLength(path));
+
+        const SearchStats &stats = SearchWorkspace::forThisThread().stats;
+        result.totals.settledNodes += stats.settledNodes;
+        result.totals.relaxedEdges += stats.relaxedEdges;
+        result.totals.heapPushes += stats.heapPushes;
+        result.totals.heapPops += stats.heapPops;
+    }
+    return result;
+}
+
+double percentile(vector<double> values, double fraction)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, size_t(fraction * values.size()))];
+}
+
+void printHeader()
+{
+    std::printf("%-8s %-12s %10s %10s %12s %12s %12s %12s %6s\n", "set", "algorithm", "median ms", "p99 ms",
+                "settled", "relaxed", "heap push", "heap pop", "wrong");
+}
+
+void printResult(const std::string &set, const std::string &algorithm, const BenchResult &result, int wrong)
+{
+    double count = std::max<size_t>(1, result.milliseconds.size());
+    std::printf("%-8s %-12s %10.3f %10.3f %12.0f %12.0f %12.0f %12.0f %6d\n", set.c_str(), algorithm.c_str(),
+                percentile(result.milliseconds, 0.5), percentile(result.milliseconds, 0.99),
+                result.totals.settledNodes / count, result.totals.relaxedEdges / count,
+                result.totals.heapPushes / count, result.totals.heapPops / count, wrong);
+}
+
+GraphNodeIndex randomNode(std::mt19937 &rng, const MapGraph &graph)
+{
+    return rng() % graph.getNodeCount();
+}
+
+// Pairs whose straight line distance is at most `maxMeters`.
+QuerySet localQueries(const MapGraph &graph, std::mt19937 &rng, int count, double maxMeters)
+{
+    QuerySet set{"local", {}};
+    while ((int)set.queries.size() < count)
+    {
+        GraphNodeIndex start = randomNode(rng, graph);
+        for (int attempt = 0; attempt < 1000000; ++attempt)
+        {
+            GraphNodeIndex end = randomNode(rng, graph);
+            if (geoDistanceLowerBound(graph.getNodeLon(start), graph.getNodeLat(start), graph.getNodeLon(end), graph.getNodeLat(end)) <= maxMeters)
+            {
+                set.queries.push_back({start, end});
+                break;
+            }
+        }
+    }
+    return set;
+}
+
+// For random origins, the nodes at Dijkstra rank 2^6, 2^7, ... up to the number of reachable nodes.
+QuerySet rankQueries(MapGraph &graph, std::mt19937 &rng, int count)
+{
+    QuerySet set{"rank", {}};
+    while ((int)set.queries.size() < count)
+    {
+        GraphNodeIndex start = randomNode(rng, graph);
+
+        // a full Dijkstra from the origin, recording the order nodes are settled in
+        vector<long long int> distances(graph.getNodeCount(), SearchLabels::unreachable);
+        vector<GraphNodeIndex> settleOrder;
+        vector<bool> settled(graph.getNodeCount(), false);
+        priority_queue<pair<long long int, GraphNodeIndex>, vector<pair<long long int, GraphNodeIndex>>, greater<pair<long long int, GraphNodeIndex>>> minPQ;
+        distances[start] = 0;
+        minPQ.push({0, start});
+        while (!minPQ.empty())
+        {
+            GraphNodeIndex v = minPQ.top().second;
+            minPQ.pop();
+            if (settled[v])
+                continue;
+            settled[v] = true;
+            settleOrder.push_back(v);
+            for (GraphEdgeIndex edgeIndex : graph.getOutEdges(v))
+            {
+                GraphNodeIndex target = graph.getEdgeTarget(edgeIndex);
+                if (graph.getEdgeWeight(edgeIndex) == forbiddenWeight)
+                    continue;
+                if (distances[v] + graph.getEdgeWeight(edgeIndex) < distances[target])
+                {
+                    distances[target] = distances[v] + graph.getEdgeWeight(edgeIndex);
+                    minPQ.push({distances[target], target});
+                }
+            }
+        }
+
+        for (size_t rank = 64; rank < settleOrder.size() && (int)set.queries.size() < count; rank *= 2)
+            set.queries.push_back({start, settleOrder[rank]});
+    }
+    return set;
+}
+
+// Pairs from the westmost to the eastmost `edgeFraction` of the nodes.
+QuerySet crossQueries(const MapGraph &graph, std::mt19937 &rng, int count, double edgeFraction)
+{
+    vector<GraphNodeIndex> byLon(graph.getNodeCount());
+    for (GraphNodeIndex v = 0; v < graph.getNodeCount(); ++v)
+        byLon[v] = v;
+    std::sort(byLon.begin(), byLon.end(), [&](GraphNodeIndex a, GraphNodeIndex b)
+              { return graph.getNodeLon(a) < graph.getNodeLon(b); });
+
+    size_t edgeCount = std::max<size_t>(1, byLon.size() * edgeFraction);
+    QuerySet set{"cross", {}};
+    for (int i = 0; i < count; ++i)
+        set.queries.push_back({byLon[rng() % edgeCount], byLon[byLon.size() - 1 - rng() % edgeCount]});
+    return set;
+}
+
+// Compares the Hilbert curve numbering that the app uses against the database numbering.
+void compareNodeOrders(std::string dbPath, int queryCount, unsigned int seed)
+{
+    MapGraph databaseOrdered, hilbertOrdered;
+    databaseOrdered.load(dbPath, "", NodeOrder::Database);
+    hilbertOrdered.load(dbPath, "", NodeOrder::Hilbert);
+
+    // the same node has a different index in the two graphs, so the queries are matched up by coordinates
+    std::map<pair<double, double>, GraphNodeIndex> hilbertIndexAt;
+    for (GraphNodeIndex v = 0; v < hilbertOrdered.getNodeCount(); ++v)
+        hilbertIndexAt[{hilbertOrdered.getNodeLon(v), hilbertOrdered.getNodeLat(v)}] = v;
+
+    std::mt19937 rng(seed);
+    vector<Query> databaseQueries, hilbertQueries;
+    for (int i = 0; i < queryCount; ++i)
+    {
+        GraphNodeIndex start = randomNode(rng, databaseOrdered), end = randomNode(rng, databaseOrdered);
+        databaseQueries.push_back({start, end});
+        hilbertQueries.push_back({hilbertIndexAt[{databaseOrdered.getNodeLon(start), databaseOrdered.getNodeLat(start)}],
+                                  hilbertIndexAt[{databaseOrdered.getNodeLon(end), databaseOrdered.getNodeLat(end)}]});
+    }
+
+    Algorithms algorithms;
+    std::printf("%-28s %10s %14s\n", "", "mean ms", "M settled/s");
+    auto report = [&](const char *name, const vector<Query> &queries, const MapGraph &graph, const Search &search)
+    {
+        BenchResult result = runQueries(queries, graph, search);
+        double seconds = 0;
+        for (double milliseconds : result.milliseconds)
+            seconds += milliseconds / 1000;
+        std::printf("%-28s %10.3f %14.2f\n", name, seconds * 1000 / queryCount, result.totals.settledNodes / seconds / 1e6);
+    };
+    report("dijkstra, database order", databaseQueries, databaseOrdered, [&](GraphNodeIndex s, GraphNodeIndex t)
+           { return algorithms.Dijkstra(s, t, databaseOrdered, false); });
+    report("dijkstra, hilbert order", hilbertQueries, hilbertOrdered, [&](GraphNodeIndex s, GraphNodeIndex t)
+           { return algorithms.Dijkstra(s, t, hilbertOrdered, false); });
+    report("a*, database order", databaseQueries, databaseOrdered, [&](GraphNodeIndex s, GraphNodeIndex t)
+           { return algorithms.aStarSearch(s, t, databaseOrdered, false); });
+    report("a*, hilbert order", hilbertQueries, hilbertOrdered, [&](GraphNodeIndex s, GraphNodeIndex t)
+           { return algorithms.aStarSearch(s, t, hilbertOrdered, false); });
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::printf("usage: %s <db path> [--queries 200] [--seed 1] [--algorithms astar,dijkstra,...] [--config ./config/config.toml] [--node-order]\n", argv[0]);
+        return 1;
+    }
+
+    std::string dbPath = argv[1], configPath = "./config/config.toml";
+    int queryCount = 200;
+    unsigned int seed = 1;
+    bool nodeOrder = false;
+    vector<AlgoName> selected = {AlgoName::Dijkstras, AlgoName::AStar, AlgoName::BidirectionalDijkstras, AlgoName::BidirectionalAStar,
+                                 AlgoName::ALT, AlgoName::BidirectionalALT, AlgoName::ContractionHierarchies};
+
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (option == "--node-order")
+            nodeOrder = true;
+        else if (i + 1 >= argc)
+            break;
+        else if (option == "--queries")
+            queryCount = std::atoi(argv[++i]);
+        else if (option == "--seed")
+            seed = std::atoi(argv[++i]);
+        else if (option == "--config")
+            configPath = argv[++i];
+        else if (option == "--algorithms")
+        {
+            selected.clear();
+            std::stringstream names(argv[++i]);
+            std::string name;
+            AlgoName algorithm;
+            while (std::getline(names, name, ','))
+            {
+                if (!parseAlgoName(name, algorithm))
+                {
+                    std::printf("unknown algorithm %s\n", name.c_str());
+                    return 1;
+                }
+                selected.push_back(algorithm);
+            }
+        }
+    }
+
+    if (nodeOrder)
+    {
+        compareNodeOrders(dbPath, queryCount, seed);
+        return 0;
+    }
+
+    // the preprocessed files live next to the database, the same as for the app
+    std::filesystem::path dataPath(dbPath);
+    MapGraph graph;
+    graph.load(dbPath, dataPath.replace_extension(".graph").string());
+
+    Algorithms algorithms;
+    for (AlgoName algorithm : selected)
+    {
+        if ((algorithm == AlgoName::ALT || algorithm == AlgoName::BidirectionalALT) && !algorithms.isLandmarksReady())
+            algorithms.prepareLandmarks(graph, dataPath.replace_extension(".alt").string(), *toml::parse_file(configPath)["routing"]["landmarks"].value<int>());
+        if (algorithm == AlgoName::ContractionHierarchies && !algorithms.isContractionHierarchyReady())
+            algorithms.prepareContractionHierarchy(graph, dataPath.replace_extension(".ch").string());
+    }
+
+    std::mt19937 rng(seed);
+    vector<QuerySet> sets = {localQueries(graph, rng, queryCount, 5000), rankQueries(graph, rng, queryCount), crossQueries(graph, rng, queryCount, 0.05)};
+
+    std::printf("%d nodes, %d edges, %d queries per set, seed %u\n", graph.getNodeCount(), graph.getEdgeCount(), queryCount, seed);
+    std::printf("settled, relaxed and heap columns are averages per query\n");
+    printHeader();
+    int wrongTotal = 0;
+    for (const QuerySet &set : sets)
+    {
+        // Dijkstra's route lengths are the reference every algorithm is checked against
+        vector<long long int> reference = runQueries(set.queries, graph, [&](GraphNodeIndex s, GraphNodeIndex t)
+                                                     { return algorithms.Dijkstra(s, t, graph, false); })
+                                              .lengths;
+        for (AlgoName algorithm : selected)
+        {
+            BenchResult result = runQueries(set.queries, graph, [&](GraphNodeIndex s, GraphNodeIndex t)
+                                            {
+                switch (algorithm)
+                {
+                case AlgoName::Dijkstras:
+                    return algorithms.Dijkstra(s, t, graph, false);
+                case AlgoName::BidirectionalDijkstras:
+                    return algorithms.bidirectionalDijkstra(s, t, graph, false);
+                case AlgoName::BidirectionalAStar:
+                    return algorithms.bidirectionalAStar(s, t, graph, false);
+                case AlgoName::ALT:
+                    return algorithms.landmarkAStarSearch(s, t, graph, false);
+                case AlgoName::BidirectionalALT:
+                    return algorithms.bidirectionalLandmarkAStar(s, t, graph, false);
+                case AlgoName::ContractionHierarchies:
+                    return algorithms.contractionHierarchySearch(s, t, graph, false);
+                default:
+                    return algorithms.aStarSearch(s, t, graph, false);
+                } });
+            int wrong = 0;
+            for (size_t i = 0; i < reference.size(); ++i)
+                wrong += result.lengths[i] != reference[i];
+            wrongTotal += wrong;
+            printResult(set.name, algoNameToString(algorithm), result, wrong);
+        }
+    }
+
+    return wrongTotal == 0 ? 0 : 1;
+}
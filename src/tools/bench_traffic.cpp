@@ -0,0 +1,173 @@
+// Traffic overlay benchmark. Applies seeded batches of random speed updates to the car weights,
+// first with no searches running and then while reader threads run car A* queries, the way the
+// app applies the traffic feed while routes are being found.
+//
+// usage: bench_traffic <db path> [--updates 100000] [--batches 10] [--readers 2] [--queries 200] [--seed 1]
+//
+// It prints the time to apply a batch and the car query times with and without a writer. After
+// every batch without readers, A* and Dijkstra must find routes of the same travel time, which
+// checks that the traffic weights keep the A* heuristic a lower bound.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+
+#include "../algorithms.h"
+
+using Clock = std::chrono::steady_clock;
+
+double milliseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+double median(vector<double> values)
+{
+    if (values.empty())
+        return 0;
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+// Random speeds for random roads: most are slowed to 5 to 60 km/h, 1% are closed and 5% return to free flow.
+vector<SpeedUpdate> randomUpdates(const MapGraph &graph, int count, std::mt19937 &rng)
+{
+    vector<SpeedUpdate> updates;
+    for (int i = 0; i < count; ++i)
+    {
+        long long int sqlID = graph.getEdge(rng() % graph.getEdgeCount()).sqlID;
+        int kind = rng() % 100;
+        double speed = kind == 0 ? 0 : kind <= 5 ? -1 : 5 + rng() % 56;
+        updates.push_back(SpeedUpdate{sqlID, speed});
+    }
+    return updates;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::printf("usage: %s <db path> [--updates 100000] [--batches 10] [--readers 2] [--queries 200] [--seed 1]\n", argv[0]);
+        return 1;
+    }
+
+    std::string dbPath = argv[1];
+    int updateCount = 100000, batchCount = 10, readerCount = 2, queryCount = 200, seed = 1;
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        std::string option = argv[i], value = argv[i + 1];
+        if (option == "--updates")
+            updateCount = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--batches")
+            batchCount = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--readers")
+            readerCount = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--queries")
+            queryCount = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--seed")
+            seed = std::atoi(value.c_str());
+    }
+
+    MapGraph graph;
+    graph.load(dbPath, std::filesystem::path(dbPath).replace_extension(".graph").string());
+    Algorithms algorithms;
+    TrafficOverlay &traffic = algorithms.getTrafficOverlay();
+    auto startTime = Clock::now();
+    traffic.init(graph);
+    std::printf("%d nodes, %d edges, %d roads, overlay index built in %.1f ms\n", graph.getNodeCount(), graph.getEdgeCount(), graph.getRoadCount(), milliseconds(startTime));
+
+    std::mt19937 rng(seed);
+    vector<pair<GraphNodeIndex, GraphNodeIndex>> queries;
+    for (int i = 0; i < queryCount; ++i)
+        queries.push_back({(int)(rng() % graph.getNodeCount()), (int)(rng() % graph.getNodeCount())});
+    vector<vector<SpeedUpdate>> batches;
+    for (int i = 0; i < batchCount; ++i)
+        batches.push_back(randomUpdates(graph, updateCount, rng));
+
+    auto carQuery = [&](pair<GraphNodeIndex, GraphNodeIndex> query)
+    {
+        return algorithms.aStarSearch(query.first, query.second, graph, false, CancellationToken::none(), RoutingProfile::Car);
+    };
+
+    vector<double> freeFlowTimes;
+    for (auto query : queries)
+    {
+        startTime = Clock::now();
+        carQuery(query);
+        freeFlowTimes.push_back(milliseconds(startTime));
+    }
+
+    // no readers: the time to apply a batch alone, and A* against Dijkstra on every snapshot
+    vector<double> applyTimes;
+    int mismatches = 0, checkedQueries = 0;
+    for (const vector<SpeedUpdate> &batch : batches)
+    {
+        TrafficBatchStats stats = traffic.apply(batch);
+        applyTimes.push_back(stats.milliseconds);
+
+        std::shared_ptr<const TrafficSnapshot> snapshot = traffic.current();
+        const Column<int> &weights = snapshot->getEdgeWeights(graph, RoutingProfile::Car);
+        for (size_t i = 0; i < queries.size(); i += 10)
+        {
+            vector<GraphEdgeIndex> aStarPath = carQuery(queries[i]);
+            vector<GraphEdgeIndex> dijkstraPath = algorithms.Dijkstra(queries[i].first, queries[i].second, graph, false, CancellationToken::none(), RoutingProfile::Car);
+            mismatches += graph.getPathWeight(aStarPath, weights) != graph.getPathWeight(dijkstraPath, weights);
+            checkedQueries++;
+        }
+    }
+    std::printf("%d batches of %d updates, %d edges slowed after the last one\n", batchCount, updateCount, traffic.current()->slowedEdges);
+    std::printf("apply without readers: median %.2f ms, max %.2f ms\n", median(applyTimes), *std::max_element(applyTimes.begin(), applyTimes.end()));
+
+    // readers run car queries the whole time while the batches are applied again
+    std::atomic<bool> isWriting = true;
+    std::atomic<int> racedQueries = 0, closedEdgesUsed = 0;
+    vector<vector<double>> readerTimes(readerCount);
+    vector<std::thread> readers;
+    for (int reader = 0; reader < readerCount; ++reader)
+    {
+        readers.emplace_back([&, reader]()
+                             {
+            for (size_t i = reader; isWriting; i = (i + readerCount) % queries.size())
+            {
+                std::shared_ptr<const TrafficSnapshot> before = traffic.current();
+                auto queryStart = Clock::now();
+                vector<GraphEdgeIndex> path = carQuery(queries[i]);
+                readerTimes[reader].push_back(milliseconds(queryStart));
+
+                // when no batch was published during the query, the query read `before`
+                if (traffic.current() != before)
+                {
+                    racedQueries++;
+                    continue;
+                }
+                for (GraphEdgeIndex edgeIndex : path)
+                    closedEdgesUsed += before->getEdgeWeights(graph, RoutingProfile::Car)[edgeIndex] == forbiddenWeight;
+            } });
+    }
+
+    applyTimes.clear();
+    for (const vector<SpeedUpdate> &batch : batches)
+    {
+        applyTimes.push_back(traffic.apply(batch).milliseconds);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    isWriting = false;
+    for (std::thread &reader : readers)
+        reader.join();
+
+    vector<double> loadedTimes;
+    for (const vector<double> &times : readerTimes)
+        loadedTimes.insert(loadedTimes.end(), times.begin(), times.end());
+    std::printf("apply with %d readers: median %.2f ms, max %.2f ms\n", readerCount, median(applyTimes), *std::max_element(applyTimes.begin(), applyTimes.end()));
+    std::printf("car A* query median: %.2f ms free flow, %.2f ms with %zu queries during the writes (%d overlapped a publish)\n",
+                median(freeFlowTimes), median(loadedTimes), loadedTimes.size(), racedQueries.load());
+    std::printf("%d of %d A* routes differ in time from Dijkstra, %d closed edges used\n", mismatches, checkedQueries, closedEdgesUsed.load());
+    return mismatches == 0 && closedEdgesUsed == 0 ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+// Distance matrix between two sets of points. Snaps every point to its nearest graph node, fills
+// the matrix with Algorithms::distanceMatrix and writes it as a dense CSV table. Then compares the
+// time with routing a random sample of the origin-destination pairs one query at a time, and
+// checks that those queries find the same distances.
+//
+// usage: distance_matrix <origins csv> <destinations csv> <output csv> [--method buckets] [--threads 4] [--compare 1000] [--db ./db/map.db] [--config ./config/config.toml]
+//
+// input rows:  lon,lat (a header row is skipped)
+// output:      a header row `origin,0,1,...` with the destination numbers, then one row per origin
+//              with the distances in meters, empty where there is no route or the point is off the map
+// --method     `buckets` (many-to-many over the contraction hierarchy) or `dijkstra` (one-to-many
+//              Dijkstra per origin). The single queries are run with the matching point-to-point
+//              search, contraction hierarchy or Dijkstra.
+// --compare    number of sampled pairs to route one at a time, 0 skips the comparison
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tomlplusplus/toml.hpp"
+
+#include "../algorithms.h"
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Reads lon,lat points from a CSV file. Lines that do not start with two numbers, like a header
+ * row, are skipped.
+ */
+vector<sf::Vector2<double>> readPoints(const std::string &path)
+{
+    vector<sf::Vector2<double>> points;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::stringstream stream(line);
+        std::string cell;
+        double values[2];
+        int count = 0;
+        while (count < 2 && std::getline(stream, cell, ','))
+        {
+            char *end = nullptr;
+            values[count] = std::strtod(cell.c_str(), &end);
+            if (end == cell.c_str())
+                break;
+            count++;
+        }
+
+        if (count == 2)
+            points.push_back(sf::Vector2<double>(values[0], values[1]));
+    }
+    return points;
+}
+
+// The nearest node of every point, -1 for points outside of the map.
+vector<GraphNodeIndex> snapPoints(const vector<sf::Vector2<double>> &points, const MapGraph &graph, const MapGeometry &geometry)
+{
+    vector<GraphNodeIndex> nodes;
+    for (sf::Vector2<double> point : points)
+    {
+        sf::Vector2<double> offset = geometry.offsetGeoVector(point);
+        nodes.push_back(graph.findNearestNode(offset.x, offset.y));
+    }
+    return nodes;
+}
+
+void writeMatrix(const std::string &path, const DistanceMatrix &matrix)
+{
+    std::ofstream file(path);
+    file << "origin";
+    for (int col = 0; col < matrix.cols; ++col)
+        file << ',' << col;
+    file << '\n';
+    for (int row = 0; row < matrix.rows; ++row)
+    {
+        file << row;
+        for (int col = 0; col < matrix.cols; ++col)
+        {
+            file << ',';
+            if (matrix.at(row, col) != SearchLabels::unreachable)
+                file << matrix.at(row, col);
+        }
+        file << '\n';
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        std::printf("usage: %s <origins csv> <destinations csv> <output csv> [--method buckets] [--threads 4] [--compare 1000] [--db ./db/map.db] [--config ./config/config.toml]\n", argv[0]);
+        return 1;
+    }
+
+    std::string originsPath = argv[1], destinationsPath = argv[2], outputPath = argv[3];
+    std::string dbPath = "./db/map.db", configPath = "./config/config.toml";
+    MatrixMethod method = MatrixMethod::Buckets;
+    int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    int compareCount = 1000;
+
+    for (int i = 4; i + 1 < argc; i += 2)
+    {
+        std::string option = argv[i], value = argv[i + 1];
+        if (option == "--method" && value != "buckets" && value != "dijkstra")
+        {
+            std::printf("unknown method %s\n", value.c_str());
+            return 1;
+        }
+        else if (option == "--method")
+            method = value == "buckets" ? MatrixMethod::Buckets : MatrixMethod::OneToMany;
+        else if (option == "--threads")
+            threadCount = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--compare")
+            compareCount = std::max(0, std::atoi(value.c_str()));
+        else if (option == "--db")
+            dbPath = value;
+        else if (option == "--config")
+            configPath = value;
+    }
+
+    auto config = toml::parse_file(configPath);
+    double mapTop = *config["map"]["bbox_top"].value<double>();
+    double mapLeft = *config["map"]["bbox_left"].value<double>();
+    double mapBottom = *config["map"]["bbox_bottom"].value<double>();
+    double mapRight = *config["map"]["bbox_right"].value<double>();
+    double chunkSize = *config["map"]["chunk_size"].value<double>();
+    MapGeometry geometry(1, {mapTop, mapLeft, mapRight - mapLeft, mapTop - mapBottom}, chunkSize);
+
+    // the preprocessed files live next to the database, the same as for the app
+    std::filesystem::path dataPath(dbPath);
+    MapGraph graph;
+    graph.load(dbPath, dataPath.replace_extension(".graph").string());
+
+    Algorithms algorithms;
+    if (method == MatrixMethod::Buckets)
+        algorithms.prepareContractionHierarchy(graph, dataPath.replace_extension(".ch").string());
+
+    auto startTime = Clock::now();
+    vector<GraphNodeIndex> origins = snapPoints(readPoints(originsPath), graph, geometry);
+    vector<GraphNodeIndex> destinations = snapPoints(readPoints(destinationsPath), graph, geometry);
+    double snapMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+
+    DistanceMatrix matrix = algorithms.distanceMatrix(origins, destinations, graph, method, threadCount);
+    writeMatrix(outputPath, matrix);
+
+    double entries = std::max(1.0, (double)matrix.rows * matrix.cols);
+    std::printf("%d x %d matrix with %s on %d threads\n", matrix.rows, matrix.cols, method == MatrixMethod::Buckets ? "buckets" : "dijkstra", threadCount);
+    std::printf("snapping %.1f ms, matrix %.1f ms", snapMilliseconds, matrix.milliseconds);
+    if (method == MatrixMethod::Buckets)
+        std::printf(" (buckets %.1f ms)", matrix.bucketMilliseconds);
+    std::printf(", %.3f us per entry, %.0f settled nodes per row\n", matrix.milliseconds * 1000 / entries, (double)matrix.settledNodes / std::max(1, matrix.rows));
+
+    if (compareCount == 0 || entries == 0)
+        return 0;
+
+    // route a sample of the pairs one at a time with the same kind of search, on as many threads
+    std::mt19937 rng(1);
+    vector<pair<int, int>> pairs;
+    for (int i = 0; i < compareCount; ++i)
+        pairs.push_back({(int)(rng() % matrix.rows), (int)(rng() % matrix.cols)});
+    vector<long long int> singleDistances(pairs.size(), SearchLabels::unreachable);
+
+    startTime = Clock::now();
+    parallelFor(pairs.size(), threadCount, [&](size_t i)
+                {
+        GraphNodeIndex origin = origins[pairs[i].first], destination = destinations[pairs[i].second];
+        if (origin == -1 || destination == -1)
+            return;
+        vector<GraphEdgeIndex> path = method == MatrixMethod::Buckets ? algorithms.contractionHierarchySearch(origin, destination, graph, false)
+                                                                      : algorithms.Dijkstra(origin, destination, graph, false);
+        if (!path.empty() || origin == destination)
+            singleDistances[i] = graph.getPathLength(path); });
+    double singleMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+
+    int mismatches = 0;
+    for (size_t i = 0; i < pairs.size(); ++i)
+        mismatches += singleDistances[i] != matrix.at(pairs[i].first, pairs[i].second);
+
+    double estimate = singleMilliseconds / pairs.size() * entries;
+    std::printf("%zu single queries %.1f ms, %.3f ms each, all %.0f pairs would take %.1f ms, the matrix is %.1fx faster\n",
+                pairs.size(), singleMilliseconds, singleMilliseconds / pairs.size(), entries, estimate, estimate / matrix.milliseconds);
+    std::printf("%d of %zu sampled distances differ from the single queries\n", mismatches, pairs.size());
+    return mismatches == 0 ? 0 : 1;
+}
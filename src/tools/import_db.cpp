@@ -0,0 +1,593 @@
+// Builds the map database from the osm4routing CSVs, in place of create_db.py, populate_db.py and
+// cleanup_db.py. Both files are memory mapped and cut into one line-aligned range per thread. Each
+// thread parses its lines, drops the edges that cars may not use, assigns chunks and encodes the
+// edge points. The rows are then written through prepared statements in a single transaction, with
+// the indices dropped during the load and rebuilt at the end.
+//
+// usage: import_db [--nodes data/nodes_bboxed.csv] [--edges data/edges_bboxed.csv] [--db db/map.db]
+//                  [--config config/config.toml] [--threads <hardware threads>]
+//
+// The database is written next to `--db` and renamed over it when the import succeeded.
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "tomlplusplus/toml.hpp"
+
+#include "../sql.h"
+#include "../mapped_file.h"
+
+// Coordinates are read in 1e-7 degree fixed point, the precision of the OSM extract, so that the
+// offsets to the bounding box and the chunk of every point are exact like the Decimals of the scripts.
+constexpr long long int fixedPointScale = 10000000;
+
+struct ParsedNode
+{
+    long long int id;
+    long long int offsetLon;
+    long long int offsetLat;
+};
+
+struct ParsedEdge
+{
+    long long int osmId;
+    long long int sourceNodeId;
+    long long int targetNodeId;
+    double lengthMeters;
+    int descriptors[6]; // foot, car forward, car backward, bike forward, bike backward, train
+    int chunkRow;
+    int chunkCol;
+    size_t geometryBegin; // position of the encoded points in the geometry buffer of the range
+};
+
+// Everything one thread parsed from its range of lines
+struct ParsedRange
+{
+    std::vector<ParsedNode> nodes;
+    std::vector<ParsedEdge> edges;
+    std::vector<char> geometry; // encoded points of all edges, one after another
+    std::string error;
+};
+
+// Map bounding box and chunk size in fixed point
+struct Grid
+{
+    long long int left;
+    long long int top;
+    long long int chunkSize;
+    int rows;
+    int cols;
+
+    static long long int floorDivide(long long int value, long long int divisor)
+    {
+        return value / divisor - (value % divisor < 0);
+    }
+
+    int rowOf(long long int offsetLat) const
+    {
+        return floorDivide(offsetLat, chunkSize);
+    }
+
+    int colOf(long long int offsetLon) const
+    {
+        return floorDivide(offsetLon, chunkSize);
+    }
+
+    bool contains(int row, int col) const
+    {
+        return row >= 0 && row < rows && col >= 0 && col < cols;
+    }
+};
+
+// Reads a number like "-81.3862789" at `position` into fixed point, rounding digits past the seventh.
+bool parseFixed(const char *&position, const char *end, long long int &value)
+{
+    bool negative = position < end && *position == '-';
+    if (negative)
+        ++position;
+
+    const char *start = position;
+    long long int integer = 0, fraction = 0, scale = fixedPointScale;
+    while (position < end && *position >= '0' && *position <= '9')
+        integer = integer * 10 + (*position++ - '0');
+    if (position < end && *position == '.')
+    {
+        ++position;
+        while (position < end && *position >= '0' && *position <= '9')
+        {
+            if (scale > 1)
+                fraction += (*position - '0') * (scale /= 10);
+            else if (scale == 1 && *position >= '5')
+                fraction += 1, scale = 0; // round on the first digit past the precision
+            else
+                scale = 0;
+            ++position;
+        }
+    }
+    value = integer * fixedPointScale + fraction;
+    if (negative)
+        value = -value;
+    return position != start;
+}
+
+bool parseInteger(const char *&position, const char *end, long long int &value)
+{
+    auto result = std::from_chars(position, end, value);
+    position = result.ptr;
+    return result.ec == std::errc();
+}
+
+// Reads the next comma separated field and steps over the comma.
+std::string_view nextField(const char *&position, const char *end)
+{
+    const char *start = position;
+    while (position < end && *position != ',' && *position != '\n' && *position != '\r')
+        ++position;
+    std::string_view field(start, position - start);
+    if (position < end && *position == ',')
+        ++position;
+    return field;
+}
+
+// path_descriptor_to_int of populate_db.py, -1 for an unknown descriptor
+int pathDescriptor(std::string_view name)
+{
+    static const std::pair<std::string_view, int> descriptors[] = {
+        {"Forbidden", 0}, {"Allowed", 1}, {"Residential", 2}, {"Tertiary", 3}, {"Secondary", 4}, {"Primary", 5}, {"Trunk", 6}, {"Motorway", 7}, {"Track", 8}, {"Lane", 8}};
+    for (auto &[descriptorName, value] : descriptors)
+    {
+        if (name == descriptorName)
+            return value;
+    }
+    return -1;
+}
+
+// Cuts [begin, end) into `count` ranges that start at the beginning of a line.
+std::vector<std::pair<const char *, const char *>> splitLines(const char *begin, const char *end, int count)
+{
+    std::vector<std::pair<const char *, const char *>> ranges;
+    const char *start = begin;
+    for (int i = 1; i <= count && start < end; ++i)
+    {
+        const char *stop = i == count ? end : std::max(start, begin + (end - begin) * i / count);
+        while (stop < end && *stop != '\n')
+            ++stop;
+        if (stop < end)
+            ++stop;
+        ranges.emplace_back(start, stop);
+        start = stop;
+    }
+    return ranges;
+}
+
+// "id,lon,lat"
+void parseNodes(const char *position, const char *end, const Grid &grid, ParsedRange &out)
+{
+    while (position < end)
+    {
+        ParsedNode node;
+        long long int lon, lat;
+        const char *line = position;
+        bool valid = parseInteger(position, end, node.id) && *position++ == ',' &&
+                     parseFixed(position, end, lon) && *position++ == ',' &&
+                     parseFixed(position, end, lat);
+        if (!valid)
+        {
+            out.error = "malformed node line: " + std::string(line, std::find(line, end, '\n'));
+            return;
+        }
+
+        node.offsetLon = lon - grid.left;
+        node.offsetLat = grid.top - lat;
+        out.nodes.push_back(node);
+
+        position = std::find(position, end, '\n');
+        if (position < end)
+            ++position;
+    }
+}
+
+// "id,osm_id,source,target,length,foot,car_forward,car_backward,bike_forward,bike_backward,train,"LINESTRING(lon lat, lon lat)""
+void parseEdges(const char *position, const char *end, const Grid &grid, ParsedRange &out)
+{
+    std::vector<double> lons, lats;
+    while (position < end)
+    {
+        const char *line = position;
+        const char *lineEnd = std::find(position, end, '\n');
+        auto fail = [&]()
+        { out.error = "malformed edge line: " + std::string(line, lineEnd); };
+
+        ParsedEdge edge;
+        nextField(position, lineEnd); // the row number of the CSV is not stored
+        std::string_view fields[4] = {nextField(position, lineEnd), nextField(position, lineEnd), nextField(position, lineEnd), nextField(position, lineEnd)};
+        bool valid = std::from_chars(fields[0].data(), fields[0].data() + fields[0].size(), edge.osmId).ec == std::errc() &&
+                     std::from_chars(fields[1].data(), fields[1].data() + fields[1].size(), edge.sourceNodeId).ec == std::errc() &&
+                     std::from_chars(fields[2].data(), fields[2].data() + fields[2].size(), edge.targetNodeId).ec == std::errc() &&
+                     std::from_chars(fields[3].data(), fields[3].data() + fields[3].size(), edge.lengthMeters).ec == std::errc();
+        for (int &descriptor : edge.descriptors)
+        {
+            descriptor = pathDescriptor(nextField(position, lineEnd));
+            valid = valid && descriptor >= 0;
+        }
+
+        // the points, offset to the bounding box
+        static constexpr std::string_view prefix = "\"LINESTRING(";
+        valid = valid && std::string_view(position, lineEnd - position).substr(0, prefix.size()) == prefix;
+        if (!valid)
+            return fail();
+        position += prefix.size();
+
+        lons.clear();
+        lats.clear();
+        long long int firstLon = 0, firstLat = 0;
+        while (position < lineEnd && *position != ')')
+        {
+            long long int lon, lat;
+            if (!parseFixed(position, lineEnd, lon) || *position++ != ' ' || !parseFixed(position, lineEnd, lat))
+                return fail();
+            if (lons.empty())
+                firstLon = lon - grid.left, firstLat = grid.top - lat;
+
+            lons.push_back(double(lon - grid.left) / fixedPointScale);
+            lats.push_back(double(grid.top - lat) / fixedPointScale);
+            while (position < lineEnd && (*position == ',' || *position == ' '))
+                ++position;
+        }
+        if (lons.empty())
+            return fail();
+
+        position = lineEnd < end ? lineEnd + 1 : end;
+
+        // cleanup_db.py: edges that cars may not use in either direction are not imported
+        if (edge.descriptors[1] == 0 && edge.descriptors[2] == 0)
+            continue;
+
+        // an edge belongs to the chunk where its path starts
+        edge.chunkRow = grid.rowOf(firstLat);
+        edge.chunkCol = grid.colOf(firstLon);
+
+        std::vector<char> encoded;
+        geocodec::encode(lons, lats, encoded);
+        edge.geometryBegin = out.geometry.size();
+        out.geometry.insert(out.geometry.end(), encoded.begin(), encoded.end());
+        out.edges.push_back(edge);
+    }
+}
+
+// Runs `parse` on every range of the file in its own thread.
+template <typename Parse>
+std::vector<ParsedRange> parseFile(const MappedFile &file, int threadCount, Parse parse)
+{
+    const char *begin = file.data(), *end = file.data() + file.size();
+    begin = std::find(begin, end, '\n'); // skip the header
+    begin = begin < end ? begin + 1 : end;
+
+    auto ranges = splitLines(begin, end, threadCount);
+    std::vector<ParsedRange> parsed(ranges.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < ranges.size(); ++i)
+        threads.emplace_back([&, i]()
+                             { parse(ranges[i].first, ranges[i].second, parsed[i]); });
+    for (std::thread &thread : threads)
+        thread.join();
+    return parsed;
+}
+
+// A parsed row in the order of the clustered (chunk_id, id) key of its table
+struct RowOrder
+{
+    long long int chunkKey;
+    long long int id;
+    size_t range;
+    size_t index;
+
+    bool operator<(const RowOrder &other) const
+    {
+        return chunkKey != other.chunkKey ? chunkKey < other.chunkKey : id < other.id;
+    }
+};
+
+class Importer
+{
+public:
+    explicit Importer(const std::string &dbPath) : dbPath(dbPath) {}
+
+    ~Importer()
+    {
+        for (sqlite3_stmt *statement : statements)
+            sqlite3_finalize(statement);
+        sqlite3_close(db);
+    }
+
+    /**
+     * Creates the tables of `sql::loadStorage` and opens the database for the bulk load.
+     *
+     * @return false if the database could not be created
+     */
+    bool open()
+    {
+        sql::loadStorage(dbPath).sync_schema();
+        if (sqlite3_open(dbPath.c_str(), &db) != SQLITE_OK)
+            return false;
+
+        // nothing needs to survive a crash, the half written file is thrown away anyway
+        exec("PRAGMA journal_mode = OFF");
+        exec("PRAGMA synchronous = OFF");
+        exec("PRAGMA locking_mode = EXCLUSIVE");
+        exec("PRAGMA temp_store = MEMORY");
+        exec("PRAGMA cache_size = -262144");
+
+        // inserting into indexed tables is slow, so the indices are built once the rows are in
+        sqlite3_stmt *statement = prepare("SELECT sql FROM sqlite_master WHERE type = 'index' AND sql IS NOT NULL");
+        while (sqlite3_step(statement) == SQLITE_ROW)
+            indexStatements.push_back((const char *)sqlite3_column_text(statement, 0));
+        statement = prepare("SELECT name FROM sqlite_master WHERE type = 'index' AND sql IS NOT NULL");
+        std::vector<std::string> indexNames;
+        while (sqlite3_step(statement) == SQLITE_ROW)
+            indexNames.push_back((const char *)sqlite3_column_text(statement, 0));
+        for (const std::string &name : indexNames)
+            exec("DROP INDEX " + name);
+
+        exec("BEGIN");
+        return true;
+    }
+
+    void insertEdges(const std::vector<ParsedRange> &ranges)
+    {
+        sqlite3_stmt *statement = prepare(
+            "INSERT INTO edge (id, osm_id, chunk_id, source_node_id, target_node_id, path_length_meters, path_foot, path_car_fwd, "
+            "path_car_bwd, path_bike_fwd, path_bike_bwd, path_train, path_offset_points, path_geometry) "
+            "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, '', ?)");
+
+        // ids are numbered in file order like AUTOINCREMENT did, the rows go in in table order
+        std::vector<RowOrder> order;
+        long long int id = 1;
+        for (size_t r = 0; r < ranges.size(); ++r)
+        {
+            for (size_t i = 0; i < ranges[r].edges.size(); ++i)
+                order.push_back({sql::chunkKey(ranges[r].edges[i].chunkRow, ranges[r].edges[i].chunkCol), id++, r, i});
+        }
+        std::sort(order.begin(), order.end());
+
+        for (const RowOrder &row : order)
+        {
+            const ParsedRange &range = ranges[row.range];
+            const ParsedEdge &edge = range.edges[row.index];
+            size_t geometryEnd = row.index + 1 < range.edges.size() ? range.edges[row.index + 1].geometryBegin : range.geometry.size();
+
+            sqlite3_bind_int64(statement, 1, row.id);
+            sqlite3_bind_int64(statement, 2, edge.osmId);
+            sqlite3_bind_int64(statement, 3, row.chunkKey);
+            sqlite3_bind_int64(statement, 4, edge.sourceNodeId);
+            sqlite3_bind_int64(statement, 5, edge.targetNodeId);
+            sqlite3_bind_double(statement, 6, edge.lengthMeters);
+            for (int d = 0; d < 6; ++d)
+                sqlite3_bind_int(statement, 7 + d, edge.descriptors[d]);
+            sqlite3_bind_blob(statement, 13, range.geometry.data() + edge.geometryBegin, geometryEnd - edge.geometryBegin, SQLITE_STATIC);
+            step(statement);
+        }
+    }
+
+    void insertNodes(const std::vector<ParsedRange> &ranges, const Grid &grid,
+                     const std::unordered_map<long long int, std::pair<int, int>> &nodeEdgeCounts, std::vector<int> &chunkNodeCounts)
+    {
+        sqlite3_stmt *statement = prepare(
+            "INSERT INTO node (id, chunk_id, offset_lon, offset_lat, num_out_edges, num_in_edges) VALUES (?, ?, ?, ?, ?, ?)");
+
+        std::vector<RowOrder> order;
+        for (size_t r = 0; r < ranges.size(); ++r)
+        {
+            for (size_t i = 0; i < ranges[r].nodes.size(); ++i)
+            {
+                // cleanup_db.py: nodes without a car edge are not imported
+                const ParsedNode &node = ranges[r].nodes[i];
+                if (!nodeEdgeCounts.count(node.id))
+                    continue;
+
+                int row = grid.rowOf(node.offsetLat), col = grid.colOf(node.offsetLon);
+                if (grid.contains(row, col))
+                    chunkNodeCounts[row * grid.cols + col]++;
+                order.push_back({sql::chunkKey(row, col), node.id, r, i});
+            }
+        }
+        std::sort(order.begin(), order.end());
+
+        for (const RowOrder &row : order)
+        {
+            const ParsedNode &node = ranges[row.range].nodes[row.index];
+            const std::pair<int, int> &counts = nodeEdgeCounts.at(node.id);
+
+            sqlite3_bind_int64(statement, 1, node.id);
+            sqlite3_bind_int64(statement, 2, row.chunkKey);
+            sqlite3_bind_double(statement, 3, double(node.offsetLon) / fixedPointScale);
+            sqlite3_bind_double(statement, 4, double(node.offsetLat) / fixedPointScale);
+            sqlite3_bind_int(statement, 5, counts.first);
+            sqlite3_bind_int(statement, 6, counts.second);
+            step(statement);
+        }
+    }
+
+    void insertChunks(const Grid &grid, const std::vector<int> &chunkNodeCounts, const std::vector<int> &chunkEdgeCounts)
+    {
+        sqlite3_stmt *statement = prepare(
+            "INSERT INTO chunk (id, row, col, offset_lat_top, offset_lon_left, num_nodes, num_edges) VALUES (?, ?, ?, ?, ?, ?, ?)");
+
+        for (int row = 0; row < grid.rows; ++row)
+        {
+            for (int col = 0; col < grid.cols; ++col)
+            {
+                sqlite3_bind_int64(statement, 1, sql::chunkKey(row, col));
+                sqlite3_bind_int(statement, 2, row);
+                sqlite3_bind_int(statement, 3, col);
+                sqlite3_bind_double(statement, 4, double(row * grid.chunkSize) / fixedPointScale);
+                sqlite3_bind_double(statement, 5, double(col * grid.chunkSize) / fixedPointScale);
+                sqlite3_bind_int(statement, 6, chunkNodeCounts[row * grid.cols + col]);
+                sqlite3_bind_int(statement, 7, chunkEdgeCounts[row * grid.cols + col]);
+                step(statement);
+            }
+        }
+    }
+
+    // Commits the rows and builds the indices again.
+    void finish()
+    {
+        exec("COMMIT");
+        for (const std::string &statement : indexStatements)
+            exec(statement);
+    }
+
+    bool failed() const
+    {
+        return !error.empty();
+    }
+
+    const std::string &getError() const
+    {
+        return error;
+    }
+
+private:
+    void exec(const std::string &query)
+    {
+        char *message = nullptr;
+        if (sqlite3_exec(db, query.c_str(), nullptr, nullptr, &message) != SQLITE_OK && error.empty())
+            error = query + ": " + (message ? message : "unknown error");
+        sqlite3_free(message);
+    }
+
+    sqlite3_stmt *prepare(const char *query)
+    {
+        sqlite3_stmt *statement = nullptr;
+        if (sqlite3_prepare_v2(db, query, -1, &statement, nullptr) != SQLITE_OK && error.empty())
+            error = std::string(query) + ": " + sqlite3_errmsg(db);
+        statements.push_back(statement);
+        return statement;
+    }
+
+    void step(sqlite3_stmt *statement)
+    {
+        if (sqlite3_step(statement) != SQLITE_DONE && error.empty())
+            error = sqlite3_errmsg(db);
+        sqlite3_reset(statement);
+    }
+
+    std::string dbPath;
+    sqlite3 *db = nullptr;
+    std::vector<sqlite3_stmt *> statements;
+    std::vector<std::string> indexStatements;
+    std::string error;
+};
+
+int main(int argc, char **argv)
+{
+    std::string nodesPath = "./data/nodes_bboxed.csv", edgesPath = "./data/edges_bboxed.csv";
+    std::string dbPath = "./db/map.db", configPath = "./config/config.toml";
+    int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string option = argv[i], value = argv[i + 1];
+        if (option == "--nodes")
+            nodesPath = value;
+        else if (option == "--edges")
+            edgesPath = value;
+        else if (option == "--db")
+            dbPath = value;
+        else if (option == "--config")
+            configPath = value;
+        else if (option == "--threads")
+            threadCount = std::max(1, std::atoi(value.c_str()));
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    auto seconds = [&]()
+    { return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count(); };
+
+    toml::v3::ex::parse_result config = toml::parse_file(configPath);
+    auto toFixed = [](double degrees)
+    { return (long long int)std::llround(degrees * fixedPointScale); };
+    Grid grid;
+    grid.left = toFixed(config["map"]["bbox_left"].value_or(0.0));
+    grid.top = toFixed(config["map"]["bbox_top"].value_or(0.0));
+    grid.chunkSize = toFixed(config["map"]["chunk_size"].value_or(0.0));
+    long long int width = toFixed(config["map"]["bbox_right"].value_or(0.0)) - grid.left;
+    long long int height = grid.top - toFixed(config["map"]["bbox_bottom"].value_or(0.0));
+    if (grid.chunkSize <= 0 || width <= 0 || height <= 0)
+    {
+        std::printf("%s has no valid map bounding box and chunk size\n", configPath.c_str());
+        return 1;
+    }
+    grid.rows = (height + grid.chunkSize - 1) / grid.chunkSize;
+    grid.cols = (width + grid.chunkSize - 1) / grid.chunkSize;
+
+    MappedFile nodesFile, edgesFile;
+    if (!nodesFile.open(nodesPath) || !edgesFile.open(edgesPath))
+    {
+        std::printf("could not read %s and %s\n", nodesPath.c_str(), edgesPath.c_str());
+        return 1;
+    }
+
+    auto edgeRanges = parseFile(edgesFile, threadCount, [&](const char *begin, const char *end, ParsedRange &out)
+                                { parseEdges(begin, end, grid, out); });
+    auto nodeRanges = parseFile(nodesFile, threadCount, [&](const char *begin, const char *end, ParsedRange &out)
+                                { parseNodes(begin, end, grid, out); });
+    for (auto *ranges : {&edgeRanges, &nodeRanges})
+    {
+        for (const ParsedRange &range : *ranges)
+        {
+            if (!range.error.empty())
+            {
+                std::printf("%s\n", range.error.c_str());
+                return 1;
+            }
+        }
+    }
+
+    // out and in edge counts of every node that has a car edge, and the edges of every chunk
+    std::unordered_map<long long int, std::pair<int, int>> nodeEdgeCounts;
+    std::vector<int> chunkNodeCounts(grid.rows * grid.cols), chunkEdgeCounts(grid.rows * grid.cols);
+    size_t edgeCount = 0;
+    for (const ParsedRange &range : edgeRanges)
+    {
+        for (const ParsedEdge &edge : range.edges)
+        {
+            nodeEdgeCounts[edge.sourceNodeId].first++;
+            nodeEdgeCounts[edge.targetNodeId].second++;
+            if (grid.contains(edge.chunkRow, edge.chunkCol))
+                chunkEdgeCounts[edge.chunkRow * grid.cols + edge.chunkCol]++;
+        }
+        edgeCount += range.edges.size();
+    }
+    std::printf("parsed %zu car edges and the nodes with %d threads in %.2f s\n", edgeCount, threadCount, seconds());
+
+    std::string importPath = dbPath + ".import";
+    std::filesystem::remove(importPath);
+    {
+        Importer importer(importPath);
+        if (importer.open())
+        {
+            importer.insertEdges(edgeRanges);
+            importer.insertNodes(nodeRanges, grid, nodeEdgeCounts, chunkNodeCounts);
+            importer.insertChunks(grid, chunkNodeCounts, chunkEdgeCounts);
+            std::printf("inserted the rows in %.2f s\n", seconds());
+            importer.finish();
+        }
+        if (importer.failed() || !std::filesystem::exists(importPath))
+        {
+            std::printf("import failed: %s\n", importer.getError().c_str());
+            return 1;
+        }
+    }
+
+    std::filesystem::rename(importPath, dbPath);
+    std::printf("built the indices and wrote %s in %.2f s\n", dbPath.c_str(), seconds());
+    return 0;
+}
@@ -0,0 +1,142 @@
+// Converts the edge points of an existing map database to the binary `path_geometry` column.
+// Every edge gets a blob encoded from its text points. Then the decode time of the text and the
+// binary points is compared on every edge, and the text is emptied so the database shrinks.
+//
+// usage: migrate_geometry <db> [--keep-text]
+//
+// `--keep-text` leaves the text points in place, so the comparison can be run again.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "../edge.h"
+
+// One edge as it is stored in the database
+struct StoredEdge
+{
+    std::string text;
+    std::vector<char> blob;
+};
+
+// The PointPath parser before the binary column, one string per point and coordinate
+std::vector<sf::Vector2<double>> parseTextSplit(const std::string &text)
+{
+    std::vector<sf::Vector2<double>> points;
+    for (auto part : splitString(text, ","))
+    {
+        auto lonLat = splitString(part, " ");
+        points.push_back(sf::Vector2<double>(stod(lonLat.at(0)), stod(lonLat.at(1))));
+    }
+    return points;
+}
+
+template <typename Decode>
+double timeDecode(const std::vector<StoredEdge> &edges, size_t &pointCount, Decode decode)
+{
+    pointCount = 0;
+    auto startTime = std::chrono::steady_clock::now();
+    for (const StoredEdge &edge : edges)
+        pointCount += decode(edge);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::printf("usage: %s <db> [--keep-text]\n", argv[0]);
+        return 1;
+    }
+
+    std::string dbPath = argv[1];
+    bool keepText = argc > 2 && std::string(argv[2]) == "--keep-text";
+    if (!std::filesystem::exists(dbPath))
+    {
+        std::printf("%s does not exist\n", dbPath.c_str());
+        return 1;
+    }
+
+    auto sizeBefore = std::filesystem::file_size(dbPath);
+    long long int encoded = sql::addEdgeGeometry(dbPath);
+    std::printf("encoded the points of %lld edges\n", encoded);
+
+    // read the raw columns once so that only decoding is timed
+    std::vector<StoredEdge> edges;
+    size_t textBytes = 0, blobBytes = 0;
+    {
+        sqlite3 *db;
+        sqlite3_stmt *statement;
+        sqlite3_open_v2(dbPath.c_str(), &db, SQLITE_OPEN_READONLY, nullptr);
+        sqlite3_prepare_v2(db, "SELECT path_offset_points, path_geometry FROM edge", -1, &statement, nullptr);
+        while (sqlite3_step(statement) == SQLITE_ROW)
+        {
+            StoredEdge edge;
+            if (auto text = (const char *)sqlite3_column_text(statement, 0))
+                edge.text = text;
+            auto blob = (const char *)sqlite3_column_blob(statement, 1);
+            edge.blob.assign(blob, blob + sqlite3_column_bytes(statement, 1));
+
+            textBytes += edge.text.size();
+            blobBytes += edge.blob.size();
+            edges.push_back(std::move(edge));
+        }
+        sqlite3_finalize(statement);
+        sqlite3_close(db);
+    }
+    std::printf("%zu edges, text points %.1f MB, binary points %.1f MB (%.1f%%)\n", edges.size(),
+                textBytes / 1048576.0, blobBytes / 1048576.0, textBytes ? 100.0 * blobBytes / textBytes : 0.0);
+
+    size_t binaryPoints;
+    std::vector<sf::Vector2<double>> buffer;
+    double binaryTime = timeDecode(edges, binaryPoints, [&](const StoredEdge &edge)
+                                   { geocodec::decodeInto(edge.blob, buffer); return buffer.size(); });
+
+    if (textBytes == 0)
+    {
+        std::printf("binary decode: %.1f ms for %zu points, no text points left to compare\n", binaryTime, binaryPoints);
+    }
+    else
+    {
+        size_t splitPoints, strtodPoints;
+        double splitTime = timeDecode(edges, splitPoints, [](const StoredEdge &edge)
+                                      { return parseTextSplit(edge.text).size(); });
+        double strtodTime = timeDecode(edges, strtodPoints, [](const StoredEdge &edge)
+                                       { return PointPath(edge.text).points.size(); });
+
+        // the blobs must give the same points as the text, up to the fixed point step
+        double maxError = 0;
+        for (const StoredEdge &edge : edges)
+        {
+            geocodec::decodeInto(edge.blob, buffer);
+            PointPath textPath(edge.text);
+            if (textPath.points.size() != buffer.size())
+            {
+                std::printf("point count mismatch: %zu text vs %zu binary points\n", textPath.points.size(), buffer.size());
+                return 1;
+            }
+            for (size_t i = 0; i < buffer.size(); ++i)
+                maxError = std::max({maxError, std::abs(buffer[i].x - textPath.points[i].x), std::abs(buffer[i].y - textPath.points[i].y)});
+        }
+
+        std::printf("%-22s %10s %10s %12s\n", "decoder", "time_ms", "points", "speedup");
+        std::printf("%-22s %10.1f %10zu %12s\n", "text, split strings", splitTime, splitPoints, "1.0x");
+        std::printf("%-22s %10.1f %10zu %11.1fx\n", "text, strtod", strtodTime, strtodPoints, splitTime / strtodTime);
+        std::printf("%-22s %10.1f %10zu %11.1fx\n", "binary, reused buffer", binaryTime, binaryPoints, splitTime / binaryTime);
+        std::printf("largest coordinate difference %.2g degrees\n", maxError);
+    }
+
+    if (!keepText)
+    {
+        sql::dropEdgeText(dbPath);
+        std::printf("emptied the text points and vacuumed the database\n");
+    }
+
+    auto sizeAfter = std::filesystem::file_size(dbPath);
+    std::printf("database size %.1f MB -> %.1f MB (%.1f%%)\n", sizeBefore / 1048576.0, sizeAfter / 1048576.0, 100.0 * sizeAfter / sizeBefore);
+    return 0;
+}
@@ -0,0 +1,226 @@
+// Headless batch router. Reads origin/destination pairs from a CSV file, routes them on a pool of
+// worker threads and writes one result row per pair. Does not open a window.
+//
+// usage: osm_router_batch <input csv> <output csv> [--algorithm astar] [--profile distance] [--traffic feed.csv] [--threads 4] [--db ./db/map.db] [--config ./config/config.toml]
+//
+// input rows:  origin_lon,origin_lat,destination_lon,destination_lat (a header row is skipped)
+// output rows: query,status,origin_node,destination_node,distance_meters,edge_count,time_ms,edges
+// `edges` lists the database ids of the edges on the route separated by spaces, an edge that is
+// driven against its stored direction is written with a minus sign.
+// --profile    what the routes minimise: `distance`, or the travel time by `car`, `bike` or `foot`.
+//              The distance column is in meters for every profile.
+// --traffic    a traffic feed file, rows of `edge id,speed km/h`, applied to the car weights before routing
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tomlplusplus/toml.hpp"
+
+#include "../algorithms.h"
+
+struct BatchQuery
+{
+    double originLon, originLat, destinationLon, destinationLat;
+};
+
+struct BatchResult
+{
+    std::string status = "ok";
+    GraphNodeIndex originNode = -1;
+    GraphNodeIndex destinationNode = -1;
+    long long int distanceMeters = 0;
+    vector<GraphEdgeIndex> path;
+    double milliseconds = 0;
+};
+
+/**
+ * Reads the query pairs from a CSV file. Lines that do not start with four numbers, like a header
+ * row, are skipped.
+ */
+vector<BatchQuery> readQueries(const std::string &path)
+{
+    vector<BatchQuery> queries;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::stringstream stream(line);
+        std::string cell;
+        double values[4];
+        int count = 0;
+        while (count < 4 && std::getline(stream, cell, ','))
+        {
+            char *end = nullptr;
+            values[count] = std::strtod(cell.c_str(), &end);
+            if (end == cell.c_str())
+                break;
+            count++;
+        }
+
+        if (count == 4)
+            queries.push_back(BatchQuery{values[0], values[1], values[2], values[3]});
+    }
+    return queries;
+}
+
+/**
+ * Snaps both ends of a query to the nearest graph node and routes between them. The algorithms that
+ * snap to roads instead (see Algorithms::snapsToRoads) route between the nearest points on roads,
+ * the distance then only counts the driven parts of the first and last edge.
+ */
+BatchResult runQuery(const BatchQuery &query, AlgoName algorithm, RoutingProfile profile, Algorithms &algorithms, MapGraph &graph, const MapGeometry &geometry)
+{
+    BatchResult result;
+    auto startTime = std::chrono::steady_clock::now();
+
+    sf::Vector2<double> origin = geometry.offsetGeoVector({query.originLon, query.originLat});
+    sf::Vector2<double> destination = geometry.offsetGeoVector({query.destinationLon, query.destinationLat});
+    // -1 for a point outside of the map
+    result.originNode = graph.findNearestNode(origin.x, origin.y);
+    result.destinationNode = graph.findNearestNode(destination.x, destination.y);
+
+    if (result.originNode == -1 || result.destinationNode == -1)
+    {
+        result.status = "no_node";
+    }
+    else
+    {
+        result.path = algorithms.findShortestPath(origin, destination, algorithm, graph, false, CancellationToken::none(), profile);
+        if (Algorithms::snapsToRoads(algorithm))
+        {
+            RoadSnap originSnap = graph.snapToRoad(origin.x, origin.y), destinationSnap = graph.snapToRoad(destination.x, destination.y);
+            result.distanceMeters = graph.getPathLength(result.path, &originSnap, &destinationSnap);
+        }
+        else
+        {
+            result.distanceMeters = graph.getPathLength(result.path);
+        }
+
+        // a path between two points on roads has at least one edge, between two nodes it is empty if they are the same
+        if (result.path.empty() && (Algorithms::snapsToRoads(algorithm) || result.originNode != result.destinationNode))
+            result.status = "no_route";
+    }
+
+    result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    return result;
+}
+
+void writeResults(const std::string &path, const vector<BatchResult> &results, MapGraph &graph)
+{
+    std::ofstream file(path);
+    file << "query,status,origin_node,destination_node,distance_meters,edge_count,time_ms,edges\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BatchResult &result = results[i];
+        file << i << ',' << result.status << ',' << result.originNode << ',' << result.destinationNode << ','
+             << result.distanceMeters << ',' << result.path.size() << ',' << result.milliseconds << ',';
+        for (size_t j = 0; j < result.path.size(); ++j)
+        {
+            GraphEdge edge = graph.getEdge(result.path[j]);
+            file << (j ? " " : "") << (edge.isPrimary ? edge.sqlID : -edge.sqlID);
+        }
+        file << '\n';
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::printf("usage: %s <input csv> <output csv> [--algorithm astar] [--profile distance] [--traffic feed.csv] [--threads 4] [--db ./db/map.db] [--config ./config/config.toml]\n", argv[0]);
+        return 1;
+    }
+
+    std::string inputPath = argv[1], outputPath = argv[2];
+    std::string dbPath = "./db/map.db", configPath = "./config/config.toml";
+    AlgoName algorithm = AlgoName::AStar;
+    RoutingProfile profile = RoutingProfile::Distance;
+    std::string trafficPath;
+    int threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 3; i + 1 < argc; i += 2)
+    {
+        std::string option = argv[i], value = argv[i + 1];
+        if (option == "--algorithm" && !parseAlgoName(value, algorithm))
+        {
+            std::printf("unknown algorithm %s\n", value.c_str());
+            return 1;
+        }
+        else if (option == "--profile" && !parseRoutingProfile(value, profile))
+        {
+            std::printf("unknown profile %s\n", value.c_str());
+            return 1;
+        }
+        else if (option == "--traffic")
+            trafficPath = value;
+        else if (option == "--threads")
+            threadCount = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--db")
+            dbPath = value;
+        else if (option == "--config")
+            configPath = value;
+    }
+
+    if (!Algorithms::supportsProfile(algorithm, profile))
+    {
+        std::printf("%s only routes by distance\n", algoNameToString(algorithm).c_str());
+        return 1;
+    }
+
+    auto config = toml::parse_file(configPath);
+    double mapTop = *config["map"]["bbox_top"].value<double>();
+    double mapLeft = *config["map"]["bbox_left"].value<double>();
+    double mapBottom = *config["map"]["bbox_bottom"].value<double>();
+    double mapRight = *config["map"]["bbox_right"].value<double>();
+    double chunkSize = *config["map"]["chunk_size"].value<double>();
+    MapGeometry geometry(1, {mapTop, mapLeft, mapRight - mapLeft, mapTop - mapBottom}, chunkSize);
+
+    // the preprocessed files live next to the database, the same as for the app
+    std::filesystem::path dataPath(dbPath);
+    MapGraph graph;
+    graph.load(dbPath, dataPath.replace_extension(".graph").string());
+
+    Algorithms algorithms;
+    if (algorithm == AlgoName::ALT || algorithm == AlgoName::BidirectionalALT)
+        algorithms.prepareLandmarks(graph, dataPath.replace_extension(".alt").string(), *config["routing"]["landmarks"].value<int>());
+    if (algorithm == AlgoName::ContractionHierarchies)
+        algorithms.prepareContractionHierarchy(graph, dataPath.replace_extension(".ch").string());
+    if (!trafficPath.empty())
+    {
+        algorithms.getTrafficOverlay().init(graph);
+        TrafficBatchStats traffic = algorithms.getTrafficOverlay().apply(readSpeedUpdates(trafficPath));
+        std::printf("applied %d traffic updates in %.1f ms, %d unknown roads, %d edges slowed\n", traffic.appliedUpdates, traffic.milliseconds, traffic.unknownRoads, traffic.slowedEdges);
+    }
+
+    vector<BatchQuery> queries = readQueries(inputPath);
+    vector<BatchResult> results(queries.size());
+
+    // every worker takes the next unrouted query until none are left
+    auto startTime = std::chrono::steady_clock::now();
+    std::atomic<size_t> nextQuery = 0;
+    vector<std::thread> workers;
+    for (int i = 0; i < threadCount; ++i)
+    {
+        workers.emplace_back([&]()
+                             {
+            for (size_t query = nextQuery++; query < queries.size(); query = nextQuery++)
+                results[query] = runQuery(queries[query], algorithm, profile, algorithms, graph, geometry); });
+    }
+    for (std::thread &worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    writeResults(outputPath, results, graph);
+    std::printf("routed %zu queries with %s by %s on %d threads in %.3f s\n", queries.size(), algoNameToString(algorithm).c_str(),
+                routingProfileToString(profile).c_str(), threadCount, seconds);
+
+    return 0;
+}
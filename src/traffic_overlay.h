@@ -0,0 +1,286 @@
+#pragma once
+
+#include <cmath>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+#include <filesystem>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "graph.h"
+
+// A new speed for one road, a row of the traffic feed
+struct SpeedUpdate
+{
+    long long int sqlID; // the road's id in the database edge table, see GraphEdge::sqlID
+    double speed;        // km/h in both directions of the road, 0 closes the road and below 0 returns it to free flow
+};
+
+/**
+ * One version of the live car weights. A snapshot never changes once it is published, searches
+ * take the current one when they start and read only it, so a route never mixes the weights of
+ * two feed batches.
+ */
+struct TrafficSnapshot
+{
+    long long int version = 0; // number of batches applied up to this snapshot
+    Column<int> carWeights;    // every edge's car weight with the traffic applied, empty while all roads flow freely
+    int slowedEdges = 0;       // edges whose weight is above free flow, closed ones included
+
+    // The weight column a search by the profile reads, the graph's own one unless traffic changed it.
+    const Column<int> &getEdgeWeights(const MapGraph &graph, RoutingProfile profile) const
+    {
+        if (profile == RoutingProfile::Car && carWeights.size() > 0)
+            return carWeights;
+        return graph.getEdgeWeights(profile);
+    }
+};
+
+struct TrafficBatchStats
+{
+    long long int version = 0; // of the snapshot the batch published
+    int appliedUpdates = 0;
+    int unknownRoads = 0; // updates for an id that is not a road of the graph, they are skipped
+    int slowedEdges = 0;
+    double milliseconds = 0;
+};
+
+/**
+ * Live traffic on top of the car weights of a MapGraph.
+ *
+ * Every batch of speed updates copies the car weights of the current snapshot, applies the
+ * updates to the copy and publishes it as the new snapshot (read-copy-update). Readers only copy
+ * the shared pointer to the current snapshot, so they never wait for a batch to be applied, and
+ * an old snapshot is freed when the last search reading it finishes. Writers take turns.
+ *
+ * Traffic only ever slows roads down: a weight is never below the free flow weight of the edge.
+ * So the A* heuristics, which assume the profile's highest speed, stay lower bounds. The landmarks
+ * and the contraction hierarchy are built on distance weights, which traffic does not change, so
+ * they need no repair after a batch. Precomputed data on car weights would stay valid for the
+ * same reason as long as it is computed on the free flow weights, see MapGraph::getEdgeWeights.
+ */
+class TrafficOverlay
+{
+public:
+    TrafficOverlay() : snapshot(std::make_shared<TrafficSnapshot>()) {}
+
+    TrafficOverlay(const TrafficOverlay &) = delete;
+    TrafficOverlay &operator=(const TrafficOverlay &) = delete;
+
+    /**
+     * Indexes the roads of the graph by their database id. Must be called once the graph is
+     * loaded, before the first batch.
+     */
+    void init(const MapGraph &graph)
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+
+        roadOfSQLId.clear();
+        roadOfSQLId.reserve(graph.getRoadCount());
+        for (int road = 0; road < graph.getRoadCount(); ++road)
+        {
+            GraphEdgeIndex edgeIndex = graph.getRoadEdge(road, true) != -1 ? graph.getRoadEdge(road, true) : graph.getRoadEdge(road, false);
+            if (edgeIndex != -1)
+                roadOfSQLId.emplace(graph.getEdge(edgeIndex).sqlID, road);
+        }
+        this->graph = &graph;
+    }
+
+    bool isReady() const
+    {
+        return graph != nullptr;
+    }
+
+    // The latest published snapshot, never nullptr. Keep it for as long as its weights are read.
+    std::shared_ptr<const TrafficSnapshot> current() const
+    {
+        return std::atomic_load_explicit(&snapshot, std::memory_order_acquire);
+    }
+
+    /**
+     * Applies a batch of speed updates and publishes the result as the new snapshot. Searches
+     * that are running keep the snapshot they started with. Updates for the same road apply in
+     * order, so the last one wins.
+     */
+    TrafficBatchStats apply(const std::vector<SpeedUpdate> &updates)
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        auto startTime = std::chrono::steady_clock::now();
+        TrafficBatchStats stats;
+        const MapGraph *graph = this->graph.load();
+        if (!graph)
+        {
+            stats.unknownRoads = updates.size();
+            return stats;
+        }
+
+        std::shared_ptr<const TrafficSnapshot> previous = current();
+        const Column<int> &freeFlow = graph->getEdgeWeights(RoutingProfile::Car);
+        const Column<int> &previousWeights = previous->getEdgeWeights(*graph, RoutingProfile::Car);
+        std::vector<int> weights(previousWeights.begin(), previousWeights.end());
+        int slowedEdges = previous->slowedEdges;
+
+        // resolve all road ids first, then apply the weights
+        updateRoads.resize(updates.size());
+        for (size_t i = 0; i < updates.size(); ++i)
+        {
+            auto road = roadOfSQLId.find(updates[i].sqlID);
+            updateRoads[i] = road != roadOfSQLId.end() ? road->second : -1;
+        }
+
+        for (size_t i = 0; i < updates.size(); ++i)
+        {
+            if (updateRoads[i] == -1)
+            {
+                stats.unknownRoads++;
+                continue;
+            }
+            stats.appliedUpdates++;
+
+            for (bool forward : {true, false})
+            {
+                GraphEdgeIndex edgeIndex = graph->getRoadEdge(updateRoads[i], forward);
+                if (edgeIndex == -1 || freeFlow[edgeIndex] == forbiddenWeight)
+                    continue;
+
+                int weight = trafficWeight(graph->getEdgeLength(edgeIndex), freeFlow[edgeIndex], updates[i].speed);
+                slowedEdges += (weight != freeFlow[edgeIndex]) - (weights[edgeIndex] != freeFlow[edgeIndex]);
+                weights[edgeIndex] = weight;
+            }
+        }
+
+        auto next = std::make_shared<TrafficSnapshot>();
+        next->version = previous->version + 1;
+        next->slowedEdges = slowedEdges;
+        if (slowedEdges > 0)
+            next->carWeights.assign(std::move(weights));
+        std::atomic_store_explicit(&snapshot, std::shared_ptr<const TrafficSnapshot>(std::move(next)), std::memory_order_release);
+
+        stats.version = previous->version + 1;
+        stats.slowedEdges = slowedEdges;
+        stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        return stats;
+    }
+
+    // Returns every road to free flow.
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        auto next = std::make_shared<TrafficSnapshot>();
+        next->version = current()->version + 1;
+        std::atomic_store_explicit(&snapshot, std::shared_ptr<const TrafficSnapshot>(std::move(next)), std::memory_order_release);
+    }
+
+private:
+    // The car weight of an edge of `meters` at `speed` km/h, never below its free flow weight.
+    static int trafficWeight(int meters, int freeFlowWeight, double speed)
+    {
+        if (speed < 0)
+            return freeFlowWeight;
+        if (speed == 0)
+            return forbiddenWeight;
+
+        double weight = std::ceil(meters * 3600.0 / speed);
+        return (int)std::clamp(weight, (double)freeFlowWeight, (double)forbiddenWeight - 1);
+    }
+
+    std::mutex writerMutex;
+    std::atomic<const MapGraph *> graph = nullptr;
+    std::unordered_map<long long int, int> roadOfSQLId; // the roads with a graph edge, by database id
+    std::vector<int> updateRoads; // the road of every update of the batch being applied, -1 if unknown
+    std::shared_ptr<const TrafficSnapshot> snapshot; // only accessed through std::atomic_load and std::atomic_store
+};
+
+/**
+ * Reads the speed updates of a traffic feed file. Every row is `edge id,speed` with the speed in
+ * km/h, see SpeedUpdate. Lines that do not start with two numbers, like a header row, are skipped.
+ */
+inline std::vector<SpeedUpdate> readSpeedUpdates(const std::string &path)
+{
+    std::vector<SpeedUpdate> updates;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        char *end = nullptr;
+        long long int sqlID = std::strtoll(line.c_str(), &end, 10);
+        if (end == line.c_str() || *end != ',')
+            continue;
+
+        const char *speedStart = end + 1;
+        double speed = std::strtod(speedStart, &end);
+        if (end == speedStart)
+            continue;
+        updates.push_back(SpeedUpdate{sqlID, speed});
+    }
+    return updates;
+}
+
+/**
+ * Applies a traffic feed file to an overlay every time the file changes, on a thread of its own.
+ * The file is checked every `interval`. Each version of the file is one batch, so a feed only
+ * needs to list the roads whose speed changed since it was last written.
+ */
+class TrafficFeedWatcher
+{
+public:
+    ~TrafficFeedWatcher()
+    {
+        stop();
+    }
+
+    /**
+     * @param onApplied Called on the watcher thread after every batch
+     */
+    void start(std::string path, TrafficOverlay &overlay, std::chrono::milliseconds interval, std::function<void(const TrafficBatchStats &)> onApplied)
+    {
+        stop();
+        isStopping = false;
+        worker = std::thread([this, path, &overlay, interval, onApplied]()
+                             {
+            std::filesystem::file_time_type appliedTime;
+            std::unique_lock<std::mutex> lock(stopMutex);
+            while (!isStopping)
+            {
+                std::error_code error;
+                std::filesystem::file_time_type modifiedTime = std::filesystem::last_write_time(path, error);
+                if (!error && modifiedTime != appliedTime)
+                {
+                    appliedTime = modifiedTime;
+                    lock.unlock();
+                    TrafficBatchStats stats = overlay.apply(readSpeedUpdates(path));
+                    if (onApplied)
+                        onApplied(stats);
+                    lock.lock();
+                }
+                stopped.wait_for(lock, interval, [this]()
+                                 { return isStopping; });
+            } });
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(stopMutex);
+            isStopping = true;
+        }
+        stopped.notify_all();
+        if (worker.joinable())
+            worker.join();
+    }
+
+private:
+    std::thread worker;
+    std::mutex stopMutex;
+    std::condition_variable stopped;
+    bool isStopping = false;
+};
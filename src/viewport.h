@@ -101,6 +101,20 @@ public:
         }
     }
 
+    /*
+    Get the velocity the viewport is currently panning with.
+    @returns pixels per second on each axis, zero on an axis that is not panning
+    */
+    sf::Vector2<double> getPanVelocity() const
+    {
+        sf::Vector2<double> velocity(0, 0);
+        if (isPanningUp ^ isPanningDown)
+            velocity.y = isPanningUp ? -panVelocity : panVelocity;
+        if (isPanningLeft ^ isPanningRight)
+            velocity.x = isPanningLeft ? -panVelocity : panVelocity;
+        return velocity;
+    }
+
     /*
     Convert a point that is relative to the viewport to one that is
     relative to the viewport's bounding area. For example, if the viewport